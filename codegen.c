@@ -28,8 +28,42 @@ static int count(void) {
 }
 
 
+// 局部变量寻址使用的寄存器，及其相对于fp的偏移
+// 省略帧指针时为sp，函数体中sp不再移动
+static char *FrameReg = "fp";
+static int FrameBias;
+
+// 省略帧指针时，表达式栈是栈帧中固定的一块区域，
+// 压栈和弹栈只读写其中的槽，不再移动sp，调用前也就无需对齐
+//
+//      ----------------------  // 调用者的sp
+//          表达式栈 MaxDepth个槽
+//      ----------------------  // sp + ExprBase
+//          ra (非叶函数)
+//      ----------------------  // sp + StackSize
+//          局部变量
+//      ----------------------  // sp
+static bool OmitFP;
+static int ExprBase;
+static int MaxDepth;
+// 当前函数是否没有调用，叶函数无需保存ra
+static bool IsLeaf;
+// 是否有尾调用跳转到函数末尾
+static bool HasTailExit;
+// 直接尾调用的函数，每个在函数末尾有各自的出口
+static char **TailCallees;
+static int NumTailCallees;
+
+static char *exprSlot(int D);
+static int frameSize(void);
+
 // 压栈，将结果临时(a0)压入栈中备用.
 static void push(void) {
+    if (OmitFP) {
+        println("  sd a0, %s", exprSlot(Depth++));
+        MaxDepth = MAX(MaxDepth, Depth);
+        return;
+    }
     println("  addi sp, sp, -8");
     println("  sd a0, 0(sp)");
     Depth++;
@@ -37,6 +71,10 @@ static void push(void) {
 
 // 弹栈，将sp指向的地址的值，弹出到a1
 static void pop(int Reg) {
+    if (OmitFP) {
+        println("  ld a%d, %s", Reg, exprSlot(--Depth));
+        return;
+    }
     println("  ld a%d, 0(sp)", Reg);
     println("  addi sp, sp, 8");
     Depth--;
@@ -44,6 +82,11 @@ static void pop(int Reg) {
 
 // 对于浮点类型进行压栈
 static void pushF(void) {
+    if (OmitFP) {
+        println("  fsd fa0, %s", exprSlot(Depth++));
+        MaxDepth = MAX(MaxDepth, Depth);
+        return;
+    }
     println("  addi sp, sp, -8");
     println("  fsd fa0, 0(sp)");
     Depth++;
@@ -51,36 +94,150 @@ static void pushF(void) {
 
 // 对于浮点类型进行弹栈
 static void popF(int Reg) {
+    if (OmitFP) {
+        println("  fld fa%d, %s", Reg, exprSlot(--Depth));
+        return;
+    }
     println("  fld fa%d, 0(sp)", Reg);
     println("  addi sp, sp, 8");
     Depth--;
 }
 
-static void genExpr(Node *Nd);
-static void genStmt(Node *Nd);
+// 表达式临时值使用的寄存器池(均为调用者保存的寄存器)
+// -O1起，二元运算先算出的一侧暂存于此，而不是压栈
+// t0, t1, t5已被用作地址计算、结构体复制和函数地址，不放入池中
+static char *TmpRegs[] = {"t2", "t3", "t4", "t6"};
+static char *TmpFRegs[] = {"ft0", "ft1", "ft2", "ft3", "ft4", "ft5", "ft6", "ft7"};
+#define TMP_REGS (int)(sizeof(TmpRegs) / sizeof(*TmpRegs))
+#define TMP_FREGS (int)(sizeof(TmpFRegs) / sizeof(*TmpFRegs))
+// 当前被占用的临时寄存器数，按栈的方式分配和释放
+static int TmpDepth;
+static int TmpFDepth;
 
-// 将函数实参计算后压入栈中
-static void pushArgs(Node *Args) {
-    // 参数为空直接返回
-    if (!Args)
-        return;
+// 含有函数调用的子树的寄存器需求，调用会破坏所有临时寄存器
+#define NEED_CALL 0x100
 
-    // 递归到最后一个实参进行
-    pushArgs(Args->Next);
+// 块内存的清零和复制按大小分三档：
+// 存取次数不多时展开，字节数不多时用循环，更大时调用C库的memset/memcpy
+// 展开时最多使用的存取指令数
+#define BLOCK_UNROLL_MAX 16
+// 用循环处理的最大字节数
+#define BLOCK_LOOP_MAX 256
+// 循环体中展开的存取次数
+#define BLOCK_LOOP_UNROLL 4
 
-    println("\n  # ↓对%s表达式进行计算，然后压栈↓",
-            isFloNum(Args->Ty) ? "浮点" : "整型");
-    // 计算出表达式
-    genExpr(Args);
-    // 根据表达式结果的类型进行压栈
-    if (isFloNum(Args->Ty)) {
-        pushF();
-    } else {
-        push();
+// 节点是否会被生成为对memset/memcpy的调用
+static bool blockCall(Node *Nd) {
+    if (!OptLevel)
+        return false;
+    if (Nd->Kind == ND_MEMZERO)
+        return Nd->Var->Ty->Size > BLOCK_LOOP_MAX;
+    if (Nd->Kind == ND_ASSIGN && isStructOrUnion(Nd->Ty))
+        return Nd->Ty->Size > BLOCK_LOOP_MAX;
+    // 返回结构体时复制到调用者给出的地址中
+    if (Nd->Kind == ND_RETURN && Nd->LHS && isStructOrUnion(Nd->LHS->Ty))
+        return Nd->LHS->Ty->Size > BLOCK_LOOP_MAX;
+    return false;
+}
+
+// Sethi-Ullman编号：计算子树求值所需的寄存器数
+// 叶子节点需要1个(a0)，左右需求相同的二元节点需要多1个
+// 结果缓存在Nd->RegNeed中
+int regNeed(Node *Nd) {
+    if (!Nd)
+        return 0;
+    if (Nd->RegNeed)
+        return Nd->RegNeed;
+
+    int N;
+    if (blockCall(Nd))
+        return Nd->RegNeed = NEED_CALL;
+    switch (Nd->Kind) {
+        case ND_NUM:
+        case ND_VAR:
+        case ND_MEMZERO:
+        case ND_NULL_EXPR:
+            N = 1;
+            break;
+        // 语句表达式内可能有任意语句，按调用保守处理
+        case ND_FUNCALL:
+        case ND_STMT_EXPR:
+            N = NEED_CALL;
+            break;
+        case ND_NEG:
+        case ND_NOT:
+        case ND_BITNOT:
+        case ND_CLZ:
+        case ND_CTZ:
+        case ND_POPCOUNT:
+        case ND_CAST:
+        case ND_DEREF:
+        case ND_ADDR:
+        case ND_MEMBER:
+            N = regNeed(Nd->LHS);
+            break;
+        // 以下节点两侧的值不会同时存活
+        case ND_COMMA:
+        case ND_LOGAND:
+        case ND_LOGOR:
+            N = MAX(regNeed(Nd->LHS), regNeed(Nd->RHS));
+            break;
+        case ND_COND:
+            N = MAX(regNeed(Nd->Cond), MAX(regNeed(Nd->Then), regNeed(Nd->Els)));
+            break;
+        // 二元运算和赋值
+        default: {
+            int L = regNeed(Nd->LHS);
+            int R = regNeed(Nd->RHS);
+            N = L == R ? L + 1 : MAX(L, R);
+            break;
+        }
     }
-    println("  # ↑结束压栈↑");
+    return Nd->RegNeed = N;
+}
+
+// 子树中是否有函数调用
+static bool hasCall(Node *Nd) {
+    return regNeed(Nd) >= NEED_CALL;
 }
 
+// 语句或表达式中是否有函数调用
+static bool callsFunc(Node *Nd) {
+    if (!Nd)
+        return false;
+    if (Nd->Kind == ND_FUNCALL || blockCall(Nd))
+        return true;
+    if (callsFunc(Nd->LHS) || callsFunc(Nd->RHS) || callsFunc(Nd->Cond) ||
+        callsFunc(Nd->Then) || callsFunc(Nd->Els) || callsFunc(Nd->Init) ||
+        callsFunc(Nd->Inc))
+        return true;
+    for (Node *N = Nd->Body; N; N = N->Next)
+        if (callsFunc(N))
+            return true;
+    return false;
+}
+
+// 二元运算是否先求值左侧
+// 优化阶段固定了顺序的节点按其要求，否则-O0先算右侧，
+// -O1起先算需求大的一侧(含调用的一侧总是先算)，相同时先算右侧
+bool lhsFirst(Node *Nd) {
+    if (Nd->Order != ORD_ANY)
+        return Nd->Order == ORD_LHS;
+    if (!OptLevel)
+        return false;
+    int NL = regNeed(Nd->LHS);
+    int NR = regNeed(Nd->RHS);
+    // 两侧都有调用时，需要压栈，保持原来的顺序
+    if (NL >= NEED_CALL && NR >= NEED_CALL)
+        return false;
+    return NL > NR;
+}
+
+static void genExpr(Node *Nd);
+static void genStmt(Node *Nd);
+static void genBranch(Node *Nd, bool Jump, char *Label);
+static bool genSelect(Node *Nd);
+
 // ImmI: 12 bits. [-2048, 2047]
 // addi, load
 static inline bool isLegalImmI(int i){
@@ -93,43 +250,76 @@ static inline bool isLegalImmS(int i){
     return isLegalImmI(i);
 }
 
+// 表达式栈第D个槽的地址，超出立即数范围时先将地址算到t0中
+static char *exprSlot(int D) {
+    int Offset = ExprBase + D * 8;
+    if (isLegalImmI(Offset))
+        return format("%d(sp)", Offset);
+    println("  li t0, %d", Offset);
+    println("  add t0, sp, t0");
+    return "0(t0)";
+}
+
+// sp加上Delta
+static void adjustSP(int Delta) {
+    if (isLegalImmI(Delta)) {
+        println("  addi sp, sp, %d", Delta);
+    } else {
+        println("  li t0, %d", Delta);
+        println("  add sp, sp, t0");
+    }
+}
+
+// 读写省略帧指针时ra在栈中的槽
+static void raSlot(char *Op) {
+    int Offset = CurrentFn->StackSize + 8;
+    if (isLegalImmI(Offset)) {
+        println("  %s ra, %d(sp)", Op, Offset);
+    } else {
+        println("  li t0, %d", Offset);
+        println("  add t0, sp, t0");
+        println("  %s ra, 0(t0)", Op);
+    }
+}
+
 // 将整形寄存器的值存入栈中
 static void storeGeneral(int Reg, int Offset, int Size) {
+    Offset += FrameBias;
     // 将%s寄存器的值存入%d(fp)的栈地址
     switch (Size) {
         case 1:
             if(isLegalImmS(Offset))
-                println("  sb a%d, %d(fp)", Reg, Offset);
+                println("  sb a%d, %d(%s)", Reg, Offset, FrameReg);
             else {
                 println("  li t0, %d", Offset);
-                println("  add t0, fp, t0");
+                println("  add t0, %s, t0", FrameReg);
                 println("  sb a%d, 0(t0)", Reg);
             }
             return;
         case 2:
             if(isLegalImmS(Offset))
-                println("  sh a%d, %d(fp)", Reg, Offset);
+                println("  sh a%d, %d(%s)", Reg, Offset, FrameReg);
             else {
                 println("  li t0, %d", Offset);
-                println("  add t0, fp, t0");
+                println("  add t0, %s, t0", FrameReg);
                 println("  sh a%d, 0(t0)", Reg);
             }
             return;
         case 4:
             if(isLegalImmS(Offset))
-                println("  sw a%d, %d(fp)", Reg, Offset);
+                println("  sw a%d, %d(%s)", Reg, Offset, FrameReg);
             else {
                 println("  li t0, %d", Offset);
-                println("  add t0, fp, t0");
+                println("  add t0, %s, t0", FrameReg);
                 println("  sw a%d, 0(t0)", Reg);
             }
             return;
         case 8:
             if(isLegalImmS(Offset))
-                println("  sd a%d, %d(fp)", Reg, Offset);
+                println("  sd a%d, %d(%s)", Reg, Offset, FrameReg);
             else {
                 println("  li t0, %d", Offset);
-                println("  add t0, fp, t0");
+                println("  add t0, %s, t0", FrameReg);
                 println("  sd a%d, 0(t0)", Reg);
             }
             return;
@@ -140,13 +330,14 @@ static void storeGeneral(int Reg, int Offset, int Size) {
 
 // 将浮点寄存器的值存入栈中
 static void storeFloat(int Reg, int Offset, int Sz) {
+    Offset += FrameBias;
     if(isLegalImmS(Offset)){
         switch (Sz) {
             case 4:
-                println("  fsw fa%d, %d(fp)", Reg, Offset);
+                println("  fsw fa%d, %d(%s)", Reg, Offset, FrameReg);
                 return;
             case 8:
-                println("  fsd fa%d, %d(fp)", Reg, Offset);
+                println("  fsd fa%d, %d(%s)", Reg, Offset, FrameReg);
                 return;
             default:
                 error("unreachable");
@@ -154,7 +345,7 @@ static void storeFloat(int Reg, int Offset, int Sz) {
     }
 
     println("  li t0, %d", Offset);
-    println("  add t0, fp, t0");
+    println("  add t0, %s, t0", FrameReg);
 
     switch (Sz) {
         case 4:
@@ -169,8 +360,8 @@ static void storeFloat(int Reg, int Offset, int Sz) {
 }
 
 
-// 加载a0(为一个地址)指向的值
-static void load(Type *Ty) {
+// 从访存地址Mem(如"8(sp)")加载值到a0(fa0)
+static void loadAt(Type *Ty, char *Mem) {
     // load will choose sext or zext according to the suffix
     // not necessary for double word, since it needs no extension
     char *Suffix = Ty->IsUnsigned ? "u" : "";
@@ -182,12 +373,12 @@ static void load(Type *Ty) {
     case TY_FUNC:
         return;
     case TY_FLOAT:
-        // 访问a0中存放的地址，取得的值存入fa0
-        println("  flw fa0, 0(a0)");
+        // 访问Mem，取得的值存入fa0
+        println("  flw fa0, %s", Mem);
         return;
     case TY_DOUBLE:
-        // 访问a0中存放的地址，取得的值存入fa0"
-        println("  fld fa0, 0(a0)");
+        // 访问Mem，取得的值存入fa0
+        println("  fld fa0, %s", Mem);
         return;
     default:
         break;
@@ -196,81 +387,253 @@ static void load(Type *Ty) {
     switch (Ty->Size)
     {
         case 1:
-            println("  lb%s a0, 0(a0)", Suffix);
+            println("  lb%s a0, %s", Suffix, Mem);
             break;
         case 2:
-            println("  lh%s a0, 0(a0)", Suffix);
+            println("  lh%s a0, %s", Suffix, Mem);
             break;
         case 4:
-            println("  lw%s a0, 0(a0)", Suffix);
+            println("  lw%s a0, %s", Suffix, Mem);
             break;
         case 8:
-            println("  ld a0, 0(a0)");  
+            println("  ld a0, %s", Mem);
             break;
         default:
             error("wtf");
     }
 }
 
-// 将a0存入栈顶值(为一个地址). used in assign, and lhs value's address was pushed to stack already
-static void store(Type *Ty) {
-    pop(1);
+// 加载a0(为一个地址)指向的值
+static void load(Type *Ty) {
+    loadAt(Ty, "0(a0)");
+}
+
+// 调用函数：Direct为真时直接调用名为Name的函数，
+// 否则调用t5中的函数，Name仅用于注释
+static void genCall(char *Name, bool Direct) {
+    // call由auipc+jalr组成，链接器可以将其松弛为一条jal
+    char *Insn = Direct ? format("call %s", Name) : format("jalr t5  # %s", Name);
+    if (OmitFP || Depth % 2 == 0) {
+        // 偶数深度，sp已经对齐16字节
+        println("  %s", Insn);
+    } else {
+        // 对齐sp到16字节的边界
+        println("  addi sp, sp, -8");
+        println("  %s", Insn);
+        println("  addi sp, sp, 8");
+    }
+}
+
+// 被调函数是否为函数名，而不是函数指针
+static bool isDirectCall(Node *Nd) {
+    return Nd->LHS->Kind == ND_VAR && Nd->LHS->Var->Ty->Kind == TY_FUNC;
+}
+
+// 存取W字节所用的指令
+static char *loadInsn(int W) {
+    return W == 8 ? "ld" : W == 4 ? "lw" : W == 2 ? "lh" : "lb";
+}
+
+static char *storeInsn(int W) {
+    return W == 8 ? "sd" : W == 4 ? "sw" : W == 2 ? "sh" : "sb";
+}
+
+// 按对齐选择一次存取的宽度
+// 基址按Align对齐，Pos为相对基址的偏移，宽度不超过剩余的Left字节
+static int chunkWidth(int Pos, int Align, int Left) {
+    for (int W = 8; W > 1; W /= 2)
+        if (W <= Align && W <= Left && Pos % W == 0)
+            return W;
+    return 1;
+}
+
+// 展开处理[Off, Off+Size)需要的存取次数
+static int numChunks(int Off, int Size, int Align) {
+    int N = 0;
+    for (int I = 0; I < Size; I += chunkWidth(Off + I, Align, Size - I))
+        N++;
+    return N;
+}
+
+// 按Align对齐的基址加上Off后的对齐
+static int offsetAlign(int Off, int Align) {
+    return (Off & -Off) && (Off & -Off) < Align ? Off & -Off : Align;
+}
+
+// 展开清零Base+Off起的Size个字节
+static void zeroUnrolled(char *Base, int Off, int Size, int Align) {
+    for (int I = 0, W; I < Size; I += W) {
+        W = chunkWidth(Off + I, Align, Size - I);
+        println("  %s zero, %d(%s)", storeInsn(W), Off + I, Base);
+    }
+}
+
+// 展开复制Src起的Size个字节到Dst，t1作为中转
+static void copyUnrolled(char *Src, char *Dst, int Size, int Align) {
+    for (int I = 0, W; I < Size; I += W) {
+        W = chunkWidth(I, Align, Size - I);
+        println("  %s t1, %d(%s)", loadInsn(W), I, Src);
+        println("  %s t1, %d(%s)", storeInsn(W), I, Dst);
+    }
+}
+
+// 将栈上FrameReg+Off起的Size个字节清零
+static void zeroBlock(int Off, int Size) {
+    char *Base = FrameReg;
+    int Align = 16;
+    bool Legal = isLegalImmS(Off) && isLegalImmS(Off + Size);
+
+    if (Size <= BLOCK_LOOP_MAX && numChunks(Off, Size, Align) <= BLOCK_UNROLL_MAX &&
+        Legal) {
+        zeroUnrolled(Base, Off, Size, Align);
+        return;
+    }
+
+    // 起始地址存入t0，调用memset时直接存入a0
+    char *Reg = Size > BLOCK_LOOP_MAX ? "a0" : "t0";
+    if (isLegalImmI(Off)) {
+        println("  addi %s, %s, %d", Reg, Base, Off);
+    } else {
+        println("  li t0, %d", Off);
+        println("  add %s, %s, t0", Reg, Base);
+    }
+    Align = offsetAlign(Off, Align);
+
+    if (Size > BLOCK_LOOP_MAX) {
+        println("  li a1, 0");
+        println("  li a2, %d", Size);
+        genCall("memset", true);
+        return;
+    }
+
+    if (numChunks(0, Size, Align) <= BLOCK_UNROLL_MAX) {
+        zeroUnrolled("t0", 0, Size, Align);
+        return;
+    }
+
+    // 循环每次清零Step个字节，t1为结束地址，剩余的不足一次的部分展开
+    int W = chunkWidth(0, Align, 8);
+    int Step = W * BLOCK_LOOP_UNROLL;
+    int Body = Size / Step * Step;
+    int C = count();
+    println("  addi t1, t0, %d", Body);
+    println(".L.zero.%d:", C);
+    zeroUnrolled("t0", 0, Step, W);
+    println("  addi t0, t0, %d", Step);
+    println("  bltu t0, t1, .L.zero.%d", C);
+    zeroUnrolled("t0", 0, Size - Body, W);
+}
+
+// 将a0指向的Size个字节复制到Addr指向的内存，两者都按Align对齐
+// 复制后a0仍指向一份相同的值
+static void copyBlock(char *Addr, int Size, int Align) {
+    if (Size > BLOCK_LOOP_MAX) {
+        if (!strcmp(Addr, "a1")) {
+            println("  mv t0, a1");
+            Addr = "t0";
+        }
+        println("  mv a1, a0");
+        println("  mv a0, %s", Addr);
+        println("  li a2, %d", Size);
+        genCall("memcpy", true);
+        return;
+    }
+
+    if (numChunks(0, Size, Align) <= BLOCK_UNROLL_MAX) {
+        copyUnrolled("a0", Addr, Size, Align);
+        return;
+    }
+
+    // 循环中t0和Addr分别为源和目的地址，a2为目的的结束地址
+    int W = chunkWidth(0, Align, 8);
+    int Step = W * BLOCK_LOOP_UNROLL;
+    int Body = Size / Step * Step;
+    int C = count();
+    println("  mv t0, a0");
+    println("  addi a2, %s, %d", Addr, Body);
+    println(".L.copy.%d:", C);
+    copyUnrolled("t0", Addr, Step, W);
+    println("  addi t0, t0, %d", Step);
+    println("  addi %s, %s, %d", Addr, Addr, Step);
+    println("  bltu %s, a2, .L.copy.%d", Addr, C);
+    copyUnrolled("t0", Addr, Size - Body, W);
+}
+
+// 将a0(fa0)存入访存地址Mem(如"8(sp)")
+static void storeAt(Type *Ty, char *Mem) {
+    switch (Ty->Kind) {
+        case TY_FLOAT:
+            println("  fsw fa0, %s", Mem);
+            return;
+        case TY_DOUBLE:
+            println("  fsd fa0, %s", Mem);
+            return;
+        default:
+            break;
+    }
+
+    switch (Ty->Size)
+    {
+        case 1:
+            println("  sb a0, %s", Mem);
+            break;
+        case 2:
+            println("  sh a0, %s", Mem);
+            break;
+        case 4:
+            println("  sw a0, %s", Mem);
+            break;
+        case 8:
+            println("  sd a0, %s", Mem);
+            break;
+        default:
+            error("wtf");
+    }
+}
+
+// 将a0存入Addr寄存器中存放的地址
+static void storeTo(Type *Ty, char *Addr) {
     switch(Ty->Kind){
         case TY_STRUCT:
         case TY_UNION:{
+            if (OptLevel) {
+                copyBlock(Addr, Ty->Size, Ty->Align);
+                return;
+            }
             // copy all the bytes from one struct to another
             int I = 0;
             while (I + 8 <= Ty->Size) {
                 println("  ld t1, %d(a0)", I);
-                println("  sd t1, %d(a1)", I);
+                println("  sd t1, %d(%s)", I, Addr);
                 I += 8;
             }
             while (I + 4 <= Ty->Size) {
                 println("  lw t1, %d(a0)", I);
-                println("  sw t1, %d(a1)", I);
+                println("  sw t1, %d(%s)", I, Addr);
                 I += 4;
             }
             while (I + 2 <= Ty->Size) {
                 println("  lh t1, %d(a0)", I);
-                println("  sh t1, %d(a1)", I);
+                println("  sh t1, %d(%s)", I, Addr);
                 I += 2;
             }
             while (I + 1 <= Ty->Size) {
                 println("  lb t1, %d(a0)", I);
-                println("  sb t1, %d(a1)", I);
+                println("  sb t1, %d(%s)", I, Addr);
                 I += 1;
             }
             return;
         }
-        case TY_FLOAT:
-            // 将fa0的值，写入到a1中存放的地址
-            println("  fsw fa0, 0(a1)");
-            return;
-        case TY_DOUBLE:
-            // 将fa0的值，写入到a1中存放的地址
-            println("  fsd fa0, 0(a1)");
-            return;
         default:
-            break;
+            storeAt(Ty, format("0(%s)", Addr));
+            return;
     }
+}
 
-    switch (Ty->Size)
-    {
-        case 1:
-            println("  sb a0, 0(a1)");
-            break;
-        case 2:
-            println("  sh a0, 0(a1)");
-            break;
-        case 4:
-            println("  sw a0, 0(a1)");
-            break;
-        case 8:
-            println("  sd a0, 0(a1)");
-            break;
-        default:
-            error("wtf");
-    }
+// 将a0存入栈顶值(为一个地址). used in assign, and lhs value's address was pushed to stack already
+static void store(Type *Ty) {
+    pop(1);
+    storeTo(Ty, "a1");
 }
 
 // 与0进行比较，不等于0则置1
@@ -292,6 +655,100 @@ static void notZero(Type *Ty) {
     }
 }
 
+//
+// 浮点常量池
+//
+
+// 常量池中的一个double，同一位模式只存放一份
+typedef struct FConst FConst;
+struct FConst {
+    uint64_t Bits;  // 位模式
+    int Id;         // 标签.L.fconst.Id的编号
+    FConst *Next;
+};
+
+static FConst *FConsts;
+
+// 浮点常量的位模式，需要按位重新解释而不是转换数值
+static uint64_t fconstBits(Node *Nd) {
+    if (Nd->Ty->Kind == TY_FLOAT) {
+        float F = Nd->FVal;
+        return *(uint32_t *)&F;
+    }
+    return *(uint64_t *)&Nd->FVal;
+}
+
+// 浮点常量是否从常量池中读取
+// float的位模式总能用lui+addi生成，只有double需要常量池；
+// li最多两条指令(lui+addi或addi+slli)就能生成的位模式也不放入常量池
+bool inFConstPool(Node *Nd) {
+    if (!OptLevel || Nd->Kind != ND_NUM || Nd->Ty->Kind != TY_DOUBLE)
+        return false;
+    int64_t V = fconstBits(Nd);
+    if (V == (int32_t)V)
+        return false;
+    V >>= __builtin_ctzll(V);
+    return V < -2048 || V >= 2048;
+}
+
+// 在常量池中查找或加入Bits，返回其编号
+static int fconstId(uint64_t Bits) {
+    for (FConst *C = FConsts; C; C = C->Next)
+        if (C->Bits == Bits)
+            return C->Id;
+    FConst *C = calloc(1, sizeof(FConst));
+    C->Bits = Bits;
+    C->Id = count();
+    C->Next = FConsts;
+    FConsts = C;
+    return C->Id;
+}
+
+// 将浮点常量装入fa0
+static void genFConst(Node *Nd) {
+    bool IsFloat = Nd->Ty->Kind == TY_FLOAT;
+    uint64_t Bits = fconstBits(Nd);
+    char *Suffix = IsFloat ? "w" : "d";
+
+    if (!OptLevel) {
+        println("  li a0, %lu  # %s %f", Bits, IsFloat ? "float" : "double", Nd->FVal);
+        println("  fmv.%s.x fa0, a0", Suffix);
+        return;
+    }
+
+    // +0.0的位模式全为0
+    if (Bits == 0) {
+        println("  fmv.%s.x fa0, zero", Suffix);
+        return;
+    }
+
+    if (inFConstPool(Nd)) {
+        println("  lla t0, .L.fconst.%d", fconstId(Bits));
+        println("  fld fa0, 0(t0)  # double %f", Nd->FVal);
+        return;
+    }
+
+    // fmv.w.x只用低32位，按符号扩展后的值生成可以少用指令
+    if (IsFloat)
+        println("  li a0, %d  # float %f", (int32_t)Bits, Nd->FVal);
+    else
+        println("  li a0, %ld  # double %f", (int64_t)Bits, Nd->FVal);
+    println("  fmv.%s.x fa0, a0", Suffix);
+}
+
+// 输出常量池
+static void emitFConsts(void) {
+    if (!FConsts)
+        return;
+    println("  .section .rodata");
+    println("  .align 3");
+    for (FConst *C = FConsts; C; C = C->Next) {
+        double D = *(double *)&C->Bits;
+        println(".L.fconst.%d:", C->Id);
+        println("  .quad %lu  # %f", C->Bits, D);
+    }
+}
+
 
 // 类型枚举
 // note: don't modify their order. these are used as index in castTable
@@ -453,6 +910,39 @@ static char *castTable[11][11] = {
 };
 
 
+// 有Zba、Zbb扩展时，符号扩展和零扩展只需一条指令
+static char zbaU32[] =  "  # 转换为u32类型\n"
+                        "  zext.w a0, a0";
+static char zbbI8[] =   "  # 转换为i8类型\n"
+                        "  sext.b a0, a0";
+static char zbbI16[] =  "  # 转换为i16类型\n"
+                        "  sext.h a0, a0";
+static char zbbU16[] =  "  # 转换为u16类型\n"
+                        "  zext.h a0, a0";
+
+// 选择-march中的扩展可用的转换代码
+static char *extCast(char *Insn) {
+    if (ExtZba && (Insn == i64u32 || Insn == u32i64))
+        return zbaU32;
+    if (ExtZbb && Insn == i64i8)
+        return zbbI8;
+    if (ExtZbb && Insn == i64i16)
+        return zbbI16;
+    if (ExtZbb && Insn == i64u16)
+        return zbbU16;
+    return Insn;
+}
+
+// 零扩展寄存器的低32位
+static void zextW(char *Reg) {
+    if (ExtZba) {
+        println("  zext.w %s, %s", Reg, Reg);
+        return;
+    }
+    println("  slli %s, %s, 32", Reg, Reg);
+    println("  srli %s, %s, 32", Reg, Reg);
+}
+
 // 类型转换
 static void cast(Type *From, Type *To) {
     if (To->Kind == TY_VOID)
@@ -467,93 +957,2177 @@ static void cast(Type *From, Type *To) {
     int T1 = getTypeId(From);
     int T2 = getTypeId(To);
     if (castTable[T1][T2])
-        println("%s", castTable[T1][T2]);
+        println("%s", extCast(castTable[T1][T2]));
 }
 
 
 //
-// codeGen
+// 扩展状态
 //
 
-// 计算给定节点的绝对地址, 并打印
-// 如果报错，说明节点不在内存中
-static void genAddr(Node *Nd) {
-    switch (Nd->Kind){
-        // 变量
-        case ND_VAR:
-            // 局部变量的偏移量是相对于fp的, 栈内
-            if (Nd->Var->IsLocal) {
-                // li is pseudo inst for sequence of lui/addi, which
-                // can represent an arbitrary 32-bit integer
-                // which can present larger range than single addi
-                int Offset = Nd->Var->Offset;
-                if(isLegalImmI(Offset)){
-                    println("  addi a0, fp, %d", Offset);
-                }
-                else{
-                    println("  li t0, %d", Offset);
-                    println("  add a0, fp, t0");
-                }
-            }
-            else {
-                println("  la a0, %s", Nd->Var->Name);
-            }
-            return;
-        // 解引用*
-        case ND_DEREF:
-            genExpr(Nd -> LHS);
-            return;
-        // 逗号
-        case ND_COMMA:
-            genExpr(Nd->LHS);
-            genAddr(Nd->RHS);
-            return;
-        // 结构体成员
-        case ND_MEMBER:
-            // base addr = a0, offset = t1
-            genAddr(Nd->LHS);   // that struct variable's address
-            // 计算成员变量的地址偏移量
-            println("  li t0, %d", Nd->Mem->Offset);
-            println("  add a0, a0, t0");
-            return;
+// 寄存器中整数值的扩展状态：值等于其低S位的符号扩展，也等于其低Z位的零扩展
+// S和Z为8、16、32或64，64表示不确定
+typedef struct {
+    int S;
+    int Z;
+} Ext;
+
+// 大于N的下一个位宽
+static int nextWidth(int N) {
+    return N < 64 ? N * 2 : 64;
+}
+
+// 零扩展的值最高位为0，也是更宽一级的符号扩展
+static Ext newExt(int S, int Z) {
+    return (Ext){MIN(S, nextWidth(Z)), Z};
+}
+
+// 常量的扩展状态
+static Ext constExt(int64_t V) {
+    int S = 8, Z = 8;
+    while (S < 64 && (V < -(1L << (S - 1)) || V >= (1L << (S - 1))))
+        S *= 2;
+    if (V < 0)
+        Z = 64;
+    while (Z < 64 && (uint64_t)V >> Z)
+        Z *= 2;
+    return newExt(S, Z);
+}
 
+// 整数类型的值在寄存器中总是扩展好的，只有U32既可能是符号扩展也可能是零扩展
+static Ext typeExt(Type *Ty) {
+    switch (Ty->Kind) {
+        case TY_BOOL:
+            return newExt(8, 8);
+        case TY_CHAR:
+        case TY_SHORT:
+        case TY_INT:
+            if (Ty->IsUnsigned)
+                return Ty->Size == 4 ? newExt(64, 64) : newExt(64, Ty->Size * 8);
+            return newExt(Ty->Size * 8, 64);
         default:
-            error("%s: not an lvalue", strndup(Nd->Tok->Loc, Nd->Tok->Len));
-            break;
+            return newExt(64, 64);
     }
 }
 
-// 根据变量的链表计算出偏移量
-// 其实是为每个变量分配地址
-static void assignLVarOffsets(Obj *Prog) {
-    // 为每个函数计算其变量所用的栈空间
-    for (Obj *Fn = Prog; Fn; Fn = Fn->Next) {
-        int Offset = 0;
-        if(Fn->Ty->Kind != TY_FUNC)
-            continue;
-//        println(" # local variables of Fn %s:", Fn->Name);
-        // 读取所有变量
-        for (Obj *Var = Fn->Locals; Var; Var = Var->Next) {
-            // the offset here is relevent to fp, which is at top of stack
-            // 每个变量分配空间
-            Offset += Var->Ty->Size;
-            Offset = alignTo(Offset, Var->Align);
-            // 为每个变量赋一个偏移量，或者说是栈中地址
-            Var->Offset = -Offset;
-//            println(" # %s, offset = %d", Var->Name, Var->Offset);
-        }
-        // 将栈对齐到16字节
-        Fn->StackSize = alignTo(Offset, 16);
-    }
+// 读取内存的指令按照类型的大小和符号进行扩展
+static Ext loadExt(Type *Ty) {
+    if (Ty->Kind == TY_BOOL)
+        return newExt(8, 8);
+    if (!isInteger(Ty) || Ty->Size == 8)
+        return newExt(64, 64);
+    if (Ty->IsUnsigned)
+        return newExt(64, Ty->Size * 8);
+    return newExt(Ty->Size * 8, 64);
 }
 
-// sementics: print the asm from an ast whose root node is `Nd`
-// steps: for each node,
-// 1. if it is a leaf node, then directly print the answer and return
-// 2. otherwise:
-//      get the value of its rhs sub-tree first, 
-//      save that answer to the stack. 
-//      then get the lhs sub-tree's value.
+// 两种可能的值都满足的扩展状态
+static Ext meetExt(Ext A, Ext B) {
+    return newExt(MAX(A.S, B.S), MAX(A.Z, B.Z));
+}
+
+// 转换到To类型需要的扩展是否已经满足
+static bool extSatisfies(Ext E, Type *From, Type *To) {
+    if (To->Size == 8)
+        return getTypeId(From) != U32 || E.Z <= 32;
+    if (To->IsUnsigned)
+        return E.Z <= To->Size * 8;
+    return E.S <= To->Size * 8;
+}
+
+// 类型转换是否不需要生成指令，E为被转换的值的扩展状态
+static bool isNopCast(Node *Nd, Ext E);
+
+// genExpr(Nd)之后a0中值的扩展状态
+static Ext extOf(Node *Nd) {
+    Type *Ty = Nd->Ty;
+    if (!isInteger(Ty) && Ty->Kind != TY_PTR)
+        return newExt(64, 64);
+
+    switch (Nd->Kind) {
+        case ND_NUM:
+            return constExt(Nd->Val);
+        case ND_VAR:
+        case ND_MEMBER:
+        case ND_DEREF:
+            return loadExt(Ty);
+        case ND_CAST: {
+            Type *From = Nd->LHS->Ty;
+            if (Ty->Kind == TY_BOOL)
+                return newExt(8, 8);
+            if (!isInteger(From) && From->Kind != TY_PTR)
+                return typeExt(Ty);
+            // 不需要指令时值不变
+            Ext E = extOf(Nd->LHS);
+            if (isNopCast(Nd, E))
+                return E;
+            // 转换到U32和U32转换到64位时是零扩展
+            if (getTypeId(Ty) == U32 || (getTypeId(From) == U32 && Ty->Size == 8))
+                return newExt(64, 32);
+            return typeExt(Ty);
+        }
+        case ND_ASSIGN:
+            return extOf(Nd->RHS);
+        case ND_COMMA:
+            return extOf(Nd->RHS);
+        case ND_COND:
+            return meetExt(extOf(Nd->Then), extOf(Nd->Els));
+        // 结果为0或1，或者较小的计数
+        case ND_EQ:
+        case ND_NE:
+        case ND_LT:
+        case ND_LE:
+        case ND_NOT:
+        case ND_LOGAND:
+        case ND_LOGOR:
+        case ND_CLZ:
+        case ND_CTZ:
+        case ND_POPCOUNT:
+            return newExt(8, 8);
+        // 符号扩展的高位进行按位运算后仍然相同，与零扩展的值相与后高位为0
+        case ND_BITAND: {
+            Ext L = extOf(Nd->LHS), R = extOf(Nd->RHS);
+            return newExt(MAX(L.S, R.S), MIN(L.Z, R.Z));
+        }
+        case ND_BITOR:
+        case ND_BITXOR: {
+            Ext L = extOf(Nd->LHS), R = extOf(Nd->RHS);
+            return newExt(MAX(L.S, R.S), MAX(L.Z, R.Z));
+        }
+        // 以下节点的类型未经整数提升，计算结果并不会截断到Ty，
+        // 比如unsigned char的c << 4可能超出8位
+        case ND_SHL:
+            return Ty->Size == 8 ? newExt(64, 64) : newExt(32, 64);
+        case ND_BITNOT:
+            return newExt(extOf(Nd->LHS).S, 64);
+        // 被移位的值已经按Ty扩展好时右移后仍然是，否则只有32位指令的符号扩展
+        case ND_SHR:
+            if (Ty->Size == 8 || extSatisfies(extOf(Nd->LHS), Ty, Ty))
+                return typeExt(Ty);
+            return newExt(32, 64);
+        case ND_STMT_EXPR: {
+            Node *Last = Nd->Body;
+            while (Last && Last->Next)
+                Last = Last->Next;
+            if (Last && Last->Kind == ND_EXPR_STMT)
+                return extOf(Last->LHS);
+            return newExt(64, 64);
+        }
+        default:
+            return typeExt(Ty);
+    }
+}
+
+static bool isNopCast(Node *Nd, Ext E) {
+    Type *From = Nd->LHS->Ty, *To = Nd->Ty;
+    if (!(isInteger(From) || From->Kind == TY_PTR) || !(isInteger(To) || To->Kind == TY_PTR) ||
+        To->Kind == TY_BOOL)
+        return false;
+    if (!castTable[getTypeId(From)][getTypeId(To)])
+        return true;
+    return extSatisfies(E, From, To);
+}
+
+// U32的两个值是否以相同的方式扩展，此时可以直接比较
+static bool sameU32Ext(Node *L, Node *R) {
+    if (!OptLevel)
+        return false;
+    Ext A = extOf(L), B = extOf(R);
+    return (A.S <= 32 && B.S <= 32) || (A.Z <= 32 && B.Z <= 32);
+}
+
+
+//
+// codeGen
+//
+
+// 将帧中偏移量为Offset的地址存入Reg
+static void frameAddr(int Offset, char *Reg) {
+    // 局部变量的偏移量是相对于fp的, 栈内
+    // li is pseudo inst for sequence of lui/addi, which
+    // can represent an arbitrary 32-bit integer
+    // which can present larger range than single addi
+    if(isLegalImmI(Offset)){
+        println("  addi %s, %s, %d", Reg, FrameReg, Offset);
+    }
+    else{
+        println("  li t0, %d", Offset);
+        println("  add %s, %s, t0", Reg, FrameReg);
+    }
+}
+
+// 将局部变量的地址存入Reg
+static void localAddr(Obj *Var, char *Reg) {
+    int Offset = Var->Offset + FrameBias;
+    // 通过地址传入的结构体，从栈中读出它的地址
+    if (Var->IsByRef && isLegalImmI(Offset)) {
+        println("  ld %s, %d(%s)", Reg, Offset, FrameReg);
+        return;
+    }
+    frameAddr(Offset, Reg);
+    if (Var->IsByRef)
+        println("  ld %s, 0(%s)", Reg, Reg);
+}
+
+//
+// 寻址方式
+//
+
+// -O1起，访存地址分解为基址和常量偏移量，偏移量放入访存指令中：
+// 结构体成员和常量下标的偏移量累加起来，局部变量相对于帧寄存器寻址，
+// 全局变量使用%pcrel_hi/%pcrel_lo寻址，指针的值计算到寄存器中
+typedef struct {
+    Obj *Var;       // 基址为变量的地址
+    Node *Ptr;      // 或者基址为指针表达式的值
+    int64_t Off;    // 常量偏移量
+} AddrMode;
+
+static bool isConstInt(Node *Nd, int64_t *Val);
+static bool ptrMode(Node *Nd, AddrMode *AM);
+
+// 常量下标乘以元素大小后的字节数
+static bool constIndex(Node *Nd, int64_t *Val) {
+    if (isConstInt(Nd, Val))
+        return true;
+    int64_t L, R;
+    switch (Nd->Kind) {
+        // 扩展到64位(包括指针运算中的转换)时值不变
+        case ND_CAST:
+            return (isInteger(Nd->Ty) || Nd->Ty->Kind == TY_PTR) && Nd->Ty->Size == 8 &&
+                   isInteger(Nd->LHS->Ty) &&
+                   constIndex(Nd->LHS, Val);
+        case ND_NEG:
+            if (Nd->Ty->IsUnsigned || !constIndex(Nd->LHS, &L) || L == INT32_MIN)
+                return false;
+            *Val = -L;
+            return true;
+        case ND_MUL:
+            if (Nd->Ty->Size != 8 || !constIndex(Nd->LHS, &L) || !constIndex(Nd->RHS, &R))
+                return false;
+            *Val = L * R;
+            return true;
+        default:
+            return false;
+    }
+}
+
+// 将左值Nd的地址分解到AM中，不能分解时返回false
+static bool addrMode(Node *Nd, AddrMode *AM) {
+    switch (Nd->Kind) {
+        case ND_VAR:
+            if (Nd->Var->Ty->Kind == TY_FUNC)
+                return false;
+            AM->Var = Nd->Var;
+            AM->Ptr = NULL;
+            AM->Off = 0;
+            return true;
+        case ND_MEMBER:
+            if (!addrMode(Nd->LHS, AM))
+                return false;
+            AM->Off += Nd->Mem->Offset;
+            return true;
+        case ND_DEREF:
+            return ptrMode(Nd->LHS, AM);
+        default:
+            return false;
+    }
+}
+
+// 将指针的值分解到AM中
+static bool ptrMode(Node *Nd, AddrMode *AM) {
+    // 数组的值就是它的地址
+    if (Nd->Ty->Kind == TY_ARRAY && addrMode(Nd, AM))
+        return true;
+    if (Nd->Kind == ND_ADDR && addrMode(Nd->LHS, AM))
+        return true;
+    // 数组退化或指针之间的转换不改变地址
+    if (Nd->Kind == ND_CAST && Nd->Ty->Kind == TY_PTR && Nd->LHS->Ty->Base)
+        return ptrMode(Nd->LHS, AM);
+    // 指针加减常量下标
+    int64_t C;
+    if ((Nd->Kind == ND_ADD || Nd->Kind == ND_SUB) && Nd->Ty->Base &&
+        constIndex(Nd->RHS, &C)) {
+        ptrMode(Nd->LHS, AM);
+        AM->Off += Nd->Kind == ND_ADD ? C : -C;
+        return true;
+    }
+    AM->Var = NULL;
+    AM->Ptr = Nd;
+    AM->Off = 0;
+    return true;
+}
+
+// Reg加上Off的访存地址，Off超出12位时先加到Reg上
+static char *memOperand(char *Reg, int64_t Off) {
+    if (isLegalImmI(Off))
+        return format("%ld(%s)", Off, Reg);
+    println("  li t0, %ld", Off);
+    println("  add %s, %s, t0", Reg, Reg);
+    return format("0(%s)", Reg);
+}
+
+// 计算AM的基址，返回访存指令的地址操作数，如"8(sp)"
+// 基址需要寄存器时存入Reg
+static char *genAddrMode(AddrMode *AM, char *Reg) {
+    if (AM->Ptr) {
+        genExpr(AM->Ptr);
+        if (strcmp(Reg, "a0"))
+            println("  mv %s, a0", Reg);
+        return memOperand(Reg, AM->Off);
+    }
+    if (AM->Var->IsByRef) {
+        localAddr(AM->Var, Reg);
+        return memOperand(Reg, AM->Off);
+    }
+    if (AM->Var->IsLocal) {
+        int64_t Off = AM->Var->Offset + FrameBias + AM->Off;
+        if (isLegalImmI(Off))
+            return format("%ld(%s)", Off, FrameReg);
+        frameAddr(Off, Reg);
+        return format("0(%s)", Reg);
+    }
+    // 偏移量并入%pcrel_hi，%pcrel_lo引用auipc所在的标签
+    int C = count();
+    println(".L.pcrel.%d:", C);
+    println("  auipc %s, %%pcrel_hi(%s%s)", Reg, AM->Var->Name,
+            AM->Off ? format("%+ld", AM->Off) : "");
+    return format("%%pcrel_lo(.L.pcrel.%d)(%s)", C, Reg);
+}
+
+// 将AM表示的地址存入a0
+static void genAddrValue(AddrMode *AM) {
+    if (AM->Ptr) {
+        genExpr(AM->Ptr);
+    } else if (AM->Var->IsByRef) {
+        localAddr(AM->Var, "a0");
+    } else if (AM->Var->IsLocal) {
+        frameAddr(AM->Var->Offset + FrameBias + AM->Off, "a0");
+        return;
+    } else {
+        println("  la a0, %s%s", AM->Var->Name, AM->Off ? format("%+ld", AM->Off) : "");
+        return;
+    }
+    if (isLegalImmI(AM->Off)) {
+        if (AM->Off)
+            println("  addi a0, a0, %ld", AM->Off);
+        return;
+    }
+    println("  li t0, %ld", AM->Off);
+    println("  add a0, a0, t0");
+}
+
+// 加载标量左值Nd的值，偏移量放入访存指令中
+static bool genLoad(Node *Nd) {
+    if (!isNumeric(Nd->Ty) && Nd->Ty->Kind != TY_PTR)
+        return false;
+    AddrMode AM;
+    if (!addrMode(Nd, &AM))
+        return false;
+    loadAt(Nd->Ty, genAddrMode(&AM, "a0"));
+    return true;
+}
+
+// 将右值存入标量左值，偏移量放入访存指令中
+static bool genStore(Node *Nd) {
+    Node *LHS = Nd->LHS;
+    if (!isNumeric(Nd->Ty) && Nd->Ty->Kind != TY_PTR)
+        return false;
+    AddrMode AM;
+    if (!addrMode(LHS, &AM))
+        return false;
+
+    // 变量的地址不会改变，右值算完后再计算
+    if (!AM.Ptr) {
+        genExpr(Nd->RHS);
+        storeAt(Nd->Ty, genAddrMode(&AM, "t0"));
+        return true;
+    }
+    // 指针的值暂存在临时寄存器中
+    if (hasCall(Nd->RHS) || TmpDepth >= TMP_REGS)
+        return false;
+    char *Base = TmpRegs[TmpDepth++];
+    char *Mem = genAddrMode(&AM, Base);
+    genExpr(Nd->RHS);
+    TmpDepth--;
+    storeAt(Nd->Ty, Mem);
+    return true;
+}
+
+// 计算给定节点的绝对地址, 并打印
+// 如果报错，说明节点不在内存中
+static void genAddr(Node *Nd) {
+    switch (Nd->Kind){
+        // 变量
+        case ND_VAR:
+            if (Nd->Var->IsLocal) {
+                localAddr(Nd->Var, "a0");
+            }
+            else {
+                println("  la a0, %s", Nd->Var->Name);
+            }
+            return;
+        // 解引用*
+        case ND_DEREF:
+            genExpr(Nd -> LHS);
+            return;
+        // 逗号
+        case ND_COMMA:
+            genExpr(Nd->LHS);
+            genAddr(Nd->RHS);
+            return;
+        // 结构体成员
+        case ND_MEMBER: {
+            AddrMode AM;
+            if (OptLevel && addrMode(Nd, &AM)) {
+                genAddrValue(&AM);
+                return;
+            }
+            // base addr = a0, offset = t1
+            genAddr(Nd->LHS);   // that struct variable's address
+            // 计算成员变量的地址偏移量
+            println("  li t0, %d", Nd->Mem->Offset);
+            println("  add a0, a0, t0");
+            return;
+        }
+        // 结构体类型的右值，其值就是存放它的地址
+        case ND_FUNCALL:
+        case ND_CAST:
+        case ND_ASSIGN:
+        case ND_COND:
+        case ND_STMT_EXPR:
+            if (isStructOrUnion(Nd->Ty)) {
+                genExpr(Nd);
+                return;
+            }
+            break;
+
+        default:
+            break;
+    }
+    error("%s: not an lvalue", strndup(Nd->Tok->Loc, Nd->Tok->Len));
+}
+
+// 根据变量的链表计算出偏移量
+// 其实是为每个变量分配地址
+// 栈帧中变量的排列顺序：标量离帧寄存器最近，按对齐量从大到小紧密排列，
+// 数组和结构体在外侧，按大小从小到大排列，这样常用的变量都在12位偏移量内
+static bool frameBefore(Obj *A, Obj *B) {
+    bool AggA = !isNumeric(A->Ty) && A->Ty->Kind != TY_PTR && !A->IsByRef;
+    bool AggB = !isNumeric(B->Ty) && B->Ty->Kind != TY_PTR && !B->IsByRef;
+    if (AggA != AggB)
+        return !AggA;
+    if (!AggA)
+        return A->Align > B->Align;
+    return A->Ty->Size < B->Ty->Size;
+}
+
+// 两个局部变量是否可能同时存活，-O1起生存期不相交的块中的变量共用栈槽
+static bool liveTogether(Obj *A, Obj *B) {
+    if (!OptLevel || !A->LiveEnd || !B->LiveEnd)
+        return true;
+    return A->LiveBegin <= B->LiveEnd && B->LiveBegin <= A->LiveEnd;
+}
+
+// 将变量放在距帧寄存器不小于Dist处，[*Lo, *Hi)为它所占的区间
+// 使用fp时变量在fp下方，结束处对齐；省略帧指针时在sp上方，开始处对齐
+// 通过地址传入的结构体只占一个8字节的槽
+static void slotAt(Obj *Var, int Dist, int *Lo, int *Hi) {
+    int Size = Var->IsByRef ? 8 : Var->Ty->Size;
+    int Align = Var->IsByRef ? 8 : Var->Align;
+    if (OptOmitFP) {
+        *Lo = alignTo(Dist, Align);
+        *Hi = *Lo + Size;
+    } else {
+        *Hi = alignTo(Dist + Size, Align);
+        *Lo = *Hi - Size;
+    }
+}
+
+static bool passByRef(Type *Ty);
+
+static void assignLVarOffsets(Obj *Prog) {
+    // 为每个函数计算其变量所用的栈空间
+    for (Obj *Fn = Prog; Fn; Fn = Fn->Next) {
+        if(Fn->Ty->Kind != TY_FUNC)
+            continue;
+        for (Obj *Var = Fn->Params; Var; Var = Var->Next)
+            Var->IsByRef = passByRef(Var->Ty);
+
+        // 取出所有变量再稳定地排序，同类的变量地址随声明的顺序递增：
+        // 省略帧指针时先声明的离sp近，否则后声明的离fp近
+        int N = 0;
+        for (Obj *Var = Fn->Locals; Var; Var = Var->Next)
+            N++;
+        Obj **Vars = calloc(N, sizeof(Obj *));
+        int *Lo = calloc(N, sizeof(int));
+        int *Hi = calloc(N, sizeof(int));
+        int I = 0;
+        for (Obj *Var = Fn->Locals; Var; Var = Var->Next, I++)
+            Vars[OptOmitFP ? N - 1 - I : I] = Var;
+        for (I = 1; I < N; I++)
+            for (int J = I; J > 0 && frameBefore(Vars[J], Vars[J - 1]); J--) {
+                Obj *T = Vars[J];
+                Vars[J] = Vars[J - 1];
+                Vars[J - 1] = T;
+            }
+
+        // 依次放到离帧寄存器最近、且不与同时存活的变量重叠的位置，
+        // 候选位置为0和这些变量的末尾，对齐留下的空隙也能被后面的变量填上
+        int Size = 0;
+        for (I = 0; I < N; I++) {
+            int BestLo = 0, BestHi = -1;
+            for (int C = -1; C < I; C++) {
+                if (C >= 0 && !liveTogether(Vars[I], Vars[C]))
+                    continue;
+                int L, H;
+                slotAt(Vars[I], C < 0 ? 0 : Hi[C], &L, &H);
+                if (BestHi >= 0 && H >= BestHi)
+                    continue;
+                bool Free = true;
+                for (int J = 0; J < I && Free; J++)
+                    if (liveTogether(Vars[I], Vars[J]) && L < Hi[J] && Lo[J] < H)
+                        Free = false;
+                if (Free) {
+                    BestLo = L;
+                    BestHi = H;
+                }
+            }
+            Lo[I] = BestLo;
+            Hi[I] = BestHi;
+            if (BestHi > Size)
+                Size = BestHi;
+        }
+
+        // 将栈对齐到16字节
+        Fn->StackSize = alignTo(Size, 16);
+        // 偏移量都是相对于fp的，省略帧指针时fp即sp + StackSize
+        for (I = 0; I < N; I++)
+            Vars[I]->Offset = OptOmitFP ? Lo[I] - Fn->StackSize : -Hi[I];
+        free(Vars);
+        free(Lo);
+        free(Hi);
+    }
+}
+
+// 计算二元运算两侧的值，*L和*R返回存放左右值的寄存器
+// 先算出的一侧暂存在临时寄存器中，再算另一侧到a0(fa0)。
+// -O0、后算的一侧有调用或临时寄存器用完时，先算出的一侧压栈，最后弹栈到a1(fa1)
+static void genOperands(Node *Nd, char **L, char **R) {
+    bool IsFlo = isFloNum(Nd->LHS->Ty);
+    int *Used = IsFlo ? &TmpFDepth : &TmpDepth;
+    int Max = IsFlo ? TMP_FREGS : TMP_REGS;
+    bool LFirst = lhsFirst(Nd);
+    Node *First = LFirst ? Nd->LHS : Nd->RHS;
+    Node *Second = LFirst ? Nd->RHS : Nd->LHS;
+    char *Res = IsFlo ? "fa0" : "a0";
+    char *Tmp;
+
+    genExpr(First);
+    if (OptLevel && *Used < Max && !hasCall(Second)) {
+        Tmp = IsFlo ? TmpFRegs[*Used] : TmpRegs[*Used];
+        if (IsFlo)
+            println("  fmv.d %s, fa0", Tmp);
+        else
+            println("  mv %s, a0", Tmp);
+        (*Used)++;
+        genExpr(Second);
+        // 运算指令紧随其后，此处即可释放
+        (*Used)--;
+    } else {
+        IsFlo ? pushF() : push();
+        genExpr(Second);
+        IsFlo ? popF(1) : pop(1);
+        Tmp = IsFlo ? "fa1" : "a1";
+    }
+
+    *L = LFirst ? Tmp : Res;
+    *R = LFirst ? Res : Tmp;
+}
+
+// 计算N(至多3)个同为整数或浮点数的值，Regs返回存放各个值的寄存器
+// 与genOperands相同，先算出的值暂存在临时寄存器中，放不下时压栈，最后弹栈到a1(fa1)、a2(fa2)
+// InOrder时按Ops的顺序求值(如CSE的临时变量需要先定义再使用)，否则需要寄存器多的先算
+static void genOperandList(Node **Ops, int N, char **Regs, bool InOrder) {
+    bool IsFlo = isFloNum(Ops[0]->Ty);
+    int *Used = IsFlo ? &TmpFDepth : &TmpDepth;
+    int Max = IsFlo ? TMP_FREGS : TMP_REGS;
+
+    int Order[3] = {0, 1, 2};
+    for (int I = 1; I < N && !InOrder; I++)
+        for (int J = I; J > 0 && regNeed(Ops[Order[J]]) > regNeed(Ops[Order[J - 1]]); J--) {
+            int T = Order[J];
+            Order[J] = Order[J - 1];
+            Order[J - 1] = T;
+        }
+
+    int Saved = 0;
+    int Pushed[3], NumPushed = 0;
+    for (int I = 0; I < N; I++) {
+        genExpr(Ops[Order[I]]);
+        if (I == N - 1) {
+            Regs[Order[I]] = IsFlo ? "fa0" : "a0";
+            break;
+        }
+        bool Call = false;
+        for (int J = I + 1; J < N; J++)
+            Call = Call || hasCall(Ops[Order[J]]);
+        if (OptLevel && *Used < Max && !Call) {
+            char *Tmp = IsFlo ? TmpFRegs[(*Used)++] : TmpRegs[(*Used)++];
+            if (IsFlo)
+                println("  fmv.d %s, fa0", Tmp);
+            else
+                println("  mv %s, a0", Tmp);
+            Regs[Order[I]] = Tmp;
+            Saved++;
+        } else {
+            IsFlo ? pushF() : push();
+            Pushed[NumPushed++] = Order[I];
+        }
+    }
+    // 运算指令紧随其后，此处即可释放
+    *Used -= Saved;
+    for (int I = NumPushed - 1, R = 1; I >= 0; I--, R++) {
+        IsFlo ? popF(R) : pop(R);
+        Regs[Pushed[I]] = format("%s%d", IsFlo ? "fa" : "a", R);
+    }
+}
+
+// 实参和形参的位置：整型寄存器a0-a7、浮点寄存器fa0-fa7，
+// 或者调用时sp开始的栈中，每个占8字节
+typedef enum {
+    LOC_GP,
+    LOC_FP,
+    LOC_STACK,
+} LocKind;
+
+typedef struct {
+    LocKind Kind;
+    int Idx;        // 寄存器的编号，或者栈中的第几个槽
+} ArgLoc;
+
+// 按LP64D的约定分配下一个参数的位置：
+// 浮点数先用浮点寄存器，用完后(以及可变参数)用整型寄存器，寄存器都用完后放入栈中
+static ArgLoc nextArgLoc(bool IsFlo, int *GP, int *FP, int *Stk) {
+    if (IsFlo && *FP < 8)
+        return (ArgLoc){LOC_FP, (*FP)++};
+    if (*GP < 8)
+        return (ArgLoc){LOC_GP, (*GP)++};
+    return (ArgLoc){LOC_STACK, (*Stk)++};
+}
+
+//
+// 结构体的传递
+//
+
+// 不超过16字节的结构体拆成至多两部分，每部分占一个寄存器或栈中的一个槽
+typedef struct {
+    int N;          // 部分的个数
+    bool IsFlo[2];  // 该部分是否通过浮点寄存器传递
+    int Off[2];     // 该部分在结构体中的偏移量
+    int Size[2];    // 该部分的字节数
+} StructParts;
+
+// 超过16字节的结构体通过地址传递
+static bool passByRef(Type *Ty) {
+    return isStructOrUnion(Ty) && Ty->Size > 16;
+}
+
+// 展开结构体(包括嵌套的结构体和数组)中的标量成员，多于两个或含有联合体时返回false
+static bool flattenStruct(Type *Ty, int Off, StructParts *P) {
+    switch (Ty->Kind) {
+        case TY_STRUCT:
+            for (Member *Mem = Ty->Mems; Mem; Mem = Mem->Next)
+                if (!flattenStruct(Mem->Ty, Off + Mem->Offset, P))
+                    return false;
+            return true;
+        case TY_ARRAY:
+            for (int I = 0; I < Ty->ArrayLen; I++)
+                if (!flattenStruct(Ty->Base, Off + I * Ty->Base->Size, P))
+                    return false;
+            return true;
+        case TY_UNION:
+            return false;
+        default:
+            if (P->N == 2)
+                return false;
+            P->IsFlo[P->N] = isFloNum(Ty);
+            P->Off[P->N] = Off;
+            P->Size[P->N] = Ty->Size;
+            P->N++;
+            return true;
+    }
+}
+
+// 按LP64D的约定拆分结构体：只含一到两个浮点数，或一个浮点数和一个整数的结构体，
+// 寄存器足够时浮点数用浮点寄存器传递；其余按整型约定拆成两个8字节，
+// 可变参数总是按整型约定
+static StructParts structParts(Type *Ty, int GP, int FP, bool IsVar) {
+    StructParts P = {};
+    if (!IsVar && flattenStruct(Ty, 0, &P) && P.N && (P.IsFlo[0] || P.IsFlo[P.N - 1])) {
+        int NF = P.IsFlo[0] + (P.N == 2 && P.IsFlo[1]);
+        if (FP + NF <= 8 && GP + P.N - NF <= 8)
+            return P;
+    }
+
+    P = (StructParts){.N = Ty->Size > 8 ? 2 : 1};
+    P.Size[0] = Ty->Size > 8 ? 8 : Ty->Size;
+    P.Off[1] = 8;
+    P.Size[1] = Ty->Size - 8;
+    return P;
+}
+
+// 确定一个实参(形参)各部分的位置，返回部分的个数
+// 结构体的每部分占一个位置，其余的实参(包括通过地址传递的结构体)只有一部分
+static int argLocs(Type *Ty, bool IsVar, int *GP, int *FP, int *Stk,
+                   ArgLoc *Locs, StructParts *P) {
+    if (!isStructOrUnion(Ty) || passByRef(Ty)) {
+        Locs[0] = nextArgLoc(isFloNum(Ty) && !IsVar, GP, FP, Stk);
+        return 1;
+    }
+    *P = structParts(Ty, *GP, *FP, IsVar);
+    for (int I = 0; I < P->N; I++)
+        Locs[I] = nextArgLoc(P->IsFlo[I], GP, FP, Stk);
+    return P->N;
+}
+
+// 将t1+Off起的Size个字节读入Reg，不读取之外的内存，t0作为中转
+// t1按Align对齐
+static void loadPart(char *Reg, bool IsFlo, int Off, int Size, int Align) {
+    if (IsFlo) {
+        println("  fl%c %s, %d(t1)", Size == 4 ? 'w' : 'd', Reg, Off);
+        return;
+    }
+    for (int I = 0, W; I < Size; I += W) {
+        W = chunkWidth(Off + I, Align, Size - I);
+        char *Dst = I ? "t0" : Reg;
+        println("  %s%s %s, %d(t1)", loadInsn(W), W == 8 ? "" : "u", Dst, Off + I);
+        if (I) {
+            println("  slli t0, t0, %d", I * 8);
+            println("  or %s, %s, t0", Reg, Reg);
+        }
+    }
+}
+
+// 将Reg的低Size个字节写入t1+Off起的内存，会破坏Reg
+static void storePart(char *Reg, bool IsFlo, int Off, int Size, int Align) {
+    if (IsFlo) {
+        println("  fs%c %s, %d(t1)", Size == 4 ? 'w' : 'd', Reg, Off);
+        return;
+    }
+    for (int I = 0, W; I < Size; I += W) {
+        W = chunkWidth(Off + I, Align, Size - I);
+        println("  %s %s, %d(t1)", storeInsn(W), Reg, Off + I);
+        if (I + W < Size)
+            println("  srli %s, %s, %d", Reg, Reg, W * 8);
+    }
+}
+
+// 寄存器的名字
+static char *locReg(ArgLoc Loc) {
+    return format("%s%d", Loc.Kind == LOC_FP ? "fa" : "a", Loc.Idx);
+}
+
+// 结构体返回值所在的寄存器：整型部分依次为a0,a1，浮点部分依次为fa0,fa1
+static void retLocs(StructParts *P, ArgLoc *Locs) {
+    int GP = 0, FP = 0;
+    for (int I = 0; I < P->N; I++)
+        Locs[I] = P->IsFlo[I] ? (ArgLoc){LOC_FP, FP++} : (ArgLoc){LOC_GP, GP++};
+}
+
+// 将a0指向的结构体读入返回值的寄存器
+static void loadRetStruct(Type *Ty) {
+    StructParts P = structParts(Ty, 0, 0, false);
+    ArgLoc Locs[2];
+    retLocs(&P, Locs);
+    println("  mv t1, a0");
+    for (int I = 0; I < P.N; I++)
+        loadPart(locReg(Locs[I]), P.IsFlo[I], P.Off[I], P.Size[I], Ty->Align);
+}
+
+// 将返回值的寄存器中的结构体存入Var，a0指向Var
+static void storeRetStruct(Obj *Var) {
+    StructParts P = structParts(Var->Ty, 0, 0, false);
+    ArgLoc Locs[2];
+    retLocs(&P, Locs);
+    localAddr(Var, "t1");
+    for (int I = 0; I < P.N; I++)
+        storePart(locReg(Locs[I]), P.IsFlo[I], P.Off[I], P.Size[I], Var->Ty->Align);
+    println("  mv a0, t1");
+}
+
+//
+// 函数调用
+//
+
+// 函数调用中传递的一个值：标量实参，或者结构体实参的一部分
+typedef struct {
+    int Arg;        // 第几个实参
+    ArgLoc Loc;     // 传递的位置
+    bool IsFlo;     // 值是否位于浮点寄存器中
+    int Off, Size;  // 结构体中该部分的偏移量和大小
+    char *Tmp;      // 暂存值的临时寄存器
+} ArgPart;
+
+// 确定调用Nd的每个实参的位置，存入Parts，返回值的个数
+// 第I个实参的值为Parts[Begin[I]]到Parts[Begin[I+1]-1]
+// Stk为栈中槽的个数，较大的结构体返回值的地址在a0中传递
+static int classifyArgs(Node *Nd, ArgPart **Parts, int **Begin, int *Stk) {
+    int N = 0;
+    for (Node *Arg = Nd->Args; Arg; Arg = Arg->Next)
+        N++;
+    *Parts = calloc(N * 2 + 1, sizeof(ArgPart));
+    *Begin = calloc(N + 1, sizeof(int));
+
+    int GP = passByRef(Nd->Ty), FP = 0, NP = 0;
+    *Stk = 0;
+    Type *CurArg = Nd->FuncType->Params;
+    int I = 0;
+    for (Node *Arg = Nd->Args; Arg; Arg = Arg->Next, I++) {
+        (*Begin)[I] = NP;
+        // 可变参数中的浮点数也通过整型寄存器传递
+        bool IsVar = Nd->FuncType->IsVariadic && !CurArg;
+        if (CurArg)
+            CurArg = CurArg->Next;
+        ArgLoc Locs[2];
+        StructParts P = {.N = 1, .IsFlo = {isFloNum(Arg->Ty)}};
+        int K = argLocs(Arg->Ty, IsVar, &GP, &FP, Stk, Locs, &P);
+        for (int J = 0; J < K; J++)
+            (*Parts)[NP++] = (ArgPart){I, Locs[J], P.IsFlo[J], P.Off[J], P.Size[J]};
+    }
+    (*Begin)[N] = NP;
+    return NP;
+}
+
+// 计算其他表达式时a0-a2(fa0-fa1)会被用作暂存，不能直接存放实参
+static bool isScratchArgReg(ArgLoc Loc) {
+    return Loc.Kind == LOC_GP ? Loc.Idx < 3 : Loc.Idx < 2;
+}
+
+// 将a0(fa0)中的值移动到寄存器Reg中
+static void moveArg(ArgPart *A, char *Reg) {
+    if (A->Loc.Kind == LOC_FP)
+        println("  fmv.d %s, fa0", Reg);
+    else if (A->IsFlo)
+        println("  fmv.x.d %s, fa0", Reg);
+    else
+        println("  mv %s, a0", Reg);
+}
+
+// 压栈的值，按压栈的顺序，之后弹出到寄存器中
+typedef struct {
+    ArgPart **Parts;
+    int N;
+} PushedParts;
+
+// 将a0(fa0)中的值压栈
+static void pushPart(ArgPart *A, PushedParts *Pushed) {
+    A->IsFlo ? pushF() : push();
+    if (A->Loc.Kind != LOC_STACK)
+        Pushed->Parts[Pushed->N++] = A;
+}
+
+// 将a0(fa0)中的值放入寄存器：
+// 不会被破坏的寄存器直接存入，否则放入临时寄存器，用完时压栈
+static void placePart(ArgPart *A, PushedParts *Pushed) {
+    if (!isScratchArgReg(A->Loc)) {
+        moveArg(A, locReg(A->Loc));
+        return;
+    }
+    if (A->Loc.Kind == LOC_FP && TmpFDepth < TMP_FREGS)
+        A->Tmp = TmpFRegs[TmpFDepth++];
+    else if (A->Loc.Kind == LOC_GP && TmpDepth < TMP_REGS)
+        A->Tmp = TmpRegs[TmpDepth++];
+    if (A->Tmp)
+        moveArg(A, A->Tmp);
+    else
+        pushPart(A, Pushed);
+}
+
+// 计算实参中位于Parts[Lo, Hi)的值，每个值先放入a0(fa0)中，
+// Push为真时压栈，否则放入寄存器。结构体实参计算出地址后依次读出各部分
+static void genArgParts(Node *Arg, ArgPart *Parts, int Lo, int Hi, bool Push,
+                        PushedParts *Pushed) {
+    genExpr(Arg);
+    bool IsStruct = isStructOrUnion(Arg->Ty) && !passByRef(Arg->Ty);
+    if (IsStruct)
+        println("  mv t1, a0");
+    for (int K = 0; K < Hi - Lo; K++) {
+        // 栈中的部分按逆序压栈
+        ArgPart *A = &Parts[Push && Parts[Hi - 1].Loc.Kind == LOC_STACK ? Hi - 1 - K : Lo + K];
+        if (IsStruct)
+            loadPart(A->IsFlo ? "fa0" : "a0", A->IsFlo, A->Off, A->Size, Arg->Ty->Align);
+        Push ? pushPart(A, Pushed) : placePart(A, Pushed);
+    }
+}
+
+// 计算函数调用的实参，放入a0-a7(fa0-fa7)，多出的实参放入调用时sp开始的栈中
+// NeedAddr为真时还计算被调函数的地址，放入t5
+// 返回较大的结构体时，Dest为存放返回值的左值，其地址在a0中传递
+// 返回调用后需要用freeStackArgs释放的字节数
+//
+// 调用会破坏所有寄存器，所以含有调用的实参先计算并压栈(-O0时为所有实参)，
+// 其余的实参随后直接计算到各自的寄存器中，只有要放入a0-a2(fa0-fa1)的先放在临时寄存器中
+static int genCallArgs(Node *Nd, bool NeedAddr, Node *Dest) {
+    ArgPart *Parts;
+    int *Begin, Stk;
+    int NP = classifyArgs(Nd, &Parts, &Begin, &Stk);
+    int N = 0;
+    for (Node *Arg = Nd->Args; Arg; Arg = Arg->Next)
+        N++;
+    Node **Args = calloc(N + 1, sizeof(Node *));
+    N = 0;
+    for (Node *Arg = Nd->Args; Arg; Arg = Arg->Next)
+        Args[N++] = Arg;
+    bool *Done = calloc(N + 1, sizeof(bool));
+    PushedParts Pushed = {calloc(NP + 1, sizeof(ArgPart *)), 0};
+
+    // 栈中的实参逆序压栈，有帧指针时压栈后正好位于sp开始的位置
+    // 此时保证调用时sp对齐16字节
+    // 前一半在a7中的结构体是最后一个压栈的，a7的部分随后压栈
+    int Pad = 0;
+    if (Stk && !OmitFP && (Depth + Stk) % 2) {
+        println("  addi sp, sp, -8");
+        Depth++;
+        Pad = 1;
+    }
+    for (int I = N - 1; I >= 0; I--) {
+        if (Parts[Begin[I + 1] - 1].Loc.Kind != LOC_STACK)
+            continue;
+        println("\n  # ↓对实参进行计算，然后压栈↓");
+        genArgParts(Args[I], Parts, Begin[I], Begin[I + 1], true, &Pushed);
+        Done[I] = true;
+    }
+
+    // 含有调用的实参
+    for (int I = N - 1; I >= 0; I--) {
+        if (Done[I] || (OptLevel && !hasCall(Args[I])))
+            continue;
+        println("\n  # ↓对实参进行计算，然后压栈↓");
+        genArgParts(Args[I], Parts, Begin[I], Begin[I + 1], true, &Pushed);
+        Done[I] = true;
+    }
+
+    // 将a0的值(fn address)存入t5
+    // LHS is an ident(ND_VAR), genExpr
+    // will get that ident's address
+    // 之后的实参中没有调用，t5不会被破坏
+    if (NeedAddr) {
+        genExpr(Nd->LHS);
+        println("  mv t5, a0");
+    }
+
+    // 其余的实参直接计算到寄存器中，最后计算的实参位于a0(fa0)时不需要移动
+    int Last = -1;
+    for (int I = 0; I < N && Last < 0; I++)
+        if (!Done[I])
+            Last = I;
+    for (int I = N - 1; I >= 0; I--) {
+        if (Done[I])
+            continue;
+        ArgPart *A = &Parts[Begin[I]];
+        println("\n  # %s传递实参", locReg(A->Loc));
+        if (I == Last && Begin[I + 1] - Begin[I] == 1 && !isStructOrUnion(Args[I]->Ty) &&
+            A->Loc.Idx == 0 && (A->Loc.Kind == LOC_FP || !A->IsFlo)) {
+            genExpr(Args[I]);
+            continue;
+        }
+        genArgParts(Args[I], Parts, Begin[I], Begin[I + 1], false, &Pushed);
+    }
+
+    // 反向弹栈，a0->参数1，a1->参数2...
+    while (Pushed.N > 0) {
+        ArgLoc Loc = Pushed.Parts[--Pushed.N]->Loc;
+        if (Loc.Kind == LOC_FP) {
+            println("  # fa%d传递浮点参数", Loc.Idx);
+            popF(Loc.Idx);
+        } else {
+            println("  # a%d传递整型参数", Loc.Idx);
+            pop(Loc.Idx);
+        }
+    }
+    for (int P = NP - 1; P >= 0; P--) {
+        if (!Parts[P].Tmp)
+            continue;
+        println("  %s %s, %s", Parts[P].Loc.Kind == LOC_FP ? "fmv.d" : "mv",
+                locReg(Parts[P].Loc), Parts[P].Tmp);
+        if (Parts[P].Loc.Kind == LOC_FP)
+            TmpFDepth--;
+        else
+            TmpDepth--;
+    }
+
+    // 存放返回值的地址
+    if (Dest)
+        genAddr(Dest);
+
+    free(Parts);
+    free(Args);
+    free(Begin);
+    free(Done);
+    free(Pushed.Parts);
+
+    if (!Stk)
+        return 0;
+    if (!OmitFP)
+        return (Stk + Pad) * 8;
+
+    // 省略帧指针时，栈中的实参在表达式栈的槽中，分配参数区后复制过去
+    int Bytes = alignTo(Stk * 8, 16);
+    adjustSP(-Bytes);
+    for (int K = 0; K < Stk; K++) {
+        int Off = Bytes + ExprBase + (Depth - 1 - K) * 8;
+        if (isLegalImmI(Off)) {
+            println("  ld t0, %d(sp)", Off);
+        } else {
+            println("  li t0, %d", Off);
+            println("  add t0, sp, t0");
+            println("  ld t0, 0(t0)");
+        }
+        println("  sd t0, %d(sp)", K * 8);
+    }
+    Depth -= Stk;
+    return Bytes;
+}
+
+// 调用后释放栈中传递实参的空间
+static void freeStackArgs(int Bytes) {
+    if (!Bytes)
+        return;
+    adjustSP(Bytes);
+    if (!OmitFP)
+        Depth -= Bytes / 8;
+}
+
+// 生成函数调用，返回较大的结构体时存入左值Dest，为空时存入Nd->RetBuffer
+// 返回结构体时a0为存放它的地址
+static void genFuncall(Node *Nd, Node *Dest) {
+    Node Buf = {.Kind = ND_VAR, .Var = Nd->RetBuffer, .Ty = Nd->Ty, .Tok = Nd->Tok};
+    if (passByRef(Nd->Ty) && !Dest)
+        Dest = &Buf;
+    // 直接调用函数名时不需要计算函数的地址
+    bool Direct = isDirectCall(Nd);
+    int StackArgs = genCallArgs(Nd, !Direct, passByRef(Nd->Ty) ? Dest : NULL);
+    // 调用函数
+    // the contents of the function is generated by test.sh, not by rvccl
+    genCall(Direct ? Nd->LHS->Var->Name : Nd->FuncName, Direct);
+    freeStackArgs(StackArgs);
+
+    if (passByRef(Nd->Ty))
+        genAddr(Dest);
+    else if (isStructOrUnion(Nd->Ty))
+        storeRetStruct(Nd->RetBuffer);
+}
+
+// 返回较大的结构体的调用，中间只有结构体之间的类型转换
+static Node *sretCall(Node *Nd) {
+    while (Nd->Kind == ND_CAST && isStructOrUnion(Nd->Ty))
+        Nd = Nd->LHS;
+    return Nd->Kind == ND_FUNCALL && passByRef(Nd->Ty) ? Nd : NULL;
+}
+
+// 返回较大的结构体：复制到调用者给出的地址中
+// 返回值直接是调用的结果时，将该地址传给被调函数，由其直接存入
+static void genRetStruct(Node *Expr) {
+    Obj *RetPtr = CurrentFn->RetPtr;
+    Node Ptr = {.Kind = ND_VAR, .Var = RetPtr, .Ty = RetPtr->Ty, .Tok = Expr->Tok};
+    Node Dest = {.Kind = ND_DEREF, .LHS = &Ptr, .Ty = Expr->Ty, .Tok = Expr->Tok};
+    Node *Call = OptLevel ? sretCall(Expr) : NULL;
+    if (Call) {
+        genFuncall(Call, &Dest);
+        return;
+    }
+    genExpr(Expr);
+    localAddr(RetPtr, "a1");
+    println("  ld a1, 0(a1)");
+    storeTo(Expr->Ty, "a1");
+}
+
+//
+// 形参
+//
+
+// 将调用者栈中传入的第Slot个实参读入Reg
+static void loadStackParam(int Slot, char *Reg) {
+    // 调用者的sp：有帧指针时为fp+16，省略时为sp加上整个栈帧的大小
+    int Src = (OmitFP ? frameSize() : 16) + Slot * 8;
+    if (isLegalImmI(Src)) {
+        println("  ld %s, %d(%s)", Reg, Src, FrameReg);
+    } else {
+        println("  li t0, %d", Src);
+        println("  add t0, %s, t0", FrameReg);
+        println("  ld %s, 0(t0)", Reg);
+    }
+}
+
+// 将调用者栈中传入的第Slot个实参存入形参的栈空间
+static void storeStackParam(int Slot, int Offset, int Size) {
+    loadStackParam(Slot, "t1");
+    Offset += FrameBias;
+    if (isLegalImmS(Offset)) {
+        println("  %s t1, %d(%s)", storeInsn(Size), Offset, FrameReg);
+    } else {
+        println("  li t0, %d", Offset);
+        println("  add t0, %s, t0", FrameReg);
+        println("  %s t1, 0(t0)", storeInsn(Size));
+    }
+}
+
+// 将传入的结构体的各部分存入形参的栈空间
+static void storeStructParam(Obj *Var, ArgLoc *Locs, StructParts *P) {
+    for (int I = 0; I < P->N; I++) {
+        char *Reg = locReg(Locs[I]);
+        if (Locs[I].Kind == LOC_STACK) {
+            loadStackParam(Locs[I].Idx, "t2");
+            Reg = "t2";
+        }
+        localAddr(Var, "t1");
+        storePart(Reg, P->IsFlo[I], P->Off[I], P->Size[I], Var->Ty->Align);
+    }
+}
+
+// 将寄存器中传入的实参存入形参的栈空间
+static void storeParams(Obj *Fn) {
+    // 记录整型寄存器，浮点寄存器，栈中的槽使用的数量
+    int GP = 0, FP = 0, Stk = 0;
+    // 存放返回值的地址
+    if (Fn->RetPtr)
+        storeGeneral(GP++, Fn->RetPtr->Offset, 8);
+
+    // 通过地址传入的结构体，调用者传入的已经是一份副本，只需保存它的地址
+    for (Obj *Var = Fn->Params; Var; Var = Var->Next) {
+        ArgLoc Locs[2];
+        StructParts P;
+        argLocs(Var->Ty, false, &GP, &FP, &Stk, Locs, &P);
+        if (isStructOrUnion(Var->Ty) && !passByRef(Var->Ty))
+            storeStructParam(Var, Locs, &P);
+        else if (Locs[0].Kind == LOC_FP)
+            storeFloat(Locs[0].Idx, Var->Offset, Var->Ty->Size);
+        else if (Locs[0].Kind == LOC_GP)
+            storeGeneral(Locs[0].Idx, Var->Offset, Var->IsByRef ? 8 : Var->Ty->Size);
+        else
+            storeStackParam(Locs[0].Idx, Var->Offset, Var->IsByRef ? 8 : Var->Ty->Size);
+    }
+
+    // 可变参数
+    if (Fn->VaArea) {
+        // 可变参数存入__va_area__，注意最多为7个
+        int Offset = Fn->VaArea->Offset;
+        while (GP < 8) {
+            storeGeneral(GP++, Offset, 8);
+            Offset += 8;
+        }
+    }
+}
+
+// 省略帧指针时栈帧的大小，在函数体生成完后才能确定
+static int frameSize(void) {
+    return ExprBase + alignTo(MaxDepth * 8, 16);
+}
+
+// 恢复调用者的栈帧，之后即可返回
+static void restoreFrame(void) {
+    if (OmitFP) {
+        if (!IsLeaf)
+            raSlot("ld");
+        if (frameSize())
+            adjustSP(frameSize());
+        return;
+    }
+    // 将fp的值改写回sp
+    println("  mv sp, fp");
+    // 将最早fp保存的值弹栈，恢复fp。
+    println("  ld fp, 0(sp)");
+    // 将ra寄存器弹栈,恢复ra的值
+    println("  ld ra, 8(sp)");
+    println("  addi sp, sp, 16");
+}
+
+//
+// 尾调用
+//
+
+// 当前函数能否进行尾调用
+// 被调函数会覆盖当前的栈帧，所以局部变量的地址不能传出去：
+// 要求所有局部变量都是标量且没有被取过地址
+static bool CanTailCall;
+
+static bool noEscape(Obj *Fn) {
+    for (Obj *Var = Fn->Locals; Var; Var = Var->Next)
+        if (!(isNumeric(Var->Ty) || Var->Ty->Kind == TY_PTR) || Var->IsAddrTaken)
+            return false;
+    return true;
+}
+
+// 实参是否都通过寄存器传递，多出的实参会留在当前栈帧中
+static bool argsInRegs(Node *Nd) {
+    ArgPart *Parts;
+    int *Begin, Stk;
+    classifyArgs(Nd, &Parts, &Begin, &Stk);
+    free(Parts);
+    free(Begin);
+    return Stk == 0;
+}
+
+// 返回值若直接是一个调用的结果(中间只有不产生指令的类型转换)，返回该调用
+static Node *tailCall(Node *Nd) {
+    while (Nd && Nd->Kind == ND_CAST) {
+        Type *From = Nd->LHS->Ty, *To = Nd->Ty;
+        if (To->Kind != TY_VOID &&
+            (To->Kind == TY_BOOL || To->Kind == TY_STRUCT || To->Kind == TY_UNION ||
+             castTable[getTypeId(From)][getTypeId(To)]))
+            return NULL;
+        Nd = Nd->LHS;
+    }
+    if (!Nd || Nd->Kind != ND_FUNCALL || !argsInRegs(Nd))
+        return NULL;
+    // 返回的结构体需要存入当前栈帧中
+    if (isStructOrUnion(Nd->Ty))
+        return NULL;
+    return Nd;
+}
+
+// 生成尾调用：释放当前栈帧后跳转到被调函数，由其直接返回到调用者
+// 调用自身时改为循环：实参存入形参后跳转到函数体开头
+static void genTailCall(Node *Call) {
+    Node *Fn = Call->LHS;
+    // 栈中还有压入的值时不能直接回到函数体开头
+    if (Fn->Kind == ND_VAR && Fn->Var->Ty->Kind == TY_FUNC &&
+        !strcmp(Fn->Var->Name, CurrentFn->Name) && Depth == 0) {
+        genCallArgs(Call, false, NULL);
+        println("  # 尾递归，改为循环");
+        storeParams(CurrentFn);
+        println("  j .L.body.%s", CurrentFn->Name);
+        return;
+    }
+
+    // 直接跳转到函数名，栈帧的大小还不确定时跳转到函数末尾该函数的出口
+    if (isDirectCall(Call)) {
+        char *Name = Fn->Var->Name;
+        genCallArgs(Call, false, NULL);
+        println("  # 尾调用");
+        if (OmitFP) {
+            int I = 0;
+            while (I < NumTailCallees && strcmp(TailCallees[I], Name))
+                I++;
+            if (I == NumTailCallees) {
+                TailCallees = realloc(TailCallees, sizeof(char *) * (NumTailCallees + 1));
+                TailCallees[NumTailCallees++] = Name;
+            }
+            println("  j .L.tail.%s.%d", CurrentFn->Name, I);
+            return;
+        }
+        restoreFrame();
+        println("  tail %s", Name);
+        return;
+    }
+
+    genCallArgs(Call, true, NULL);
+    println("  # 尾调用");
+    if (OmitFP) {
+        // 栈帧的大小此时还不确定，跳转到函数末尾统一释放
+        HasTailExit = true;
+        println("  j .L.tail.%s", CurrentFn->Name);
+        return;
+    }
+    restoreFrame();
+    println("  jr t5  # %s", Call->FuncName);
+}
+
+//
+// 常数乘除法的强度削减
+//
+
+// 是否为整数常量，*Val为其值
+static bool isConstInt(Node *Nd, int64_t *Val) {
+    if (Nd->Kind == ND_NUM && isInteger(Nd->Ty)) {
+        *Val = Nd->Val;
+        return true;
+    }
+    if (Nd->Kind != ND_CAST || !isInteger(Nd->Ty) || !isInteger(Nd->LHS->Ty) ||
+        !isConstInt(Nd->LHS, Val))
+        return false;
+
+    // 按目标类型截断
+    Type *Ty = Nd->Ty;
+    if (Ty->Kind == TY_BOOL)
+        *Val = *Val != 0;
+    else if (Ty->Size == 1)
+        *Val = Ty->IsUnsigned ? (int64_t)(uint8_t)*Val : (int64_t)(int8_t)*Val;
+    else if (Ty->Size == 2)
+        *Val = Ty->IsUnsigned ? (int64_t)(uint16_t)*Val : (int64_t)(int16_t)*Val;
+    else if (Ty->Size == 4)
+        *Val = Ty->IsUnsigned ? (int64_t)(uint32_t)*Val : (int64_t)(int32_t)*Val;
+    return true;
+}
+
+// 若X为2的幂，返回其指数，否则返回-1
+static int log2Exact(uint64_t X) {
+    if (!X || (X & (X - 1)))
+        return -1;
+    int N = 0;
+    while (X >>= 1)
+        N++;
+    return N;
+}
+
+// 有符号除法的魔数，x / D = (mulh(x, M) [+-x]) >> S，加上商为负时的修正
+// 见Hacker's Delight 10-1，要求 2 <= |D| < 2^63
+static void magicSigned(int64_t D, int64_t *M, int *S) {
+    uint64_t Two63 = 0x8000000000000000UL;
+    uint64_t AD = D < 0 ? -(uint64_t)D : D;
+    uint64_t T = Two63 + ((uint64_t)D >> 63);
+    uint64_t ANC = T - 1 - T % AD;
+    uint64_t Q1 = Two63 / ANC, R1 = Two63 - Q1 * ANC;
+    uint64_t Q2 = Two63 / AD, R2 = Two63 - Q2 * AD;
+    uint64_t Delta;
+    int P = 63;
+    do {
+        P++;
+        Q1 *= 2;
+        R1 *= 2;
+        if (R1 >= ANC) {
+            Q1++;
+            R1 -= ANC;
+        }
+        Q2 *= 2;
+        R2 *= 2;
+        if (R2 >= AD) {
+            Q2++;
+            R2 -= AD;
+        }
+        Delta = AD - R2;
+    } while (Q1 < Delta || (Q1 == Delta && R1 == 0));
+    *M = Q2 + 1;
+    if (D < 0)
+        *M = -*M;
+    *S = P - 64;
+}
+
+// 无符号除法的魔数，x / D = mulhu(x, M) >> S
+// 魔数超过64位时Add为真，需要额外的修正，见Hacker's Delight 10-8
+static void magicUnsigned(uint64_t D, uint64_t *M, int *S, bool *Add) {
+    uint64_t NC = -1 - (-D) % D;
+    uint64_t Q1 = 0x8000000000000000UL / NC, R1 = 0x8000000000000000UL - Q1 * NC;
+    uint64_t Q2 = 0x7FFFFFFFFFFFFFFFUL / D, R2 = 0x7FFFFFFFFFFFFFFFUL - Q2 * D;
+    uint64_t Delta;
+    int P = 63;
+    *Add = false;
+    do {
+        P++;
+        if (R1 >= NC - R1) {
+            Q1 = 2 * Q1 + 1;
+            R1 = 2 * R1 - NC;
+        } else {
+            Q1 = 2 * Q1;
+            R1 = 2 * R1;
+        }
+        if (R2 + 1 >= D - R2) {
+            if (Q2 >= 0x7FFFFFFFFFFFFFFFUL)
+                *Add = true;
+            Q2 = 2 * Q2 + 1;
+            R2 = 2 * R2 + 1 - D;
+        } else {
+            if (Q2 >= 0x8000000000000000UL)
+                *Add = true;
+            Q2 = 2 * Q2;
+            R2 = 2 * R2 + 1;
+        }
+        Delta = D - 1 - R2;
+    } while (P < 128 && (Q1 < Delta || (Q1 == Delta && R1 == 0)));
+    *M = Q2 + 1;
+    *S = P - 64;
+}
+
+// a0 = a0 * C，Suffix为"w"时是32位运算
+// 能用不超过3条移位和加减指令完成时不使用mul
+static void genMulConst(int64_t C, char *Suffix) {
+    uint64_t U = C < 0 ? -(uint64_t)C : C;
+    if (!U) {
+        println("  li a0, 0");
+        return;
+    }
+
+    // U = V << J，V为奇数
+    int J = 0;
+    while (!((U >> J) & 1))
+        J++;
+    uint64_t V = U >> J;
+    int Add = log2Exact(V - 1);
+    int Sub = log2Exact(V + 1);
+    int Len = (J > 0) + (C < 0);
+    if (V != 1)
+        Len += 2;
+
+    if ((V != 1 && Add < 0 && Sub < 0) || Len > 3) {
+        println("  li t0, %ld", C);
+        println("  mul%s a0, a0, t0", Suffix);
+        return;
+    }
+
+    println("  # 乘以%ld，改为移位和加减", C);
+    if (V != 1 && Add > 0) {
+        // x * (2^k + 1) = (x << k) + x
+        println("  slli t0, a0, %d", Add);
+        println("  add%s a0, a0, t0", Suffix);
+    } else if (V != 1) {
+        // x * (2^k - 1) = (x << k) - x
+        println("  slli t0, a0, %d", Sub);
+        println("  sub%s a0, t0, a0", Suffix);
+    }
+    if (J)
+        println("  slli%s a0, a0, %d", Suffix, J);
+    if (C < 0)
+        println("  neg%s a0, a0", Suffix);
+    // 乘以1时32位的结果仍需符号扩展
+    if (*Suffix && C == 1)
+        println("  sext.w a0, a0");
+}
+
+// a0 = a0 / D 或 a0 % D，D不为0和±1
+// 32位运算通过64位的mulhu完成：对于32位的x，x / d = mulhu(x, 2^64 / d + 1)，
+// x % d = mulhu((2^64 / d + 1) * x, d)，见Lemire等人的Faster Remainder by Direct Computation
+static void genDivConst(int64_t D, bool IsMod, bool IsUnsigned, bool Is32) {
+    char *Suffix = Is32 ? "w" : "";
+    uint64_t AD = (!IsUnsigned && D < 0) ? -(uint64_t)D : D;
+    int K = log2Exact(AD);
+
+    println("  # %s%ld，避免使用除法指令", IsMod ? "对常数取余" : "除以常数", D);
+
+    // 2的幂
+    if (K >= 0 && IsUnsigned) {
+        if (!IsMod) {
+            println("  srli%s a0, a0, %d", Suffix, K);
+        } else if (AD - 1 <= 0x7ff) {
+            println("  andi a0, a0, %ld", AD - 1);
+        } else {
+            println("  li t0, %ld", AD - 1);
+            println("  and a0, a0, t0");
+        }
+        return;
+    }
+    if (K >= 0) {
+        // 负数加上2^k-1后再移位，使结果向0取整
+        int W = Is32 ? 32 : 64;
+        println("  srai%s t0, a0, %d", Suffix, W - 1);
+        println("  srli%s t0, t0, %d", Suffix, W - K);
+        println("  add%s t0, a0, t0", Suffix);
+        if (!IsMod) {
+            println("  srai%s a0, t0, %d", Suffix, K);
+            if (D < 0)
+                println("  neg%s a0, a0", Suffix);
+            return;
+        }
+        // x % 2^k = x - ((x + bias) & -2^k)
+        if (AD <= 0x800) {
+            println("  andi t0, t0, %ld", -(int64_t)AD);
+        } else {
+            println("  li t1, %ld", -(int64_t)AD);
+            println("  and t0, t0, t1");
+        }
+        println("  sub%s a0, a0, t0", Suffix);
+        return;
+    }
+
+    if (Is32) {
+        uint64_t C = (uint64_t)-1 / AD + 1;
+        if (IsUnsigned) {
+            // 零扩展
+            zextW("a0");
+        } else {
+            // t1为符号位，取绝对值
+            println("  sext.w a0, a0");
+            println("  srai t1, a0, 63");
+            println("  xor a0, a0, t1");
+            println("  sub a0, a0, t1");
+        }
+        println("  li t0, %ld", C);
+        if (IsMod) {
+            println("  mul a0, a0, t0");
+            println("  li t0, %ld", AD);
+        }
+        println("  mulhu a0, a0, t0");
+        if (!IsUnsigned) {
+            // 商的符号为两侧符号的异或，余数的符号与被除数相同
+            if (!IsMod && D < 0)
+                println("  not t1, t1");
+            println("  xor a0, a0, t1");
+            println("  sub a0, a0, t1");
+        } else if (IsMod && AD > 0x80000000UL) {
+            println("  sext.w a0, a0");
+        }
+        return;
+    }
+
+    // 64位，取余时保留被除数
+    if (IsMod)
+        println("  mv a1, a0");
+    if (IsUnsigned) {
+        uint64_t M;
+        int S;
+        bool Add;
+        magicUnsigned(D, &M, &S, &Add);
+        println("  li t0, %ld", M);
+        println("  mulhu t0, a0, t0");
+        if (Add) {
+            // q = (((x - t) >> 1) + t) >> (s - 1)
+            println("  sub t1, a0, t0");
+            println("  srli t1, t1, 1");
+            println("  add t0, t1, t0");
+            S--;
+        }
+        println("  srli a0, t0, %d", S);
+    } else {
+        int64_t M;
+        int S;
+        magicSigned(D, &M, &S);
+        println("  li t0, %ld", M);
+        println("  mulh t0, a0, t0");
+        if (D > 0 && M < 0)
+            println("  add t0, t0, a0");
+        if (D < 0 && M > 0)
+            println("  sub t0, t0, a0");
+        if (S)
+            println("  srai t0, t0, %d", S);
+        // 商为负时加1
+        println("  srli t1, t0, 63");
+        println("  add a0, t0, t1");
+    }
+    if (IsMod) {
+        // x % d = x - x / d * d
+        genMulConst(D, "");
+        println("  sub a0, a1, a0");
+    }
+}
+
+// 指针相减后除以元素大小，结果一定能整除
+// 奇数在模2^64下有乘法逆元，整除时 x / (v << j) = (x >> j) * v^-1
+static bool isExactDiv(Node *Nd) {
+    Node *LHS = Nd->LHS;
+    return Nd->Kind == ND_DIV && LHS->Kind == ND_SUB && LHS->LHS->Ty->Base &&
+           LHS->RHS->Ty->Base;
+}
+
+static void genExactDiv(int64_t D) {
+    int J = 0;
+    while (!((D >> J) & 1))
+        J++;
+    uint64_t V = (uint64_t)D >> J;
+    println("  # 指针之差除以元素大小%ld", D);
+    if (J)
+        println("  srai a0, a0, %d", J);
+    if (V == 1)
+        return;
+    // 牛顿迭代求逆元，每次迭代正确的位数翻倍
+    uint64_t Inv = V;
+    for (int I = 0; I < 5; I++)
+        Inv *= 2 - V * Inv;
+    println("  li t0, %ld", Inv);
+    println("  mul a0, a0, t0");
+}
+
+// 乘、除、取余的一侧为整数常量时，用移位、加减和乘法取高位代替
+// 返回是否已生成代码
+static bool genConstArith(Node *Nd) {
+    if (Nd->Kind != ND_MUL && Nd->Kind != ND_DIV && Nd->Kind != ND_MOD)
+        return false;
+    if (!isInteger(Nd->LHS->Ty) || !isInteger(Nd->RHS->Ty))
+        return false;
+
+    int64_t C;
+    Node *Other = Nd->LHS;
+    if (!isConstInt(Nd->RHS, &C)) {
+        // 乘法可以交换
+        if (Nd->Kind != ND_MUL || !isConstInt(Nd->LHS, &C))
+            return false;
+        Other = Nd->RHS;
+    }
+
+    bool Is32 = !(Nd->LHS->Ty->Kind == TY_LONG || Nd->LHS->Ty->Base);
+    bool IsUnsigned = Nd->Ty->IsUnsigned;
+    if (Is32)
+        C = IsUnsigned ? (int64_t)(uint32_t)C : (int64_t)(int32_t)C;
+
+    if (Nd->Kind == ND_MUL) {
+        genExpr(Other);
+        genMulConst(C, Is32 ? "w" : "");
+        return true;
+    }
+
+    // 除以0和±1保留除法指令
+    if (C == 0 || C == 1 || (!IsUnsigned && C == -1))
+        return false;
+
+    genExpr(Other);
+    if (isExactDiv(Nd) && C > 0 && !Is32)
+        genExactDiv(C);
+    else
+        genDivConst(C, Nd->Kind == ND_MOD, IsUnsigned, Is32);
+    return true;
+}
+
+//
+// 立即数操作数
+//
+
+// 是否可以作为I型指令的12位立即数
+static bool isImm12(int64_t V) {
+    return V >= -0x800 && V <= 0x7ff;
+}
+
+// 可以交换两侧的运算
+static bool isCommutative(NodeKind Kind) {
+    switch (Kind) {
+        case ND_ADD:
+        case ND_BITAND:
+        case ND_BITOR:
+        case ND_BITXOR:
+        case ND_EQ:
+        case ND_NE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// 二元运算的一侧为较小的整数常量时，使用立即数形式的指令，常量无需装入寄存器
+// 返回是否已生成代码
+static bool genImmArith(Node *Nd) {
+    if (isFloNum(Nd->LHS->Ty) || isFloNum(Nd->RHS->Ty))
+        return false;
+
+    int64_t C;
+    Node *Other = Nd->LHS;
+    // 常量是否在左侧
+    bool Swap = false;
+    if (!isConstInt(Nd->RHS, &C)) {
+        if (!isConstInt(Nd->LHS, &C) ||
+            !(isCommutative(Nd->Kind) || Nd->Kind == ND_LT || Nd->Kind == ND_LE))
+            return false;
+        Other = Nd->RHS;
+        Swap = true;
+    }
+
+    // 与genExpr中寄存器形式的指令保持一致
+    char *Suffix = Nd->LHS->Ty->Kind == TY_LONG || Nd->LHS->Ty->Base ? "" : "w";
+    bool IsUnsigned = Nd->LHS->Ty->IsUnsigned;
+    // U32的值在寄存器中可能是符号扩展或零扩展的，只有非负的小常量两种形式相同
+    bool IsU32 = IsUnsigned && Nd->LHS->Ty->Kind == TY_INT;
+    char *U = IsUnsigned ? "u" : "";
+
+    switch (Nd->Kind) {
+        case ND_ADD:
+            if (!isImm12(C))
+                return false;
+            genExpr(Other);
+            println("  addi%s a0, a0, %ld", Suffix, C);
+            return true;
+        // 减去常量即加上其相反数
+        case ND_SUB:
+            if (!isImm12(-C))
+                return false;
+            genExpr(Other);
+            println("  addi%s a0, a0, %ld", Suffix, -C);
+            return true;
+        case ND_BITAND:
+        case ND_BITOR:
+        case ND_BITXOR: {
+            if (!isImm12(C))
+                return false;
+            char *Op = Nd->Kind == ND_BITAND ? "andi" : Nd->Kind == ND_BITOR ? "ori" : "xori";
+            genExpr(Other);
+            println("  %s a0, a0, %ld", Op, C);
+            return true;
+        }
+        case ND_SHL:
+        case ND_SHR:
+            // 移位量超出范围的行为未定义，保留原来的指令
+            if (C < 0 || C >= (*Suffix ? 32 : 64))
+                return false;
+            genExpr(Other);
+            if (Nd->Kind == ND_SHL)
+                println("  slli%s a0, a0, %ld", Suffix, C);
+            else
+                println("  sr%si%s a0, a0, %ld", Nd->Ty->IsUnsigned ? "l" : "a", Suffix, C);
+            return true;
+        case ND_EQ:
+        case ND_NE:
+            if (!isImm12(C) || (IsU32 && C < 0))
+                return false;
+            genExpr(Other);
+            if (C)
+                println("  xori a0, a0, %ld", C);
+            println("  %s a0, a0", Nd->Kind == ND_EQ ? "seqz" : "snez");
+            return true;
+        case ND_LT:
+        case ND_LE: {
+            // x < C, x <= C即x < C+1
+            // C < x即!(x < C+1)，C <= x即!(x < C)
+            bool Inv = Swap;
+            if (Nd->Kind == ND_LT ? Swap : !Swap) {
+                // 无符号比较时C+1不能回绕
+                if (IsUnsigned && C == -1)
+                    return false;
+                C++;
+            }
+            if (!isImm12(C) || (IsU32 && C < 0))
+                return false;
+            genExpr(Other);
+            println("  slti%s a0, a0, %ld", U, C);
+            if (Inv)
+                println("  xori a0, a0, 1");
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+//
+// 位操作扩展
+//
+
+// 跳过不生成代码的整数、指针之间的类型转换，其值在寄存器中不变
+static Node *skipNopCast(Node *Nd) {
+    while (Nd->Kind == ND_CAST && Nd->Ty->Kind != TY_BOOL &&
+           (isInteger(Nd->Ty) || Nd->Ty->Kind == TY_PTR) &&
+           (isInteger(Nd->LHS->Ty) || Nd->LHS->Ty->Kind == TY_PTR) &&
+           !castTable[getTypeId(Nd->LHS->Ty)][getTypeId(Nd->Ty)])
+        Nd = Nd->LHS;
+    return Nd;
+}
+
+// 计算二元运算Nd两侧替换为L和R后的值，求值顺序与Nd相同
+static void genPair(Node *Nd, Node *L, Node *R, char **RL, char **RR) {
+    Node Tmp = *Nd;
+    Tmp.LHS = L;
+    Tmp.RHS = R;
+    genOperands(&Tmp, RL, RR);
+}
+
+// 乘以2、4、8或左移1到3位的64位下标，返回下标，*Shift为移位量
+static Node *scaledIndex(Node *Nd, int *Shift) {
+    Nd = skipNopCast(Nd);
+    if (Nd->Ty->Size != 8)
+        return NULL;
+
+    int64_t C;
+    Node *X;
+    if (Nd->Kind == ND_MUL && isConstInt(Nd->RHS, &C)) {
+        X = Nd->LHS;
+        *Shift = log2Exact(C);
+    } else if (Nd->Kind == ND_MUL && isConstInt(Nd->LHS, &C)) {
+        X = Nd->RHS;
+        *Shift = log2Exact(C);
+    } else if (Nd->Kind == ND_SHL && isConstInt(Nd->RHS, &C)) {
+        X = Nd->LHS;
+        *Shift = C >= 1 && C <= 3 ? C : -1;
+    } else {
+        return NULL;
+    }
+    return *Shift >= 1 && *Shift <= 3 ? X : NULL;
+}
+
+// Nd是否为 W - A
+static bool isWidthMinus(Node *Nd, Node *A, int W) {
+    int64_t C;
+    Nd = skipNopCast(Nd);
+    return Nd->Kind == ND_SUB && isConstInt(Nd->LHS, &C) && C == W && isPureExpr(A) &&
+           sameExpr(skipNopCast(Nd->RHS), skipNopCast(A));
+}
+
+// x << a | x >> (W - a)，x为W位的无符号数时即为循环移位
+static bool genRotate(Node *Nd) {
+    Node *Shl = skipNopCast(Nd->LHS);
+    Node *Shr = skipNopCast(Nd->RHS);
+    if (Shl->Kind == ND_SHR) {
+        Node *T = Shl;
+        Shl = Shr;
+        Shr = T;
+    }
+    if (Shl->Kind != ND_SHL || Shr->Kind != ND_SHR)
+        return false;
+    Type *Ty = Shl->Ty;
+    if (!isInteger(Ty) || !Ty->IsUnsigned || (Ty->Size != 4 && Ty->Size != 8) ||
+        !Shr->Ty->IsUnsigned || Shr->Ty->Size != Ty->Size)
+        return false;
+    Node *X = Shl->LHS;
+    if (!isPureExpr(X) || !sameExpr(X, Shr->LHS))
+        return false;
+
+    int W = Ty->Size * 8;
+    char *Suffix = W == 32 ? "w" : "";
+    int64_t A, B;
+    if (isConstInt(Shl->RHS, &A) && isConstInt(Shr->RHS, &B)) {
+        if (A <= 0 || B <= 0 || A + B != W)
+            return false;
+        genExpr(X);
+        println("  rori%s a0, a0, %ld", Suffix, B);
+        return true;
+    }
+
+    // 移位量为a和W - a时，循环移位的方向取决于哪一侧是a
+    bool Left;
+    Node *Amt;
+    if (isWidthMinus(Shr->RHS, Shl->RHS, W)) {
+        Left = true;
+        Amt = Shl->RHS;
+    } else if (isWidthMinus(Shl->RHS, Shr->RHS, W)) {
+        Left = false;
+        Amt = Shr->RHS;
+    } else {
+        return false;
+    }
+    char *RX, *RA;
+    genPair(Nd, X, Amt, &RX, &RA);
+    println("  ro%s%s a0, %s, %s", Left ? "l" : "r", Suffix, RX, RA);
+    return true;
+}
+
+// 只有一位为1的值：1 << n或2的幂常数
+// n不是常数时*Bit为n，否则*Bit为NULL，*Pos为n
+// 32位的值不能改变第31位，否则结果不再是符号扩展的
+static bool singleBit(Node *Nd, Node **Bit, int64_t *Pos, bool Is32) {
+    int64_t C;
+    Nd = skipNopCast(Nd);
+    *Bit = NULL;
+    if (isConstInt(Nd, &C)) {
+        *Pos = log2Exact(C);
+        return *Pos >= 0 && (!Is32 || *Pos < 31);
+    }
+    if (Nd->Kind != ND_SHL || !isConstInt(Nd->LHS, &C) || C != 1)
+        return false;
+    if (isConstInt(Nd->RHS, Pos))
+        return *Pos >= 0 && *Pos < (Is32 ? 31 : 64);
+    if (Is32)
+        return false;
+    *Bit = Nd->RHS;
+    return true;
+}
+
+// 置位、清除、翻转单个位，或者(x >> n) & 1取出单个位
+static bool genSingleBit(Node *Nd) {
+    bool Is32 = Nd->Ty->Size != 8;
+    int64_t Pos;
+    for (int I = 0; I < 2; I++) {
+        // 常数掩码时位置为常数，没有Bit
+        Node *Bit = NULL;
+        Node *Other = I ? Nd->RHS : Nd->LHS;
+        Node *Mask = skipNopCast(I ? Nd->LHS : Nd->RHS);
+        char *Op;
+        int64_t C;
+
+        if (Nd->Kind == ND_BITAND && isConstInt(Mask, &C) && C == 1) {
+            // (x >> n) & 1
+            Node *Shr = skipNopCast(Other);
+            if (Shr->Kind != ND_SHR)
+                continue;
+            int W = Shr->LHS->Ty->Size == 8 ? 64 : 32;
+            if (isConstInt(Shr->RHS, &Pos)) {
+                if (Pos < 0 || Pos >= W)
+                    continue;
+                genExpr(Shr->LHS);
+                println("  bexti a0, a0, %ld", Pos);
+                return true;
+            }
+            char *RX, *RN;
+            genOperands(Shr, &RX, &RN);
+            println("  bext a0, %s, %s", RX, RN);
+            return true;
+        }
+
+        if (Nd->Kind == ND_BITAND) {
+            // x & ~(1 << n)
+            if (Mask->Kind == ND_BITNOT) {
+                if (!singleBit(Mask->LHS, &Bit, &Pos, Is32))
+                    continue;
+            } else if (!isConstInt(Mask, &C) || isImm12(C) || (Pos = log2Exact(~C)) < 0 ||
+                       (Is32 && Pos >= 31)) {
+                continue;
+            }
+            Op = "bclr";
+        } else {
+            if (!singleBit(Mask, &Bit, &Pos, Is32))
+                continue;
+            // 较小的常数可以直接用ori和xori
+            if (isConstInt(Mask, &C) && isImm12(C))
+                continue;
+            Op = Nd->Kind == ND_BITOR ? "bset" : "binv";
+        }
+
+        if (!Bit) {
+            genExpr(Other);
+            println("  %si a0, a0, %ld", Op, Pos);
+            return true;
+        }
+        char *RX, *RN;
+        genPair(Nd, I ? Bit : Other, I ? Other : Bit, &RX, &RN);
+        if (I) {
+            char *T = RX;
+            RX = RN;
+            RN = T;
+        }
+        println("  %s a0, %s, %s", Op, RX, RN);
+        return true;
+    }
+    return false;
+}
+
+// 有Zba、Zbb、Zbs扩展时，用一条指令完成的运算
+// 返回是否已生成代码
+static bool genBitmanip(Node *Nd) {
+    if (!isInteger(Nd->Ty) && Nd->Ty->Kind != TY_PTR)
+        return false;
+
+    switch (Nd->Kind) {
+        // 基址加上乘以2、4、8的下标
+        case ND_ADD: {
+            if (!ExtZba || Nd->Ty->Size != 8)
+                return false;
+            int Shift;
+            Node *Idx = scaledIndex(Nd->RHS, &Shift);
+            bool IdxLeft = !Idx;
+            if (IdxLeft)
+                Idx = scaledIndex(Nd->LHS, &Shift);
+            if (!Idx)
+                return false;
+            char *L, *R;
+            genPair(Nd, IdxLeft ? Idx : Nd->LHS, IdxLeft ? Nd->RHS : Idx, &L, &R);
+            println("  sh%dadd a0, %s, %s", Shift, IdxLeft ? L : R, IdxLeft ? R : L);
+            return true;
+        }
+        case ND_BITAND:
+        case ND_BITOR:
+        case ND_BITXOR: {
+            if (ExtZbs && genSingleBit(Nd))
+                return true;
+            if (!ExtZbb)
+                return false;
+            if (Nd->Kind == ND_BITOR && genRotate(Nd))
+                return true;
+
+            // 一侧取反的与、或、异或
+            Node *NotL = skipNopCast(Nd->LHS);
+            Node *NotR = skipNopCast(Nd->RHS);
+            char *Op = Nd->Kind == ND_BITAND ? "andn" : Nd->Kind == ND_BITOR ? "orn" : "xnor";
+            char *L, *R;
+            if (NotR->Kind == ND_BITNOT) {
+                genPair(Nd, Nd->LHS, NotR->LHS, &L, &R);
+                println("  %s a0, %s, %s", Op, L, R);
+                return true;
+            }
+            if (NotL->Kind == ND_BITNOT) {
+                genPair(Nd, NotL->LHS, Nd->RHS, &L, &R);
+                println("  %s a0, %s, %s", Op, R, L);
+                return true;
+            }
+            return false;
+        }
+        default:
+            return false;
+    }
+}
+
+// a0 = a0中前导零、末尾零或1的个数，Is32时只计算低32位
+// 没有Zbb扩展时逐位计算，a0为0时前导零和末尾零的个数为位宽
+static void genBitCount(NodeKind Kind, bool Is32) {
+    char *Suffix = Is32 ? "w" : "";
+    if (ExtZbb) {
+        char *Op = Kind == ND_CLZ ? "clz" : Kind == ND_CTZ ? "ctz" : "cpop";
+        println("  %s%s a0, a0", Op, Suffix);
+        return;
+    }
+
+    int C = count();
+    int W = Is32 ? 32 : 64;
+    if (Is32)
+        zextW("a0");
+    println("  mv t0, a0");
+    switch (Kind) {
+        case ND_CLZ:
+            // 每次右移一位，直到为0
+            println("  li a0, %d", W);
+            println(".L.bits.%d:", C);
+            println("  beqz t0, .L.bits.end.%d", C);
+            println("  srli t0, t0, 1");
+            println("  addi a0, a0, -1");
+            break;
+        case ND_CTZ:
+            // 每次右移一位，直到最低位为1
+            println("  li a0, %d", W);
+            println("  beqz t0, .L.bits.end.%d", C);
+            println("  li a0, 0");
+            println(".L.bits.%d:", C);
+            println("  andi t1, t0, 1");
+            println("  bnez t1, .L.bits.end.%d", C);
+            println("  srli t0, t0, 1");
+            println("  addi a0, a0, 1");
+            break;
+        default:
+            // 每次清除最低的1
+            println("  li a0, 0");
+            println(".L.bits.%d:", C);
+            println("  beqz t0, .L.bits.end.%d", C);
+            println("  addi t1, t0, -1");
+            println("  and t0, t0, t1");
+            println("  addi a0, a0, 1");
+            break;
+    }
+    println("  j .L.bits.%d", C);
+    println(".L.bits.end.%d:", C);
+}
+
+//
+// 浮点运算
+//
+
+// 与Ty类型相同的浮点乘法
+static bool isFMul(Node *Nd, Type *Ty) {
+    return Nd->Kind == ND_MUL && Nd->Ty->Kind == Ty->Kind;
+}
+
+// 乘法和加减法融合为一条指令，中间结果不再舍入，由-ffp-contract=fast开启
+//      a*b + c => fmadd      a*b - c => fmsub
+//      c - a*b => fnmsub     -(a*b) - c => fnmadd
+static bool genFMA(Node *Nd) {
+    if (!isFloNum(Nd->Ty) || (Nd->Kind != ND_ADD && Nd->Kind != ND_SUB))
+        return false;
+
+    bool IsSub = Nd->Kind == ND_SUB;
+    Node *Mul, *Add;
+    bool NegMul = false, NegAdd = false;
+    if (isFMul(Nd->LHS, Nd->Ty)) {
+        Mul = Nd->LHS;
+        Add = Nd->RHS;
+        NegAdd = IsSub;
+    } else if (isFMul(Nd->RHS, Nd->Ty)) {
+        Mul = Nd->RHS;
+        Add = Nd->LHS;
+        NegMul = IsSub;
+    } else if (Nd->LHS->Kind == ND_NEG && isFMul(Nd->LHS->LHS, Nd->Ty)) {
+        Mul = Nd->LHS->LHS;
+        Add = Nd->RHS;
+        NegMul = true;
+        NegAdd = IsSub;
+    } else {
+        return false;
+    }
+
+    // 0、1为两个乘数，2为加数
+    Node *Ops[] = {Mul->LHS, Mul->RHS, Add};
+    char *Regs[3];
+    if (Nd->Order == ORD_ANY && Mul->Order == ORD_ANY) {
+        genOperandList(Ops, 3, Regs, false);
+    } else {
+        // 优化阶段固定了求值顺序，按Nd和Mul的顺序排列三个值
+        bool MulLFirst = Mul->Order != ORD_RHS;
+        bool MulFirst = (Mul == Nd->RHS) == (Nd->Order == ORD_RHS);
+        int Seq[3], K = 0;
+        if (!MulFirst)
+            Seq[K++] = 2;
+        Seq[K++] = MulLFirst ? 0 : 1;
+        Seq[K++] = MulLFirst ? 1 : 0;
+        if (MulFirst)
+            Seq[K++] = 2;
+        Node *SeqOps[3];
+        char *SeqRegs[3];
+        for (int I = 0; I < 3; I++)
+            SeqOps[I] = Ops[Seq[I]];
+        genOperandList(SeqOps, 3, SeqRegs, true);
+        for (int I = 0; I < 3; I++)
+            Regs[Seq[I]] = SeqRegs[I];
+    }
+    char *Insn = NegMul ? (NegAdd ? "fnmadd" : "fnmsub") : (NegAdd ? "fmsub" : "fmadd");
+    char *Suffix = Nd->Ty->Kind == TY_FLOAT ? "s" : "d";
+    println("  %s.%s fa0, %s, %s, %s", Insn, Suffix, Regs[0], Regs[1], Regs[2]);
+    return true;
+}
+
+// 除以常数改为乘以其倒数
+// 除数为2的幂时倒数可以精确表示，结果与除法相同；-ffast-math时不要求精确
+static bool genFRecipDiv(Node *Nd) {
+    if (Nd->Kind != ND_DIV || !isFloNum(Nd->Ty) || Nd->RHS->Kind != ND_NUM)
+        return false;
+
+    bool IsFloat = Nd->Ty->Kind == TY_FLOAT;
+    uint64_t Bits = fconstBits(Nd->RHS);
+    int MantBits = IsFloat ? 23 : 52;
+    int Exp = (Bits >> MantBits) & (IsFloat ? 0xff : 0x7ff);
+    int MaxExp = IsFloat ? 0xff : 0x7ff;
+    // 0、无穷大和NaN没有可用的倒数
+    if (Exp == 0 || Exp == MaxExp)
+        return false;
+    bool Exact = !(Bits & ((1ULL << MantBits) - 1)) && Exp < MaxExp - 1;
+    if (!Exact && !OptFastMath)
+        return false;
+
+    Node Recip = *Nd->RHS;
+    Recip.FVal = IsFloat ? (double)(1.0f / (float)Nd->RHS->FVal) : 1.0 / Nd->RHS->FVal;
+    Node Mul = *Nd;
+    Mul.Kind = ND_MUL;
+    Mul.RHS = &Recip;
+    genExpr(&Mul);
+    return true;
+}
+
+// 同一个变量或相同的常量，可以只求值一次
+static bool sameLeaf(Node *A, Node *B) {
+    if (A->Kind != B->Kind)
+        return false;
+    if (A->Kind == ND_VAR)
+        return A->Var == B->Var;
+    if (A->Kind == ND_NUM)
+        return A->Val == B->Val && A->FVal == B->FVal;
+    return false;
+}
+
+// -ffast-math时，比较后选出较小或较大的一个改用fmin/fmax
+// 两者对NaN和±0的处理与?:不同
+//      a < b ? a : b => fmin     a < b ? b : a => fmax
+static bool genFMinMax(Node *Nd) {
+    Node *Cond = Nd->Cond;
+    if (!isFloNum(Nd->Ty) || (Cond->Kind != ND_LT && Cond->Kind != ND_LE) ||
+        Cond->LHS->Ty->Kind != Nd->Ty->Kind)
+        return false;
+
+    char *Insn;
+    if (sameLeaf(Nd->Then, Cond->LHS) && sameLeaf(Nd->Els, Cond->RHS))
+        Insn = "fmin";
+    else if (sameLeaf(Nd->Then, Cond->RHS) && sameLeaf(Nd->Els, Cond->LHS))
+        Insn = "fmax";
+    else
+        return false;
+
+    char *L, *R;
+    genOperands(Cond, &L, &R);
+    println("  %s.%s fa0, %s, %s", Insn, Nd->Ty->Kind == TY_FLOAT ? "s" : "d", L, R);
+    return true;
+}
+
+// -ffast-math时不考虑NaN，比较的结果取反改为相反的比较
+//      !(a < b) => b <= a     !(a <= b) => b < a
+static bool genFNotCmp(Node *Nd) {
+    Node *Cmp = Nd->LHS;
+    if ((Cmp->Kind != ND_LT && Cmp->Kind != ND_LE) || !isFloNum(Cmp->LHS->Ty))
+        return false;
+
+    Node Inv = *Cmp;
+    Inv.Kind = Cmp->Kind == ND_LT ? ND_LE : ND_LT;
+    Inv.LHS = Cmp->RHS;
+    Inv.RHS = Cmp->LHS;
+    // 左右交换后，CSE固定的求值顺序也要跟着交换
+    if (Cmp->Order != ORD_ANY)
+        Inv.Order = Cmp->Order == ORD_LHS ? ORD_RHS : ORD_LHS;
+    genExpr(&Inv);
+    return true;
+}
+
+// sementics: print the asm from an ast whose root node is `Nd`
+// steps: for each node,
+// 1. if it is a leaf node, then directly print the answer and return
+// 2. otherwise:
+//      get the value of its rhs sub-tree first, 
+//      save that answer to the stack. 
+//      then get the lhs sub-tree's value.
 //      now we have both sub-tree's value, 
 //      and how to deal with these two values depends on current root node
 // 生成表达式. after expr is generated its value will be put to a0
@@ -572,6 +3146,8 @@ static void genExpr(Node *Nd) {
             return;
     // logical op
         case ND_NOT:
+            if (OptFastMath && genFNotCmp(Nd))
+                return;
             genExpr(Nd->LHS);
             notZero(Nd->LHS->Ty);
             println("  seqz a0, a0");
@@ -579,6 +3155,16 @@ static void genExpr(Node *Nd) {
         // 逻辑与
         case ND_LOGAND: {
             int C = count();
+            // 跳转代码中直接得到结果
+            if (OptLevel) {
+                genBranch(Nd, false, format(".L.false.%d", C));
+                println("  li a0, 1");
+                println("  j .L.end.%d", C);
+                println(".L.false.%d:", C);
+                println("  li a0, 0");
+                println(".L.end.%d:", C);
+                return;
+            }
             genExpr(Nd->LHS);
             notZero(Nd->LHS->Ty);
             // 左部短路操作判断，为0则跳转
@@ -597,6 +3183,15 @@ static void genExpr(Node *Nd) {
         // 逻辑或
         case ND_LOGOR: {
             int C = count();
+            if (OptLevel) {
+                genBranch(Nd, true, format(".L.true.%d", C));
+                println("  li a0, 0");
+                println("  j .L.end.%d", C);
+                println(".L.true.%d:", C);
+                println("  li a0, 1");
+                println(".L.end.%d:", C);
+                return;
+            }
             genExpr(Nd->LHS);
             notZero(Nd->LHS->Ty);
             // 左部短路操作判断，不为0则跳转
@@ -630,21 +3225,9 @@ static void genExpr(Node *Nd) {
     // others. general op
         case ND_NUM: {
             switch (Nd->Ty->Kind) {
-                case TY_FLOAT:{
-                    // 将a0转换到float类型值为%f的fa0中
-                    // can't do the cast directly like (uint32_t)Nd->FVal.
-                    // if so, something like 0.999 will be truncated to 0.
-                    // and we wish things like (_Bool)0.1l to be "true".
-                    // we need to reinterpret the bits here
-                    float f = Nd->FVal;
-                    println("  li a0, %u  # float %f", *(uint32_t*)&f, Nd->FVal);
-                    println("  fmv.w.x fa0, a0");
-                    return;
-                }
+                case TY_FLOAT:
                 case TY_DOUBLE:
-                    // 将a0转换到double类型值为%f的fa0中
-                    println("  li a0, %lu  # double %f", *(uint64_t*)&Nd->FVal, Nd->FVal);
-                    println("  fmv.d.x fa0, a0");
+                    genFConst(Nd);
                     return;
                 default:
                     println("  li a0, %ld", Nd->Val);
@@ -655,22 +3238,45 @@ static void genExpr(Node *Nd) {
         // 变量. note: array also has VAR type
         case ND_VAR:
         case ND_MEMBER:
+            if (OptLevel && genLoad(Nd))
+                return;
             // 计算出变量的地址, 存入a0
             genAddr(Nd);
             // load a value from the generated address
             load(Nd->Ty);
             return;
         // 赋值
-        case ND_ASSIGN:
+        case ND_ASSIGN: {
+            // 返回较大结构体的调用直接将返回值存入未取过地址的局部变量
+            Node *Call = OptLevel ? sretCall(Nd->RHS) : NULL;
+            if (Call && Nd->LHS->Kind == ND_VAR && Nd->LHS->Var->IsLocal &&
+                !Nd->LHS->Var->IsAddrTaken) {
+                genFuncall(Call, Nd->LHS);
+                return;
+            }
+            if (OptLevel && genStore(Nd))
+                return;
             // 左部是左值，保存值到的地址
             genAddr(Nd->LHS);
+            // 右部没有调用时，地址暂存在临时寄存器中
+            if (OptLevel && !hasCall(Nd->RHS) && TmpDepth < TMP_REGS) {
+                char *Addr = TmpRegs[TmpDepth++];
+                println("  mv %s, a0", Addr);
+                genExpr(Nd->RHS);
+                TmpDepth--;
+                storeTo(Nd->Ty, Addr);
+                return;
+            }
             push();
             // 右部是右值，为表达式的值
             genExpr(Nd->RHS);
             store(Nd->Ty);
             return;
+        }
         // 解引用. *var
         case ND_DEREF:
+            if (OptLevel && genLoad(Nd))
+                return;
             // get the address first
             genExpr(Nd->LHS);
             load(Nd->Ty);
@@ -680,58 +3286,9 @@ static void genExpr(Node *Nd) {
             genAddr(Nd->LHS);
             return;
         // 函数调用
-        case ND_FUNCALL:{
-            // 计算所有参数的值，正向压栈
-            pushArgs(Nd->Args);
-            // 将a0的值(fn address)存入t5
-            // LHS is an ident(ND_VAR), genExpr
-            // will get that ident's address
-            genExpr(Nd->LHS);
-            println("  mv t5, a0");
-            // 反向弹栈，a0->参数1，a1->参数2...
-            int GP = 0, FP = 0;
-            // 读取函数形参中的参数类型
-            Type *CurArg = Nd->FuncType->Params;
-            for (Node *Arg = Nd->Args; Arg; Arg = Arg->Next) {
-                // 如果是可变参数函数
-                // 匹配到空参数（最后一个）的时候，将剩余的整型寄存器弹栈
-                if (Nd->FuncType->IsVariadic && CurArg == NULL) {
-                    if (GP < 8) {
-                        println("  # a%d传递可变实参", GP);
-                        pop(GP++);
-                    }
-                    continue;
-                }
-
-                CurArg = CurArg->Next;
-                if (isFloNum(Arg->Ty)) {
-                    if (FP < 8) {
-                        println("  # fa%d传递浮点参数", FP);
-                        popF(FP++);
-                    } else if (GP < 8) {
-                        println("  # a%d传递浮点参数", GP);
-                        pop(GP++);
-                    }
-                } else {
-                    if (GP < 8) {
-                        println("  # a%d传递整型参数", GP);
-                        pop(GP++);
-                    }
-                }
-            }
-            // 调用函数
-            // the contents of the function is generated by test.sh, not by rvccl
-            if (Depth % 2 == 0) {
-                // 偶数深度，sp已经对齐16字节
-                println("  jalr t5  # %s", Nd->FuncName);
-            } else {
-                // 对齐sp到16字节的边界
-                println("  addi sp, sp, -8");
-                println("  jalr t5  # %s", Nd->FuncName);
-                println("  addi sp, sp, 8");
-            }
+        case ND_FUNCALL:
+            genFuncall(Nd, NULL);
             return;
-        }
         // 语句表达式
         case ND_STMT_EXPR:
             for (Node *N = Nd->Body; N; N = N->Next)
@@ -745,14 +3302,20 @@ static void genExpr(Node *Nd) {
         // 类型转换
         case ND_CAST:
             genExpr(Nd->LHS);
+            // 值已经按照目标类型扩展好时不需要转换
+            if (OptLevel && isNopCast(Nd, extOf(Nd->LHS)))
+                return;
             cast(Nd->LHS->Ty, Nd->Ty);
             return;
         // 条件运算符
         case ND_COND: {
+            if (OptFastMath && genFMinMax(Nd))
+                return;
+            // 两侧都很简单时不使用分支
+            if (genSelect(Nd))
+                return;
             int C = count();
-            genExpr(Nd->Cond);
-            notZero(Nd->Cond->Ty);
-            println("  beqz a0, .L.else.%d", C);
+            genBranch(Nd->Cond, false, format(".L.else.%d", C));
             genExpr(Nd->Then);
             println("  j .L.end.%d", C);
             println(".L.else.%d:", C);
@@ -762,195 +3325,1190 @@ static void genExpr(Node *Nd) {
         }
         // 内存清零
         case ND_MEMZERO: {
-            int Offset = Nd->Var->Offset;
+            int Offset = Nd->Var->Offset + FrameBias;
             int Size = Nd->Var->Ty->Size;
-            println("  # 对%s的内存%d(fp)清零%d位", Nd->Var->Name, Offset, Size);
+            println("  # 对%s的内存%d(%s)清零%d位", Nd->Var->Name, Offset, FrameReg, Size);
+            if (OptLevel) {
+                zeroBlock(Offset, Size);
+                return;
+            }
             // 对栈内变量所占用的每个字节都进行清零
             int I = 0;
             if(isLegalImmS(Offset)){
                 while( I + 8 <= Size){
-                    println("  sd zero, %d(fp)", Offset+I);
+                    println("  sd zero, %d(%s)", Offset+I, FrameReg);
                     I += 8;
                 }
                 while( I + 4 <= Size){
-                    println("  sw zero, %d(fp)", Offset+I);
+                    println("  sw zero, %d(%s)", Offset+I, FrameReg);
                     I += 4;
                 }
                 while( I + 2 <= Size){
-                    println("  sh zero, %d(fp)", Offset+I);
+                    println("  sh zero, %d(%s)", Offset+I, FrameReg);
                     I += 2;
                 }
                 while( I + 1 <= Size){
-                    println("  sb zero, %d(fp)", Offset+I);
+                    println("  sb zero, %d(%s)", Offset+I, FrameReg);
                     I += 1;
                 }
             }
             else{
                 while( I + 8 <= Size){
                     println("  li t0, %d", Offset + I);
-                    println("  add t0, fp, t0");
-                    println("  sb zero, 0(t0)");
+                    println("  add t0, %s, t0", FrameReg);
+                    println("  sd zero, 0(t0)");
                     I += 8;
                 }
                 while( I + 4 <= Size){
                     println("  li t0, %d", Offset + I);
-                    println("  add t0, fp, t0");
+                    println("  add t0, %s, t0", FrameReg);
                     println("  sw zero, 0(t0)");
                     I += 4;
                 }
                 while( I + 2 <= Size){
                     println("  li t0, %d", Offset + I);
-                    println("  add t0, fp, t0");
+                    println("  add t0, %s, t0", FrameReg);
                     println("  sh zero, 0(t0)");
                     I += 2;
                 }
                 while( I + 1 <= Size){
                     println("  li t0, %d", Offset + I);
-                    println("  add t0, fp, t0");
+                    println("  add t0, %s, t0", FrameReg);
                     println("  sb zero, 0(t0)");
                     I += 1;
                 }
             }
-            return;
+            return;
+        }
+        // 空表达式
+        case ND_NULL_EXPR:
+            return;
+        // 位计数的内建函数
+        case ND_CLZ:
+        case ND_CTZ:
+        case ND_POPCOUNT:
+            genExpr(Nd->LHS);
+            genBitCount(Nd->Kind, Nd->LHS->Ty->Size == 4);
+            return;
+
+        default:
+            break;
+    }
+
+
+    // -march中有位操作扩展时可用的指令
+    if (OptLevel && genBitmanip(Nd))
+        return;
+    // 乘除以常数时改用移位、加减和乘法取高位
+    if (OptLevel && genConstArith(Nd))
+        return;
+    // 一侧为较小的常量时使用立即数形式的指令
+    if (OptLevel && genImmArith(Nd))
+        return;
+    // 浮点乘加融合
+    if (OptFPContract && genFMA(Nd))
+        return;
+    // 浮点数除以常数改为乘法
+    if ((OptLevel || OptFastMath) && genFRecipDiv(Nd))
+        return;
+
+    // 计算两侧的值. L: lhs value. R: rhs value
+    char *L, *R;
+    genOperands(Nd, &L, &R);
+
+    // 处理浮点类型
+    if (isFloNum(Nd->LHS->Ty)) {
+        // 生成各个二叉树节点
+        // float对应s(single)后缀，double对应d(double)后缀
+        char *Suffix = (Nd->LHS->Ty->Kind == TY_FLOAT) ? "s" : "d";
+
+        switch (Nd->Kind) {
+            case ND_ADD:
+                println("  fadd.%s fa0, %s, %s", Suffix, L, R);
+                return;
+            case ND_SUB:
+                println("  fsub.%s fa0, %s, %s", Suffix, L, R);
+                return;
+            case ND_MUL:
+                println("  fmul.%s fa0, %s, %s", Suffix, L, R);
+                return;
+            case ND_DIV:
+                println("  fdiv.%s fa0, %s, %s", Suffix, L, R);
+                return;
+            case ND_EQ:
+                println("  feq.%s a0, %s, %s", Suffix, L, R);
+                return;
+            case ND_NE:
+                println("  feq.%s a0, %s, %s", Suffix, L, R);
+                println("  seqz a0, a0");
+                return;
+            case ND_LT:
+                println("  flt.%s a0, %s, %s", Suffix, L, R);
+                return;
+            case ND_LE:
+                println("  fle.%s a0, %s, %s", Suffix, L, R);
+                return;
+            default:
+                errorTok(Nd->Tok, "invalid expression");
+        }
+    }
+
+    // 生成各个二叉树节点
+    // ptr and long still use RV64, other data types can use RV32
+    char *Suffix = Nd->LHS->Ty->Kind == TY_LONG || Nd->LHS->Ty->Base? "" : "w";
+    switch (Nd->Kind) {
+        case ND_ADD: // + a0=L+R
+            println("  add%s a0, %s, %s", Suffix, L, R);
+            return;
+        case ND_SUB: // - a0=L-R
+            println("  sub%s a0, %s, %s", Suffix, L, R);
+            return;
+        case ND_MUL: // * a0=L*R
+            println("  mul%s a0, %s, %s", Suffix, L, R);
+            return;
+        case ND_DIV: // / a0=L/R
+            println("  div%s%s a0, %s, %s", Nd->Ty->IsUnsigned? "u": "", Suffix, L, R);
+            return;
+        case ND_MOD: // % a0=L%R
+            println("  rem%s%s a0, %s, %s", Nd->Ty->IsUnsigned? "u": "", Suffix, L, R);
+            return;
+        case ND_SHL:
+            println("  sll%s a0, %s, %s", Suffix, L, R);
+            return;
+        case ND_SHR:
+            if (Nd->Ty->IsUnsigned)
+                println("  srl%s a0, %s, %s", Suffix, L, R);
+            else
+                println("  sra%s a0, %s, %s", Suffix, L, R);
+            return;
+        case ND_NE:
+        case ND_EQ:
+            // 两边扩展的方式相同时可以直接比较
+            if (!sameU32Ext(Nd->LHS, Nd->RHS)) {
+                if (Nd->LHS->Ty->IsUnsigned && Nd->LHS->Ty->Kind == TY_INT) {
+                    println("  # 左部是U32类型，需要截断");
+                    zextW(L);
+                };
+                if (Nd->RHS->Ty->IsUnsigned && Nd->RHS->Ty->Kind == TY_INT) {
+                    println("  # 右部是U32类型，需要截断");
+                    zextW(R);
+                };
+            }
+            println("  xor a0, %s, %s", L, R);
+        if(Nd->Kind ==  ND_EQ)
+            // if L == R, then L ^ R should be 0
+            println("  seqz a0, a0");
+        else
+            // if L != R, then L ^ R should not be 0
+            println("  snez a0, a0");
+            return;
+        case ND_LE: // L <= R
+            // L <= R -> !(L > R)
+            // note: '!' here means 0 -> 1, 1-> 0. 
+            // which is different from the 'neg' inst
+            println("  slt%s a0, %s, %s", Nd->LHS->Ty->IsUnsigned? "u": "", R, L);
+            println("  xori a0, a0, 1");
+            return;
+        case ND_LT: // L < R
+            println("  slt%s a0, %s, %s", Nd->LHS->Ty->IsUnsigned? "u": "", L, R);
+            return;
+        case ND_BITAND: // & a0=L&R
+            println("  and a0, %s, %s", L, R);
+            return;
+        case ND_BITOR: // | a0=L|R
+            println("  or a0, %s, %s", L, R);
+            return;
+        case ND_BITXOR: // ^ a0=L^R
+            println("  xor a0, %s, %s", L, R);
+            return;
+        default:
+            break;
+    }
+
+    error("%s: invalid expression", Nd -> Tok -> Loc);
+}
+
+//
+// 条件跳转
+//
+
+// 是否为整数或指针类型的常数0
+static bool isZeroConst(Node *Nd) {
+    while (Nd->Kind == ND_CAST && (isInteger(Nd->Ty) || Nd->Ty->Kind == TY_PTR) &&
+           (isInteger(Nd->LHS->Ty) || Nd->LHS->Ty->Kind == TY_PTR))
+        Nd = Nd->LHS;
+    return Nd->Kind == ND_NUM && isInteger(Nd->Ty) && Nd->Val == 0;
+}
+
+// 整数比较直接生成比较并跳转的指令，与0比较时使用zero寄存器
+static void genCmpBranch(Node *Nd, bool Jump, char *Label) {
+    char *L, *R;
+    if (isZeroConst(Nd->RHS)) {
+        genExpr(Nd->LHS);
+        L = "a0";
+        R = "zero";
+    } else if (isZeroConst(Nd->LHS)) {
+        genExpr(Nd->RHS);
+        L = "zero";
+        R = "a0";
+    } else {
+        genOperands(Nd, &L, &R);
+    }
+
+    char *U = Nd->LHS->Ty->IsUnsigned ? "u" : "";
+    switch (Nd->Kind) {
+        case ND_EQ:
+        case ND_NE:
+            // U32类型的值需要截断后再比较，两边扩展的方式相同时除外
+            if (Nd->LHS->Ty->IsUnsigned && Nd->LHS->Ty->Kind == TY_INT &&
+                !sameU32Ext(Nd->LHS, Nd->RHS)) {
+                if (strcmp(L, "zero"))
+                    zextW(L);
+                if (strcmp(R, "zero"))
+                    zextW(R);
+            }
+            println("  %s %s, %s, %s", (Nd->Kind == ND_EQ) == Jump ? "beq" : "bne", L, R, Label);
+            return;
+        // L < R，不成立时跳转即为 L >= R
+        case ND_LT:
+            println("  %s%s %s, %s, %s", Jump ? "blt" : "bge", U, L, R, Label);
+            return;
+        // L <= R 即 R >= L，不成立时跳转即为 R < L
+        case ND_LE:
+            println("  %s%s %s, %s, %s", Jump ? "bge" : "blt", U, R, L, Label);
+            return;
+        default:
+            errorTok(Nd->Tok, "invalid expression");
+    }
+}
+
+// 浮点比较的结果放入a0后跳转，!=通过对==的结果取反实现
+static void genFCmpBranch(Node *Nd, bool Jump, char *Label) {
+    char *L, *R;
+    genOperands(Nd, &L, &R);
+    char *Suffix = (Nd->LHS->Ty->Kind == TY_FLOAT) ? "s" : "d";
+    switch (Nd->Kind) {
+        case ND_EQ:
+            println("  feq.%s a0, %s, %s", Suffix, L, R);
+            break;
+        case ND_NE:
+            println("  feq.%s a0, %s, %s", Suffix, L, R);
+            Jump = !Jump;
+            break;
+        case ND_LT:
+            println("  flt.%s a0, %s, %s", Suffix, L, R);
+            break;
+        case ND_LE:
+            println("  fle.%s a0, %s, %s", Suffix, L, R);
+            break;
+        default:
+            errorTok(Nd->Tok, "invalid expression");
+    }
+    println("  %s a0, %s", Jump ? "bnez" : "beqz", Label);
+}
+
+// 短路求值的&&和||
+// 对于&&，任一侧为假即为假；对于||，任一侧为真即为真
+static void genLogicBranch(Node *Nd, bool Jump, char *Label) {
+    // 一侧的值为Short时即可确定结果
+    bool Short = Nd->Kind == ND_LOGOR;
+    if (Jump == Short) {
+        genBranch(Nd->LHS, Jump, Label);
+        genBranch(Nd->RHS, Jump, Label);
+        return;
+    }
+
+    int C = count();
+    char *Skip = format(".L.skip.%d", C);
+    genBranch(Nd->LHS, Short, Skip);
+    genBranch(Nd->RHS, Jump, Label);
+    println("%s:", Skip);
+}
+
+// 计算条件，其真假等于Jump时跳转到Label，否则继续执行
+// 比较和逻辑运算直接生成跳转，而不先得到0或1
+static void genBranch(Node *Nd, bool Jump, char *Label) {
+    if (!OptLevel) {
+        genExpr(Nd);
+        notZero(Nd->Ty);
+        println("  %s a0, %s", Jump ? "bnez" : "beqz", Label);
+        return;
+    }
+
+    int64_t Val;
+    switch (Nd->Kind) {
+        case ND_NOT:
+            genBranch(Nd->LHS, !Jump, Label);
+            return;
+        case ND_LOGAND:
+        case ND_LOGOR:
+            genLogicBranch(Nd, Jump, Label);
+            return;
+        case ND_COMMA:
+            genExpr(Nd->LHS);
+            genBranch(Nd->RHS, Jump, Label);
+            return;
+        // 整数扩展或转为bool时，是否为0不变
+        case ND_CAST:
+            if (isInteger(Nd->Ty) && isInteger(Nd->LHS->Ty) &&
+                (Nd->Ty->Kind == TY_BOOL || Nd->Ty->Size >= Nd->LHS->Ty->Size)) {
+                genBranch(Nd->LHS, Jump, Label);
+                return;
+            }
+            break;
+        case ND_EQ:
+        case ND_NE:
+        case ND_LT:
+        case ND_LE:
+            if (isFloNum(Nd->LHS->Ty))
+                genFCmpBranch(Nd, Jump, Label);
+            else
+                genCmpBranch(Nd, Jump, Label);
+            return;
+        default:
+            break;
+    }
+
+    // 常量条件
+    if (isConstInt(Nd, &Val)) {
+        if ((Val != 0) == Jump)
+            println("  j %s", Label);
+        return;
+    }
+
+    genExpr(Nd);
+    if (isFloNum(Nd->Ty)) {
+        // a0 = (Nd == 0)
+        char *Suffix = (Nd->Ty->Kind == TY_FLOAT) ? "s" : "d";
+        println("  fmv.%s.x fa1, zero", Suffix);
+        println("  feq.%s a0, fa0, fa1", Suffix);
+        println("  %s a0, %s", Jump ? "beqz" : "bnez", Label);
+        return;
+    }
+    println("  %s a0, %s", Jump ? "bnez" : "beqz", Label);
+}
+
+//
+// switch的分派
+//
+
+// 至少有这么多case，并且值的分布足够密集时，才使用跳转表
+#define MIN_JUMP_TABLE 4
+// 跳转表中case所占的最小比例(%)
+#define MIN_TABLE_DENSITY 40
+// 不超过这么多组case时，直接逐个比较
+#define MAX_LINEAR_CLUSTERS 3
+
+// 一组case：单个case，或者一段用跳转表分派的值
+typedef struct {
+    int64_t Lo, Hi; // 值的范围
+    int Begin, End; // 在排好序的case数组中的下标范围[Begin, End)
+} CaseCluster;
+
+// 当前switch的所有case(按值排序)，以及比较时是否为无符号数
+static Node **SwCases;
+static int64_t *SwVals;
+static bool SwUnsigned;
+
+static bool caseLess(int64_t A, int64_t B) {
+    return SwUnsigned ? (uint64_t)A < (uint64_t)B : A < B;
+}
+
+// [Begin, End)中的case是否适合用跳转表分派
+static bool isDense(int Begin, int End) {
+    if (End - Begin < MIN_JUMP_TABLE)
+        return false;
+    uint64_t Range = (uint64_t)SwVals[End - 1] - (uint64_t)SwVals[Begin];
+    if (Range >= INT32_MAX)
+        return false;
+    return (uint64_t)(End - Begin) * 100 >= (Range + 1) * MIN_TABLE_DENSITY;
+}
+
+// 用跳转表分派一组case，值不在范围内时跳转到Miss
+static void genJumpTable(CaseCluster *C, char *Default, char *Miss) {
+    int Id = count();
+    println("  # 跳转表分派%ld到%ld的case", C->Lo, C->Hi);
+    // t0 = a0 - Lo，同时检查两侧的边界
+    if (C->Lo > -0x800 && C->Lo <= 0x800) {
+        println("  addi t0, a0, %ld", -C->Lo);
+    } else {
+        println("  li t1, %ld", C->Lo);
+        println("  sub t0, a0, t1");
+    }
+    println("  li t1, %lu", (uint64_t)C->Hi - (uint64_t)C->Lo + 1);
+    println("  bgeu t0, t1, %s", Miss);
+    println("  la t1, .L.switch.%d", Id);
+    println("  slli t0, t0, 3");
+    println("  add t0, t0, t1");
+    println("  ld t0, 0(t0)");
+    println("  jr t0");
+
+    println("  .section .rodata");
+    println("  .align 3");
+    println(".L.switch.%d:", Id);
+    int I = C->Begin;
+    for (uint64_t V = C->Lo;; V++) {
+        // 空缺的值跳转到default
+        if ((uint64_t)SwVals[I] == V)
+            println("  .quad %s", SwCases[I++]->Label);
+        else
+            println("  .quad %s", Default);
+        if (V == (uint64_t)C->Hi)
+            break;
+    }
+    println("  .text");
+}
+
+// 在[Lo, Hi]的case组中查找a0，都不匹配时跳转到Default
+static void genCaseTree(CaseCluster *Cls, int Lo, int Hi, char *Default) {
+    // 组数较少时逐个比较
+    if (Hi - Lo < MAX_LINEAR_CLUSTERS) {
+        for (int I = Lo; I <= Hi; I++) {
+            CaseCluster *C = &Cls[I];
+            if (C->End - C->Begin == 1) {
+                println("  li t0, %ld", C->Lo);
+                println("  beq a0, t0, %s", SwCases[C->Begin]->Label);
+            } else if (I == Hi) {
+                genJumpTable(C, Default, Default);
+                return;
+            } else {
+                int Id = count();
+                char *Next = format(".L.case.%d", Id);
+                genJumpTable(C, Default, Next);
+                println("%s:", Next);
+            }
+        }
+        println("  j %s", Default);
+        return;
+    }
+
+    // 二分：小于中间一组的最小值时查找左半部分
+    int Mid = (Lo + Hi + 1) / 2;
+    int Id = count();
+    println("  li t0, %ld", Cls[Mid].Lo);
+    println("  %s a0, t0, .L.case.%d", SwUnsigned ? "bltu" : "blt", Id);
+    genCaseTree(Cls, Mid, Hi, Default);
+    println(".L.case.%d:", Id);
+    genCaseTree(Cls, Lo, Mid - 1, Default);
+}
+
+// 32位的值在寄存器中可能是符号扩展或零扩展的，统一扩展后再与case的值比较
+// 已经扩展好时不需要再扩展
+static void extendSwitchCond(Node *Nd) {
+    Type *Ty = Nd->Ty;
+    Ext E = OptLevel ? extOf(Nd) : newExt(64, 64);
+    if (Ty->Size == 4 && Ty->IsUnsigned) {
+        if (E.Z > 32)
+            zextW("a0");
+    } else if (Ty->Size == 4 && E.S > 32) {
+        println("  sext.w a0, a0");
+    }
+}
+
+// case的值按照switch条件的类型扩展到64位
+static int64_t caseVal(Type *Ty, int64_t V) {
+    if (Ty->Size == 4)
+        return Ty->IsUnsigned ? (int64_t)(uint32_t)V : (int64_t)(int32_t)V;
+    return V;
+}
+
+// 将a0与各case的值比较，跳转到对应的标签
+// 排序后的case被分成若干组，密集的值用跳转表，各组之间用二分查找
+static void genSwitchDispatch(Node *Nd) {
+    Type *Ty = Nd->Cond->Ty;
+    SwUnsigned = Ty->Size == 8 && Ty->IsUnsigned;
+
+    int N = 0;
+    for (Node *C = Nd->CaseNext; C; C = C->CaseNext)
+        N++;
+    SwCases = calloc(N, sizeof(Node *));
+    SwVals = calloc(N, sizeof(int64_t));
+
+    // 插入排序，相同的值只保留第一个
+    int Cnt = 0;
+    for (Node *C = Nd->CaseNext; C; C = C->CaseNext) {
+        int64_t V = caseVal(Ty, C->Val);
+        int I = Cnt;
+        while (I > 0 && caseLess(V, SwVals[I - 1]))
+            I--;
+        if (I > 0 && SwVals[I - 1] == V)
+            continue;
+        for (int J = Cnt; J > I; J--) {
+            SwVals[J] = SwVals[J - 1];
+            SwCases[J] = SwCases[J - 1];
+        }
+        SwVals[I] = V;
+        SwCases[I] = C;
+        Cnt++;
+    }
+
+    char *Default = Nd->DefaultCase ? Nd->DefaultCase->Label : Nd->BrkLabel;
+    if (!Cnt) {
+        println("  j %s", Default);
+        return;
+    }
+
+    // 分组，使组数最少：Best[I]为从第I个case开始最少的组数，Len[I]为第一组的大小
+    int *Best = calloc(Cnt + 1, sizeof(int));
+    int *Len = calloc(Cnt, sizeof(int));
+    for (int I = Cnt - 1; I >= 0; I--) {
+        Best[I] = Best[I + 1] + 1;
+        Len[I] = 1;
+        for (int J = I + MIN_JUMP_TABLE; J <= Cnt; J++) {
+            if (isDense(I, J) && Best[J] + 1 < Best[I]) {
+                Best[I] = Best[J] + 1;
+                Len[I] = J - I;
+            }
         }
-        // 空表达式
-        case ND_NULL_EXPR:
-            return;
+    }
 
-        default:
-            break;
+    CaseCluster *Cls = calloc(Best[0], sizeof(CaseCluster));
+    int NCls = 0;
+    for (int I = 0; I < Cnt; I += Len[I]) {
+        CaseCluster *C = &Cls[NCls++];
+        C->Begin = I;
+        C->End = I + Len[I];
+        C->Lo = SwVals[I];
+        C->Hi = SwVals[C->End - 1];
     }
 
+    genCaseTree(Cls, 0, NCls - 1, Default);
+    free(Best);
+    free(Len);
+    free(Cls);
+    free(SwVals);
+    free(SwCases);
+}
 
-    // 处理浮点类型
-    if (isFloNum(Nd->LHS->Ty)) {
-        // 递归到最右节点
-        genExpr(Nd->RHS);
-        // 将结果压入栈
-        pushF();
-        // 递归到左节点
-        genExpr(Nd->LHS);
-        // 将结果弹栈到fa1
-        popF(1);
+//
+// 循环向量化
+//
 
-        // 生成各个二叉树节点
-        // float对应s(single)后缀，double对应d(double)后缀
-        char *Suffix = (Nd->LHS->Ty->Kind == TY_FLOAT) ? "s" : "d";
+// 每个向量寄存器组包含的寄存器数
+#define VEC_LMUL 4
 
+// 当前生成的向量化循环
+static VecLoop *VLoop;
+// 已占用的向量寄存器组数，按栈的方式分配
+static int VDepth;
+
+// 第D个向量寄存器组，v0留给掩码，v1-v3用于归约
+static int vecReg(int D) {
+    return VEC_LMUL * (D + 1);
+}
+
+// 子树中是否有数组元素，没有时是循环中不变的值
+static bool hasElem(Node *Nd) {
+    if (!Nd)
+        return false;
+    if (vecBase(Nd, VLoop->Iv))
+        return true;
+    return hasElem(Nd->LHS) || hasElem(Nd->RHS);
+}
+
+// 二元运算对应的向量指令
+static char *vecOp(Node *Nd) {
+    if (isFloNum(Nd->Ty)) {
         switch (Nd->Kind) {
-            case ND_ADD:
-                println("  fadd.%s fa0, fa0, fa1", Suffix);
-                return;
-            case ND_SUB:
-                println("  fsub.%s fa0, fa0, fa1", Suffix);
-                return;
-            case ND_MUL:
-                println("  fmul.%s fa0, fa0, fa1", Suffix);
-                return;
-            case ND_DIV:
-                println("  fdiv.%s fa0, fa0, fa1", Suffix);
-                return;
-            case ND_EQ:
-                println("  feq.%s a0, fa0, fa1", Suffix);
-                return;
-            case ND_NE:
-                println("  feq.%s a0, fa0, fa1", Suffix);
-                println("  seqz a0, a0");
-                return;
-            case ND_LT:
-                println("  flt.%s a0, fa0, fa1", Suffix);
-                return;
-            case ND_LE:
-                println("  fle.%s a0, fa0, fa1", Suffix);
-                return;
-            default:
-                errorTok(Nd->Tok, "invalid expression");
+            case ND_ADD: return "vfadd";
+            case ND_SUB: return "vfsub";
+            case ND_MUL: return "vfmul";
+            case ND_DIV: return "vfdiv";
+            default: break;
         }
     }
-    // EXPR_STMT
-    // 递归到最右节点
-    genExpr(Nd->RHS);
-    // 将结果 a0 压入栈
-    // rhs sub-tree's answer
-    push();
-    // 递归到左节点
+    switch (Nd->Kind) {
+        case ND_ADD: return "vadd";
+        case ND_SUB: return "vsub";
+        case ND_MUL: return "vmul";
+        case ND_BITAND: return "vand";
+        case ND_BITOR: return "vor";
+        case ND_BITXOR: return "vxor";
+        case ND_SHL: return "vsll";
+        case ND_SHR: {
+            // 被提升过的窄类型，按原类型的符号移位
+            Type *Ty = Nd->LHS->Ty->Size == VLoop->SEW ? Nd->LHS->Ty : Nd->LHS->LHS->Ty;
+            return Ty->IsUnsigned ? "vsrl" : "vsra";
+        }
+        default:
+            error("invalid vector expression");
+    }
+}
+
+// 计算向量表达式，返回结果所在的寄存器组
+// a3为本次处理的元素相对于数组基址的偏移
+static int genVec(Node *Nd) {
+    bool Flo = isFloNum(Nd->Ty);
+    char *Form = Flo ? "vf" : "vx";
+    char *Scalar = Flo ? "fa0" : "a0";
+
+    // 不变的值复制到每个元素
+    if (!hasElem(Nd)) {
+        int V = vecReg(VDepth++);
+        genExpr(Nd);
+        println("  %s.v.%c v%d, %s", Flo ? "vfmv" : "vmv", Flo ? 'f' : 'x', V, Scalar);
+        return V;
+    }
+
+    // 数组元素
+    Node *Base = vecBase(Nd, VLoop->Iv);
+    if (Base) {
+        int V = vecReg(VDepth++);
+        genExpr(Base);
+        println("  add a0, a0, a3");
+        println("  vle%d.v v%d, (a0)", VLoop->SEW * 8, V);
+        return V;
+    }
+
+    switch (Nd->Kind) {
+        // 只有不改变低位的整数转换
+        case ND_CAST:
+            return genVec(Nd->LHS);
+        case ND_NEG: {
+            int V = genVec(Nd->LHS);
+            println("  vrsub.vx v%d, v%d, zero", V, V);
+            return V;
+        }
+        case ND_BITNOT: {
+            int V = genVec(Nd->LHS);
+            println("  vxor.vi v%d, v%d, -1", V, V);
+            return V;
+        }
+        default:
+            break;
+    }
+
+    char *Op = vecOp(Nd);
+    if (hasElem(Nd->LHS) && hasElem(Nd->RHS)) {
+        int A = genVec(Nd->LHS);
+        int B = genVec(Nd->RHS);
+        println("  %s.vv v%d, v%d, v%d", Op, A, A, B);
+        VDepth--;
+        return A;
+    }
+    if (hasElem(Nd->LHS)) {
+        int A = genVec(Nd->LHS);
+        genExpr(Nd->RHS);
+        println("  %s.%s v%d, v%d, %s", Op, Form, A, A, Scalar);
+        return A;
+    }
+    // 标量在左侧，减法改用反向减
+    int B = genVec(Nd->RHS);
     genExpr(Nd->LHS);
-    // 将结果弹栈到a1
-    pop(1);
+    if (Nd->Kind == ND_SUB)
+        Op = Flo ? "vfrsub" : "vrsub";
+    println("  %s.%s v%d, v%d, %s", Op, Form, B, B, Scalar);
+    return B;
+}
 
-    // a0: lhs value. a1: rhs value
-    // 生成各个二叉树节点
-    // ptr and long still use RV64, other data types can use RV32
-    char *Suffix = Nd->LHS->Ty->Kind == TY_LONG || Nd->LHS->Ty->Base? "" : "w";
+// 归约对应的指令，浮点数按顺序累加，结果与原来的循环相同
+// -ffast-math允许重新结合，浮点数改用不要求顺序的归约
+static char *redOp(Node *Nd) {
     switch (Nd->Kind) {
-        case ND_ADD: // + a0=a0+a1
-            println("  add%s a0, a0, a1", Suffix);
-            return;
-        case ND_SUB: // - a0=a0-a1
-            println("  sub%s a0, a0, a1", Suffix);
-            return;
-        case ND_MUL: // * a0=a0*a1
-            println("  mul%s a0, a0, a1", Suffix);
-            return;
-        case ND_DIV: // / a0=a0/a1
-            println("  div%s%s a0, a0, a1", Nd->Ty->IsUnsigned? "u": "", Suffix);
-            return;
-        case ND_MOD: // % a0=a0%a1
-            println("  rem%s%s a0, a0, a1", Nd->Ty->IsUnsigned? "u": "", Suffix);
-            return;
-        case ND_SHL:
-            println("  sll%s a0, a0, a1", Suffix);
-            return;
-        case ND_SHR:
-            if (Nd->Ty->IsUnsigned)
-                println("  srl%s a0, a0, a1", Suffix);
+        case ND_ADD:
+            if (isFloNum(Nd->Ty))
+                return OptFastMath ? "vfredusum" : "vfredosum";
+            return "vredsum";
+        case ND_BITAND: return "vredand";
+        case ND_BITOR: return "vredor";
+        case ND_BITXOR: return "vredxor";
+        default:
+            error("invalid reduction");
+    }
+}
+
+// 生成向量化的循环，此时归纳变量的初值已经设置好
+// 数组可能重叠时跳转到Scalar执行原来的循环，返回是否需要原来的循环
+//
+// 每次处理vl个元素，直到处理完 End - i 个元素：
+// a2为剩余的元素个数，a3为本次处理的元素相对于数组基址的偏移，a4为vl，a6为归纳变量
+// 归约的值保存在v1-v3的第0个元素中，循环结束后写回变量
+static bool genVecLoop(Node *Nd, char *Scalar) {
+    VecLoop *L = VLoop = Nd->Vec;
+    Node *Cond = L->Cond;
+    Type *CmpTy = Cond->LHS->Ty;
+    bool Unsigned = CmpTy->IsUnsigned;
+    int Shift = simpleLog2(L->SEW);
+    char *VType = format("e%d, m%d, ta, ma", L->SEW * 8, VEC_LMUL);
+    Node *Iv = Cond->LHS;
+    while (Iv->Kind == ND_CAST)
+        Iv = Iv->LHS;
+
+    int C = count();
+    println("\n# =====向量化的循环%d============", C);
+    // 元素个数为 End - i，i <= End时再加1，没有元素时直接结束
+    genExpr(Cond->RHS);
+    extendSwitchCond(Cond->RHS);
+    println("  mv a2, a0");
+    genExpr(Cond->LHS);
+    extendSwitchCond(Cond->LHS);
+    if (Cond->Kind == ND_LT)
+        println("  %s a0, a2, %s", Unsigned ? "bgeu" : "bge", Nd->BrkLabel);
+    else
+        println("  %s a2, a0, %s", Unsigned ? "bltu" : "blt", Nd->BrkLabel);
+    println("  sub a2, a2, a0");
+    if (Cond->Kind == ND_LE)
+        println("  addi a2, a2, 1");
+
+    // 两个数组的距离不为0，且小于要访问的字节数时会重叠
+    if (L->Checks) {
+        println("  slli a5, a2, %d", Shift);
+        println("  addi a5, a5, -1");
+        for (VecCheck *Chk = L->Checks; Chk; Chk = Chk->Next) {
+            genExpr(Chk->A);
+            println("  mv a7, a0");
+            genExpr(Chk->B);
+            println("  sub a0, a7, a0");
+            println("  srai t0, a0, 63");
+            println("  xor a0, a0, t0");
+            println("  sub a0, a0, t0");
+            println("  addi a0, a0, -1");
+            println("  bltu a0, a5, %s", Scalar);
+        }
+    }
+
+    genExpr(Iv);
+    println("  mv a6, a0");
+
+    // 归约的初值
+    if (L->NumRed) {
+        println("  vsetvli zero, a2, %s", VType);
+        int R = 1;
+        for (Node *S = L->Stmts; S; S = S->Next) {
+            if (S->Kind == ND_ASSIGN)
+                continue;
+            genExpr(S->LHS);
+            if (isFloNum(S->Ty))
+                println("  vfmv.s.f v%d, fa0", R++);
             else
-                println("  sra%s a0, a0, a1", Suffix);
-            return;
-        case ND_NE:
+                println("  vmv.s.x v%d, a0", R++);
+        }
+    }
+
+    println(".L.vec.%d:", C);
+    println("  vsetvli a4, a2, %s", VType);
+    println("  slli a3, a6, %d", Shift);
+    int R = 1;
+    for (Node *S = L->Stmts; S; S = S->Next) {
+        // a[i] = E
+        if (S->Kind == ND_ASSIGN) {
+            int V = genVec(S->RHS);
+            genExpr(vecBase(S->LHS, L->Iv));
+            println("  add a0, a0, a3");
+            println("  vse%d.v v%d, (a0)", L->SEW * 8, V);
+            VDepth--;
+            continue;
+        }
+        // s op= E
+        int V = genVec(S->RHS);
+        println("  %s.vs v%d, v%d, v%d", redOp(S), R, V, R);
+        R++;
+        VDepth--;
+    }
+    println("  add a6, a6, a4");
+    println("  sub a2, a2, a4");
+    println("  bnez a2, .L.vec.%d", C);
+
+    // 写回归纳变量和归约的值
+    genAddr(Iv);
+    println("  %s a6, 0(a0)", storeInsn(Iv->Ty->Size));
+    R = 1;
+    for (Node *S = L->Stmts; S; S = S->Next) {
+        if (S->Kind == ND_ASSIGN)
+            continue;
+        if (isFloNum(S->Ty)) {
+            println("  vfmv.f.s fa0, v%d", R++);
+            genAddr(S->LHS);
+            println("  %s fa0, 0(a0)", S->Ty->Size == 4 ? "fsw" : "fsd");
+        } else {
+            println("  vmv.x.s a5, v%d", R++);
+            genAddr(S->LHS);
+            println("  %s a5, 0(a0)", storeInsn(S->Ty->Size));
+        }
+    }
+
+    if (!L->Checks)
+        return false;
+    println("  j %s", Nd->BrkLabel);
+    return true;
+}
+
+// 是否含有语句表达式
+static bool hasStmtExpr(Node *Nd) {
+    if (!Nd)
+        return false;
+    if (Nd->Kind == ND_STMT_EXPR)
+        return true;
+    if (hasStmtExpr(Nd->LHS) || hasStmtExpr(Nd->RHS) || hasStmtExpr(Nd->Cond) ||
+        hasStmtExpr(Nd->Then) || hasStmtExpr(Nd->Els))
+        return true;
+    for (Node *Arg = Nd->Args; Arg; Arg = Arg->Next)
+        if (hasStmtExpr(Arg))
+            return true;
+    return false;
+}
+
+//
+// 静态分支预测
+//
+
+// 当前所在循环的break标签，用来识别退出循环的分支
+static char *LoopBrk;
+
+// 是否调用了不返回的函数
+static bool isNoreturnCall(Node *Nd) {
+    while (Nd->Kind == ND_CAST)
+        Nd = Nd->LHS;
+    if (Nd->Kind != ND_FUNCALL || !isDirectCall(Nd))
+        return false;
+    Obj *Fn = Nd->LHS->Var;
+    return Fn->IsNoreturn || !strcmp(Fn->Name, "exit") || !strcmp(Fn->Name, "abort") ||
+           !strcmp(Fn->Name, "_Exit") || !strcmp(Fn->Name, "_exit");
+}
+
+// 语句块中最后执行的语句
+static Node *lastStmt(Node *Nd) {
+    while (Nd && Nd->Kind == ND_BLOCK) {
+        Node *N = Nd->Body;
+        while (N && N->Next)
+            N = N->Next;
+        Nd = N;
+    }
+    return Nd;
+}
+
+// 很少执行的分支：以不返回的调用结束(错误处理)，
+// 或者在循环中以break或return结束(循环通常会继续)
+static bool isColdStmt(Node *Nd) {
+    Nd = lastStmt(Nd);
+    if (!Nd)
+        return false;
+    if (Nd->Kind == ND_EXPR_STMT)
+        return isNoreturnCall(Nd->LHS);
+    if (!LoopBrk)
+        return false;
+    return Nd->Kind == ND_RETURN || (Nd->Kind == ND_GOTO && !strcmp(Nd->UniqueLabel, LoopBrk));
+}
+
+// __builtin_expect给出的提示
+static int expectHint(Node *Nd) {
+    if (Nd->Expect)
+        return Nd->Expect;
+    if (Nd->Kind == ND_NOT)
+        return -expectHint(Nd->LHS);
+    if (Nd->Kind == ND_CAST)
+        return expectHint(Nd->LHS);
+    return 0;
+}
+
+// 指针通常不为空
+static int nullHint(Node *Nd) {
+    switch (Nd->Kind) {
+        case ND_NOT:
+            return -nullHint(Nd->LHS);
         case ND_EQ:
-            if (Nd->LHS->Ty->IsUnsigned && Nd->LHS->Ty->Kind == TY_INT) {
-                println("  # 左部是U32类型，需要截断");
-                println("slli a0, a0, 32");
-                println("srli a0, a0, 32");
-            };
-            if (Nd->RHS->Ty->IsUnsigned && Nd->RHS->Ty->Kind == TY_INT) {
-                println("  # 右部是U32类型，需要截断");
-                println("slli a1, a1, 32");
-                println("srli a1, a1, 32");
-            };
-            println("  xor a0, a0, a1");
-        if(Nd->Kind ==  ND_EQ)
-            // if a0 == a1, then a0 ^ a1 should be 0
-            println("  seqz a0, a0");
-        else
-            // if a0 != a1, then a0 ^ a1 should not be 0
-            println("  snez a0, a0");
-            return;
-        case ND_LE: // a0 <= a1
-            // a0 <= a1 -> !(a0 > a1)
-            // note: '!' here means 0 -> 1, 1-> 0. 
-            // which is different from the 'neg' inst
-            println("  slt%s a0, a1, a0", Nd->LHS->Ty->IsUnsigned? "u": "");
-            println("  xori a0, a0, 1");
-            return;
-        case ND_LT: // a0 < a1
-            println("  slt%s a0, a0, a1", Nd->LHS->Ty->IsUnsigned? "u": "");
-            return;
-        case ND_BITAND: // & a0=a0&a1
-            println("  and a0, a0, a1");
-            return;
-        case ND_BITOR: // | a0=a0|a1
-            println("  or a0, a0, a1");
-            return;
-        case ND_BITXOR: // ^ a0=a0^a1
-            println("  xor a0, a0, a1");
-            return;
+        case ND_NE: {
+            Node *P = isZeroConst(Nd->RHS) ? Nd->LHS : isZeroConst(Nd->LHS) ? Nd->RHS : NULL;
+            if (!P || P->Ty->Kind != TY_PTR)
+                return 0;
+            return Nd->Kind == ND_EQ ? -1 : 1;
+        }
         default:
-            break;
+            return Nd->Ty->Kind == TY_PTR ? 1 : 0;
+    }
+}
+
+// 预测if的条件：1为很可能为真，-1为很可能为假，0为不确定
+static int ifHint(Node *Nd) {
+    int H = expectHint(Nd->Cond);
+    if (H)
+        return H;
+    bool ThenCold = isColdStmt(Nd->Then);
+    bool ElsCold = Nd->Els && isColdStmt(Nd->Els);
+    if (ThenCold != ElsCold)
+        return ThenCold ? -1 : 1;
+    return nullHint(Nd->Cond);
+}
+
+// 只是一个跳转的语句，返回跳转的目标
+static char *jumpTarget(Node *Nd) {
+    while (Nd->Kind == ND_BLOCK && Nd->Body && !Nd->Body->Next)
+        Nd = Nd->Body;
+    return Nd->Kind == ND_GOTO ? Nd->UniqueLabel : NULL;
+}
+
+//
+// 冷代码块
+//
+
+// 很少执行的代码块的范围[ColdBegin, ColdEnd)，函数结束时移到末尾
+// 代码块留在原处时也是正确的：之前的代码跳过它，它执行完后跳回
+static int *ColdBegin, *ColdEnd;
+static int NumCold, CapCold;
+// 正在生成冷代码块，其中的代码块不再单独移动
+static bool InCold;
+
+// 生成很少执行的代码块Nd，以Label开始，执行完后跳转到Ret
+static void genColdBlock(Node *Nd, char *Label, char *Ret) {
+    int Begin = lineMark();
+    InCold = true;
+    println("%s:", Label);
+    genStmt(Nd);
+    // 以跳转或不返回的调用结束时不需要跳回
+    Node *Last = lastStmt(Nd);
+    if (!Last || !(Last->Kind == ND_GOTO || Last->Kind == ND_RETURN ||
+                   (Last->Kind == ND_EXPR_STMT && isNoreturnCall(Last->LHS))))
+        println("  j %s", Ret);
+    InCold = false;
+
+    if (NumCold == CapCold) {
+        CapCold = CapCold ? CapCold * 2 : 8;
+        ColdBegin = realloc(ColdBegin, sizeof(int) * CapCold);
+        ColdEnd = realloc(ColdEnd, sizeof(int) * CapCold);
     }
+    ColdBegin[NumCold] = Begin;
+    ColdEnd[NumCold++] = lineMark();
+}
 
-    error("%s: invalid expression", Nd -> Tok -> Loc);
+// 将冷代码块移到函数末尾，Shift为之后插入到它们之前的行数
+// 函数从第Begin行开始，较大时分支可能跳不到末尾(±4KiB)，冷代码块留在原处
+static void moveColdBlocks(int Begin, int Shift) {
+    if (codeSize(Begin) < 4096)
+        for (int I = NumCold - 1; I >= 0; I--)
+            moveLines(ColdBegin[I] + Shift, ColdEnd[I] + Shift);
+    NumCold = 0;
+}
+
+//
+// 条件选择
+//
+
+// 条件选择的每一侧允许的最大开销，两侧都会被求值
+#define SELECT_ARM_COST 3
+
+// 没有副作用、不会访问非法地址的简单整数表达式的开销(大致的指令数)
+// 不能用于条件选择时返回-1
+static int armCost(Node *Nd) {
+    if (!isInteger(Nd->Ty) && Nd->Ty->Kind != TY_PTR)
+        return -1;
+    switch (Nd->Kind) {
+        case ND_NUM:
+            return 1;
+        // 全局变量需要先计算地址
+        case ND_VAR:
+            return Nd->Var->IsLocal ? 1 : 2;
+        case ND_NEG:
+        case ND_BITNOT:
+        case ND_CAST: {
+            int L = armCost(Nd->LHS);
+            return L < 0 ? -1 : L + 1;
+        }
+        case ND_ADD:
+        case ND_SUB:
+        case ND_MUL:
+        case ND_BITAND:
+        case ND_BITOR:
+        case ND_BITXOR:
+        case ND_SHL:
+        case ND_SHR: {
+            int L = armCost(Nd->LHS);
+            int R = armCost(Nd->RHS);
+            return L < 0 || R < 0 ? -1 : L + R + 1;
+        }
+        default:
+            return -1;
+    }
+}
+
+// Cond ? Then : Els能否生成为不含分支的代码
+// 有__builtin_expect提示时分支容易预测，保留分支
+static bool canSelect(Node *Cond, Node *Then, Node *Els) {
+    if (!OptLevel || expectHint(Cond))
+        return false;
+    if (!isInteger(Cond->Ty) && Cond->Ty->Kind != TY_PTR)
+        return false;
+    int T = armCost(Then);
+    int E = armCost(Els);
+    return T >= 0 && E >= 0 && T <= SELECT_ARM_COST && E <= SELECT_ARM_COST;
+}
+
+// 值一定为0或1
+static bool isBoolExpr(Node *Nd) {
+    switch (Nd->Kind) {
+        case ND_EQ:
+        case ND_NE:
+        case ND_LT:
+        case ND_LE:
+        case ND_NOT:
+        case ND_LOGAND:
+        case ND_LOGOR:
+            return true;
+        default:
+            return Nd->Ty->Kind == TY_BOOL;
+    }
+}
+
+// 绝对值，有Zbb时使用max
+//      x < 0 ? -x : x  =>  srai t0, x, 63; xor a0, x, t0; sub a0, a0, t0
+static bool genAbs(Node *Nd) {
+    Node *Cond = Nd->Cond;
+    if ((Cond->Kind != ND_LT && Cond->Kind != ND_LE) || Nd->Ty->IsUnsigned ||
+        !isInteger(Nd->Ty) || Nd->Ty->Size < 4)
+        return false;
+
+    Node *X, *Pos, *Neg;
+    if (isZeroConst(Cond->RHS)) {
+        // x < 0 ? -x : x
+        X = Cond->LHS;
+        Neg = Nd->Then;
+        Pos = Nd->Els;
+    } else if (isZeroConst(Cond->LHS)) {
+        // 0 < x ? x : -x
+        X = Cond->RHS;
+        Pos = Nd->Then;
+        Neg = Nd->Els;
+    } else {
+        return false;
+    }
+    if (Neg->Kind != ND_NEG || !sameLeaf(Neg->LHS, X) || !sameLeaf(Pos, X) ||
+        X->Ty->Size != Nd->Ty->Size)
+        return false;
+
+    char *W = Nd->Ty->Size == 8 ? "" : "w";
+    genExpr(X);
+    if (ExtZbb) {
+        println("  neg%s t0, a0", W);
+        println("  max a0, a0, t0");
+    } else {
+        println("  srai t0, a0, 63");
+        println("  xor a0, a0, t0");
+        println("  sub%s a0, a0, t0", W);
+    }
+    return true;
+}
+
+// Zbb的最小、最大值，无符号数使用minu/maxu
+//      a < b ? a : b => min     a < b ? b : a => max
+static bool genMinMax(Node *Nd) {
+    Node *Cond = Nd->Cond;
+    if ((Cond->Kind != ND_LT && Cond->Kind != ND_LE) || !isInteger(Cond->LHS->Ty) ||
+        Cond->LHS->Ty->Size != Nd->Ty->Size)
+        return false;
+
+    char *Insn;
+    if (sameLeaf(Nd->Then, Cond->LHS) && sameLeaf(Nd->Els, Cond->RHS))
+        Insn = "min";
+    else if (sameLeaf(Nd->Then, Cond->RHS) && sameLeaf(Nd->Els, Cond->LHS))
+        Insn = "max";
+    else
+        return false;
+
+    char *L, *R;
+    genOperands(Cond, &L, &R);
+    println("  %s%s a0, %s, %s", Insn, Cond->LHS->Ty->IsUnsigned ? "u" : "", L, R);
+    return true;
+}
+
+// 不用分支计算Cond ? Then : Els，两侧都会被求值
+// 有Zicond时用czero清除未选中的一侧，否则由条件得到全0或全1的掩码：
+//      Els ^ ((Then ^ Els) & -Cond)
+static bool genSelect(Node *Nd) {
+    if (!canSelect(Nd->Cond, Nd->Then, Nd->Els))
+        return false;
+    if (genAbs(Nd) || (ExtZbb && genMinMax(Nd)))
+        return true;
+
+    // 一侧为0时只需要清除另一侧
+    bool ThenZero = isZeroConst(Nd->Then);
+    bool ElsZero = !ThenZero && isZeroConst(Nd->Els);
+    Node *Ops[] = {Nd->Cond, ThenZero ? Nd->Els : Nd->Then, Nd->Els};
+    char *Regs[3];
+    // 条件先求值，其中定义的CSE临时变量可能在两侧使用
+    genOperandList(Ops, ThenZero || ElsZero ? 2 : 3, Regs, true);
+    char *C = Regs[0];
+
+    if (ExtZicond) {
+        if (ThenZero) {
+            println("  czero.nez a0, %s, %s", Regs[1], C);
+        } else if (ElsZero) {
+            println("  czero.eqz a0, %s, %s", Regs[1], C);
+        } else {
+            println("  czero.eqz t0, %s, %s", Regs[1], C);
+            println("  czero.nez a0, %s, %s", Regs[2], C);
+            println("  or a0, a0, t0");
+        }
+        return true;
+    }
+
+    // Then为0时，t0在条件不成立时全为1
+    if (ThenZero) {
+        if (isBoolExpr(Nd->Cond)) {
+            println("  addi t0, %s, -1", C);
+        } else {
+            println("  seqz t0, %s", C);
+            println("  neg t0, t0");
+        }
+        println("  and a0, %s, t0", Regs[1]);
+        return true;
+    }
+
+    // t0在条件成立时全为1
+    if (isBoolExpr(Nd->Cond)) {
+        println("  neg t0, %s", C);
+    } else {
+        println("  snez t0, %s", C);
+        println("  neg t0, t0");
+    }
+    if (ElsZero) {
+        println("  and a0, %s, t0", Regs[1]);
+        return true;
+    }
+    println("  xor t1, %s, %s", Regs[1], Regs[2]);
+    println("  and t1, t1, t0");
+    println("  xor a0, %s, t1", Regs[2]);
+    return true;
+}
+
+// 只有一个对未取过地址的整型局部变量赋值的语句时，返回该赋值
+static Node *singleAssign(Node *Nd) {
+    while (Nd->Kind == ND_BLOCK && Nd->Body && !Nd->Body->Next)
+        Nd = Nd->Body;
+    if (Nd->Kind != ND_EXPR_STMT || Nd->LHS->Kind != ND_ASSIGN)
+        return NULL;
+    Node *A = Nd->LHS;
+    Obj *Var = A->LHS->Kind == ND_VAR ? A->LHS->Var : NULL;
+    if (!Var || !Var->IsLocal || Var->IsAddrTaken ||
+        (!isInteger(A->Ty) && A->Ty->Kind != TY_PTR))
+        return NULL;
+    return A;
+}
+
+// 只给同一个变量赋值的if语句改为条件选择
+//      if (c) x = a; else x = b;  =>  x = c ? a : b
+//      if (c) x = a;              =>  x = c ? a : x
+static bool genSelectAssign(Node *Nd) {
+    Node *A = singleAssign(Nd->Then);
+    if (!A)
+        return false;
+    Node *B = Nd->Els ? singleAssign(Nd->Els) : NULL;
+    if (Nd->Els && (!B || B->LHS->Var != A->LHS->Var))
+        return false;
+    Node *Els = B ? B->RHS : A->LHS;
+    if (!canSelect(Nd->Cond, A->RHS, Els))
+        return false;
+
+    Node Sel = *A;
+    Sel.Kind = ND_COND;
+    Sel.Cond = Nd->Cond;
+    Sel.Then = A->RHS;
+    Sel.Els = Els;
+    Sel.LHS = Sel.RHS = NULL;
+    Sel.RegNeed = 0;
+    Node Assign = *A;
+    Assign.RHS = &Sel;
+    Assign.RegNeed = 0;
+    genExpr(&Assign);
+    return true;
 }
 
 // 生成语句
@@ -968,12 +4526,25 @@ static void genStmt(Node *Nd) {
             // node of type EXPR_STMT is unary
             genExpr(Nd->LHS);
             return;
-        case ND_RETURN:
-            genExpr(Nd->LHS);
+        case ND_RETURN: {
+            Node *Call = CanTailCall ? tailCall(Nd->LHS) : NULL;
+            if (Call) {
+                genTailCall(Call);
+                return;
+            }
+            if (Nd->LHS && passByRef(Nd->LHS->Ty)) {
+                genRetStruct(Nd->LHS);
+            } else {
+                genExpr(Nd->LHS);
+                // 结构体的各部分读入a0,a1(fa0,fa1)
+                if (Nd->LHS && isStructOrUnion(Nd->LHS->Ty))
+                    loadRetStruct(Nd->LHS->Ty);
+            }
             // 无条件跳转语句，跳转到.L.return.%s段
             // j offset是 jal x0, offset的别名指令
             println("  j .L.return.%s", CurrentFn->Name);
             return;
+        }
         // 生成if语句
         case ND_IF: {
             /*
@@ -986,13 +4557,34 @@ static void genStmt(Node *Nd) {
                 ...
             .L.end.%d:
             */
+            // 只是给同一个变量赋值时不使用分支
+            if (genSelectAssign(Nd))
+                return;
             // 代码段计数
             int C = count();
+            // 只有一侧且只是跳转时，条件直接跳转到目标
+            char *Target = OptLevel && !Nd->Els ? jumpTarget(Nd->Then) : NULL;
+            if (Target) {
+                genBranch(Nd->Cond, true, Target);
+                return;
+            }
+            // 很少执行的一侧移到函数末尾，另一侧顺序执行
+            int Hint = OptLevel && !InCold ? ifHint(Nd) : 0;
+            if (Hint < 0 || (Hint > 0 && Nd->Els)) {
+                char *Cold = format(".L.cold.%d", C);
+                char *End = format(".L.end.%d", C);
+                genBranch(Nd->Cond, Hint < 0, Cold);
+                Node *Hot = Hint < 0 ? Nd->Els : Nd->Then;
+                if (Hot)
+                    genStmt(Hot);
+                println("  j %s", End);
+                genColdBlock(Hint < 0 ? Nd->Then : Nd->Els, Cold, End);
+                println("%s:", End);
+                return;
+            }
             // 生成条件内语句
-            genExpr(Nd->Cond);
-            notZero(Nd->Cond->Ty);
             // 判断结果是否为0，为0(false)则跳转到else标签
-            println("  beqz a0, .L.else.%d", C);
+            genBranch(Nd->Cond, false, format(".L.else.%d", C));
             // 生成符合条件后的语句
             genStmt(Nd->Then);
             // 执行完后跳转到if语句后面的语句
@@ -1022,6 +4614,18 @@ static void genStmt(Node *Nd) {
     we will insert an cond and branch.
     this works as the init cond check.
     if not satisfied, we will bot enter the loop body
+
+    -O1起将循环转为 if (cond) do body while (cond) 的形式，
+    每次迭代只在末尾有一个条件跳转：
+            ... (init)
+            ... (cond)
+           (beqz a0, .L.end.%d)-------+     // 入口判断一次
+    +-->.L.begin.%d:                  |
+    |       ... (body)                |
+    |       ... (inc)                 |
+    |       ... (cond)                |
+    +------(bnez a0, .L.begin.%d)     |
+        .L.end.%d:  <-----------------+
         */
         case ND_FOR: {
             // 代码段计数
@@ -1030,18 +4634,28 @@ static void genStmt(Node *Nd) {
             if(Nd->Init){
                 genStmt(Nd->Init);
             }
+            // 向量化的循环，数组可能重叠时执行下面原来的循环
+            if (Nd->Vec && !genVecLoop(Nd, format(".L.begin.%d", C))) {
+                println("%s:", Nd->BrkLabel);
+                return;
+            }
+            // 条件中的语句表达式可能有标签，不能复制，此时不转换
+            bool Rotate = OptLevel && Nd->Cond && !hasStmtExpr(Nd->Cond);
+            if (Rotate)
+                genBranch(Nd->Cond, false, Nd->BrkLabel);
             // 输出循环头部标签
             println(".L.begin.%d:", C);
             // 处理循环条件语句
-            if (Nd->Cond) {
+            if (Nd->Cond && !Rotate) {
                 // 生成条件循环语句
-                genExpr(Nd->Cond);
-                notZero(Nd->Cond->Ty);
                 // 判断结果是否为0，为0则跳转到结束部分
-                println("  beqz a0, %s", Nd->BrkLabel);
+                genBranch(Nd->Cond, false, Nd->BrkLabel);
             }
             // 生成循环体语句
+            char *OldBrk = LoopBrk;
+            LoopBrk = Nd->BrkLabel;
             genStmt(Nd->Then);
+            LoopBrk = OldBrk;
             // continue标签语句
             println("%s:", Nd->ContLabel);
             // 处理循环递增语句
@@ -1050,8 +4664,11 @@ static void genStmt(Node *Nd) {
                 // 生成循环递增语句
                 genExpr(Nd->Inc);
             }
-            // 跳转到循环头部
-            println("  j .L.begin.%d", C);
+            // 条件成立时回到循环头部
+            if (Rotate)
+                genBranch(Nd->Cond, true, format(".L.begin.%d", C));
+            else
+                println("  j .L.begin.%d", C);
             // 输出循环尾部标签
             println("%s:", Nd->BrkLabel);
             return;
@@ -1067,13 +4684,14 @@ static void genStmt(Node *Nd) {
             println(".L.begin.%d:", C);
 
             println("\n# Then语句%d", C);
+            char *OldBrk = LoopBrk;
+            LoopBrk = Nd->BrkLabel;
             genStmt(Nd->Then);
+            LoopBrk = OldBrk;
 
             println("\n# Cond语句%d", C);
             println("%s:", Nd->ContLabel);
-            genExpr(Nd->Cond);
-            notZero(Nd->Cond->Ty);
-            println("  bnez a0, .L.begin.%d", C);
+            genBranch(Nd->Cond, true, format(".L.begin.%d", C));
 
             println("%s:", Nd->BrkLabel);
             return;
@@ -1087,20 +4705,25 @@ static void genStmt(Node *Nd) {
         case ND_SWITCH:
             println("\n# =====switch语句===============");
             genExpr(Nd->Cond);
+            extendSwitchCond(Nd->Cond);
 
-            println("  # 遍历跳转到值等于a0的case标签");
-            for (Node *N = Nd->CaseNext; N; N = N->CaseNext) {
-                println("  li t0, %ld", N->Val);
-                println("  beq a0, t0, %s", N->Label);
-            }
+            if (OptLevel) {
+                genSwitchDispatch(Nd);
+            } else {
+                println("  # 遍历跳转到值等于a0的case标签");
+                for (Node *N = Nd->CaseNext; N; N = N->CaseNext) {
+                    println("  li t0, %ld", caseVal(Nd->Cond->Ty, N->Val));
+                    println("  beq a0, t0, %s", N->Label);
+                }
 
-            if (Nd->DefaultCase) {
-                println("  # 跳转到default标签");
-                println("  j %s", Nd->DefaultCase->Label);
-            }
+                if (Nd->DefaultCase) {
+                    println("  # 跳转到default标签");
+                    println("  j %s", Nd->DefaultCase->Label);
+                }
 
-            println("  # 结束switch，跳转break标签");
-            println("  j %s", Nd->BrkLabel);
+                println("  # 结束switch，跳转break标签");
+                println("  j %s", Nd->BrkLabel);
+            }
             // 生成case标签的语句
             genStmt(Nd->Then);
             println("# switch的break标签，结束switch");
@@ -1128,20 +4751,36 @@ static void genStmt(Node *Nd) {
     //           表达式计算
     //-------------------------------//
 
+// .L开头的是字符串字面量等匿名变量，只在汇编文件内可见，不放入符号表
+static bool isAsmLocal(char *Name) {
+    return !strncmp(Name, ".L", 2);
+}
+
+// 切换段之后输出变量的对齐、类型和大小
+static void symbolHeader(Obj *Var) {
+    println("  .align %d", simpleLog2(Var->Align));
+    if (isAsmLocal(Var->Name))
+        return;
+    println("  .type %s, @object", Var->Name);
+    println("  .size %s, %d", Var->Name, Var->Ty->Size);
+}
+
 static void emitData(Obj *Prog) {
     for (Obj *Var = Prog; Var; Var = Var->Next) {
         if (Var->Ty->Kind == TY_FUNC || !Var->IsDefinition)
             continue;
 
-        char *visibility = Var->IsStatic? ".local": ".global";
-        println("  %s %s", visibility, Var->Name);
+        if (!isAsmLocal(Var->Name)) {
+            char *visibility = Var->IsStatic? ".local": ".global";
+            println("  %s %s", visibility, Var->Name);
+        }
 
         if (!Var->Align)
             error("Align can not be 0!");
-        println("  .align %d", simpleLog2(Var->Align));
 
         if (Var -> InitData){
             println("  .data");
+            symbolHeader(Var);
             println("%s:", Var->Name);
             Relocation *Rel = Var->Rel;
             int Pos = 0;
@@ -1170,6 +4809,7 @@ static void emitData(Obj *Prog) {
             // bss段未给数据分配空间，只记录数据所需空间的大小
             println("  # 未初始化的全局变量");
             println("  .bss");
+            symbolHeader(Var);
             println("%s:", Var->Name);
             println("  # 全局变量零填充%d位", Var->Ty->Size);
             println("  .zero %d", Var->Ty->Size);
@@ -1184,7 +4824,8 @@ void emitText(Obj *Prog) {
     // 为每个函数单独生成代码
     for (Obj *Fn = Prog; Fn; Fn = Fn->Next) {
         // not a function, or just a function defination without body.
-        if (!Fn->Body)
+        // 内联后不再被引用的static函数也不需要输出
+        if (!Fn->Body || !Fn->IsDefinition)
             continue;
 
         if (Fn->IsStatic)
@@ -1193,74 +4834,89 @@ void emitText(Obj *Prog) {
             println("  .globl %s", Fn->Name);
 
         println("  .text");
+        println("  .type %s, @function", Fn->Name);
         println("# =====%s段开始===============", Fn->Name);
         println("%s:", Fn->Name);
         CurrentFn = Fn;
 
-        // Prologue, 前言
-        // 将ra寄存器压栈,保存ra的值
-        println("  addi sp, sp, -16");
-        println("  sd ra, 8(sp)");
-        // 将fp压入栈中，保存fp的值
-        println("  sd fp, 0(sp)");
-        // 将sp写入fp
-        println("  mv fp, sp");
-
-        // 偏移量为实际变量所用的栈大小
-        if(isLegalImmI(Fn->StackSize))
-            println("  addi sp, sp, -%d", Fn->StackSize);
-        else{
-            println("  li t0, -%d", Fn->StackSize);
-        println("  add sp, sp, t0");
-    }
-    // map (actual params) -> (formal params)
-    // this needs to be done before entering the fn body
-    // then in the fn body we can use its formal params
-    // in stack as if they were passed from outside
+        OmitFP = OptOmitFP;
+        IsLeaf = OmitFP && !callsFunc(Fn->Body);
+        FrameReg = OmitFP ? "sp" : "fp";
+        FrameBias = OmitFP ? Fn->StackSize : 0;
+        ExprBase = Fn->StackSize + (IsLeaf ? 0 : 16);
+        MaxDepth = 0;
+        HasTailExit = false;
+        NumTailCallees = 0;
+        // 省略帧指针时，前言在函数体之后生成，再移动到这里
+        int PrologueAt = lineMark();
 
-    // 记录整型寄存器，浮点寄存器使用的数量
-    int GP = 0, FP = 0;
-    for (Obj *Var = Fn->Params; Var; Var = Var->Next) {
-        if (isFloNum(Var->Ty)) {
-            // 正常传递的浮点形参
-            if (FP < 8)
-                storeFloat(FP++, Var->Offset, Var->Ty->Size);
-            else
-                storeGeneral(GP++, Var->Offset, Var->Ty->Size);
-        }
-        else
-            // 正常传递的整型形参
-            storeGeneral(GP++, Var->Offset, Var->Ty->Size);
-        }
+        if (!OmitFP) {
+            // Prologue, 前言
+            // 将ra寄存器压栈,保存ra的值
+            println("  addi sp, sp, -16");
+            println("  sd ra, 8(sp)");
+            // 将fp压入栈中，保存fp的值
+            println("  sd fp, 0(sp)");
+            // 将sp写入fp
+            println("  mv fp, sp");
 
-        // 可变参数
-        if (Fn->VaArea) {
-            // 可变参数存入__va_area__，注意最多为7个
-            int Offset = Fn->VaArea->Offset;
-            while (GP < 8) {
-                storeGeneral(GP++, Offset, 8);
-                Offset += 8;
+            // 偏移量为实际变量所用的栈大小
+            if(isLegalImmI(Fn->StackSize))
+                println("  addi sp, sp, -%d", Fn->StackSize);
+            else{
+                println("  li t0, -%d", Fn->StackSize);
+                println("  add sp, sp, t0");
             }
+            // map (actual params) -> (formal params)
+            // this needs to be done before entering the fn body
+            // then in the fn body we can use its formal params
+            // in stack as if they were passed from outside
+            storeParams(Fn);
         }
 
         // 生成语句链表的代码
         println("# =====%s段主体===============", Fn->Name);
+        // 尾递归跳转到这里
+        if (OptLevel)
+            println(".L.body.%s:", Fn->Name);
+        CanTailCall = OptLevel && noEscape(Fn);
         genStmt(Fn->Body);
         Assert(Depth == 0, "depth = %d", Depth);
 
+        // 前言移到函数开头后，冷代码块的位置要加上前言的行数
+        int Shift = 0;
+        if (OmitFP) {
+            int Mark = lineMark();
+            // 一次分配整个栈帧，叶函数没有局部变量时什么都不用做
+            if (frameSize())
+                adjustSP(-frameSize());
+            if (!IsLeaf)
+                raSlot("sd");
+            storeParams(Fn);
+            Shift = lineMark() - Mark;
+            moveLines(PrologueAt, Mark);
+        }
+
         // Epilogue，后语
         // 输出return段标签
         println("# =====%s段结束===============", Fn->Name);
         println(".L.return.%s:", Fn->Name);
-        // 将fp的值改写回sp
-        println("  mv sp, fp");
-        // 将最早fp保存的值弹栈，恢复fp。
-        println("  ld fp, 0(sp)");
-        // 将ra寄存器弹栈,恢复ra的值
-        println("  ld ra, 8(sp)");
-        println("  addi sp, sp, 16");
+        restoreFrame();
         // 返回
         println("  ret");
+        if (HasTailExit) {
+            println(".L.tail.%s:", Fn->Name);
+            restoreFrame();
+            println("  jr t5");
+        }
+        for (int I = 0; I < NumTailCallees; I++) {
+            println(".L.tail.%s.%d:", Fn->Name, I);
+            restoreFrame();
+            println("  tail %s", TailCallees[I]);
+        }
+        moveColdBlocks(PrologueAt, Shift);
+        println("  .size %s, .-%s", Fn->Name, Fn->Name);
+        flushLines(OutputFile);
     }
 }
 
@@ -1271,6 +4927,10 @@ void codegen(Obj * Prog, FILE *Out) {
     assignLVarOffsets(Prog);
     // 生成数据
     emitData(Prog);
+    flushLines(OutputFile);
     // 生成代码
     emitText(Prog);
+    // 生成代码中用到的浮点常量
+    emitFConsts();
+    flushLines(OutputFile);
 }
\ No newline at end of file
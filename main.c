@@ -6,12 +6,81 @@ static char *OptO;
 // 输入文件的路径. default "-"
 static char *InputPath;
 
+// 优化等级. -O0(默认)保持最朴素的栈式代码
+int OptLevel;
+
+// 在标准错误中输出窥孔优化每条规则的命中次数
+bool OptPeepholeStats;
+
+// 省略帧指针：局部变量相对于sp寻址，-O1起默认开启
+bool OptOmitFP;
+// 是否由参数指定了是否省略帧指针
+static bool OmitFPSet;
+
+// 循环向量化：生成RVV指令，-O2起默认开启，需要V扩展
+bool OptVectorize;
+static bool VectorizeSet;
+
+// 浮点乘加融合：生成fmadd等指令，中间结果不舍入，默认关闭
+bool OptFPContract;
+static bool FPContractSet;
+
+// 快速浮点运算：不考虑NaN，允许重新结合和乘以倒数，默认关闭
+bool OptFastMath;
+
+// 目标支持的扩展，由-march指定，默认为基础的rv64gc
+bool ExtZba;
+bool ExtZbb;
+bool ExtZbs;
+bool ExtZicond;
+bool ExtV;
+
 // 输出程序的使用说明
 static void usage(int Status) {
-    fprintf(stderr, "rvcc [ -o <path> ] <file>\n");
+    fprintf(stderr, "rvcc [ -o <path> ] [ -O<n> ] [ -f[no-]omit-frame-pointer ] [ -f[no-]vectorize ] [ -ffp-contract=fast|on|off ] [ -f[no-]fast-math ] [ -march=<isa> ] [ -fpeephole-stats ] <file>\n");
     exit(Status);
 }
 
+// 解析-march的ISA字符串，如rv64gcv_zba_zbb_zbs
+// 只记录会影响代码生成的扩展，其余已知的扩展被忽略
+static void parseMarch(char *Arch) {
+    if (strncmp(Arch, "rv64", 4) || (Arch[4] != 'i' && Arch[4] != 'g'))
+        error("unsupported -march=%s: expected rv64i or rv64g", Arch);
+
+    // 单字母的扩展，版本号被忽略
+    char *P = Arch + 4;
+    for (; *P && *P != '_' && *P != 'z' && *P != 's' && *P != 'x'; P++) {
+        if (isdigit(*P) || (*P == 'p' && isdigit(P[-1])))
+            continue;
+        if (*P == 'v')
+            ExtV = true;
+        else if (*P == 'b')
+            ExtZba = ExtZbb = ExtZbs = true;
+        else if (!strchr("imafdgcq", *P))
+            error("unsupported -march=%s: unknown extension '%c'", Arch, *P);
+    }
+
+    // 多字母的扩展，以_分隔
+    while (*P) {
+        if (*P == '_') {
+            P++;
+            continue;
+        }
+        int Len = strcspn(P, "_");
+        if (Len == 3 && !strncmp(P, "zba", 3))
+            ExtZba = true;
+        else if (Len == 3 && !strncmp(P, "zbb", 3))
+            ExtZbb = true;
+        else if (Len == 3 && !strncmp(P, "zbs", 3))
+            ExtZbs = true;
+        else if (Len == 6 && !strncmp(P, "zicond", 6))
+            ExtZicond = true;
+        else if (*P != 'z' && *P != 's' && *P != 'x')
+            error("unsupported -march=%s: unknown extension '%.*s'", Arch, Len, P);
+        P += Len;
+    }
+}
+
 // 解析传入程序的参数
 static void parseArgs(int Argc, char **Argv) {
     // 遍历所有传入程序的参数
@@ -37,6 +106,50 @@ static void parseArgs(int Argc, char **Argv) {
             continue;
         }
 
+        // 解析-O<n>的参数, 单独的-O等价于-O1
+        if (!strncmp(Argv[I], "-O", 2)) {
+            OptLevel = Argv[I][2] ? atoi(Argv[I] + 2) : 1;
+            continue;
+        }
+
+        if (!strcmp(Argv[I], "-fomit-frame-pointer") ||
+            !strcmp(Argv[I], "-fno-omit-frame-pointer")) {
+            OptOmitFP = Argv[I][2] != 'n';
+            OmitFPSet = true;
+            continue;
+        }
+
+        if (!strcmp(Argv[I], "-fvectorize") || !strcmp(Argv[I], "-fno-vectorize")) {
+            OptVectorize = Argv[I][2] != 'n';
+            VectorizeSet = true;
+            continue;
+        }
+
+        // on时允许在表达式内融合，与fast相同
+        if (!strncmp(Argv[I], "-ffp-contract=", 14)) {
+            char *Mode = Argv[I] + 14;
+            if (strcmp(Mode, "fast") && strcmp(Mode, "on") && strcmp(Mode, "off"))
+                error("unsupported %s: expected fast, on or off", Argv[I]);
+            OptFPContract = strcmp(Mode, "off");
+            FPContractSet = true;
+            continue;
+        }
+
+        if (!strcmp(Argv[I], "-ffast-math") || !strcmp(Argv[I], "-fno-fast-math")) {
+            OptFastMath = Argv[I][2] != 'n';
+            continue;
+        }
+
+        if (!strncmp(Argv[I], "-march=", 7)) {
+            parseMarch(Argv[I] + 7);
+            continue;
+        }
+
+        if (!strcmp(Argv[I], "-fpeephole-stats")) {
+            OptPeepholeStats = true;
+            continue;
+        }
+
         // 解析为-的参数
         if (Argv[I][0] == '-' && Argv[I][1] != '\0')
             error("unknown argument: %s", Argv[I]);
@@ -48,6 +161,15 @@ static void parseArgs(int Argc, char **Argv) {
     // 不存在输入文件时报错
     if (!InputPath)
         error("no input files");
+
+    if (!OmitFPSet)
+        OptOmitFP = OptLevel > 0;
+    if (!FPContractSet)
+        OptFPContract = OptFastMath;
+    if (!VectorizeSet)
+        OptVectorize = OptLevel >= 2;
+    // 没有V扩展时不能使用向量指令
+    OptVectorize = OptVectorize && ExtV;
 }
 
 // 打开需要写入的文件
@@ -72,10 +194,15 @@ int main(int Argc, char **Argv) {
     // 解析终结符流
     Obj *Prog = parse(Tok);
 
+    // 优化AST
+    optimize(Prog);
+
     // 生成代码
     FILE *Out = openFile(OptO);
     // .file 文件编号 文件名, debug use
     fprintf(Out, ".file 1 \"%s\"\n", InputPath);
     codegen(Prog, Out);
+    if (OptPeepholeStats)
+        printPeepholeStats(stderr);
     return 0;
 }
\ No newline at end of file
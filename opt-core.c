@@ -0,0 +1,27 @@
+//! 代码生成前在AST上进行的优化
+#include "opt.h"
+
+// 优化入口函数
+// -O2起进行AST上的优化，-O1只在代码生成中做一些简单的改进
+void optimize(Obj *Prog) {
+    // 函数内联需要看到整个程序，在其他优化之前进行
+    if (OptLevel >= 2)
+        inlineFuncs(Prog);
+
+    for (Obj *Fn = Prog; Fn; Fn = Fn->Next) {
+        if (Fn->Ty->Kind != TY_FUNC || !Fn->IsDefinition)
+            continue;
+
+        markAddrTaken(Fn);
+        // 向量化的循环由代码生成整体处理，其他优化不再进入其中
+        if (OptVectorize)
+            vectorize(Fn);
+        if (OptLevel < 2)
+            continue;
+
+        // 循环不变量外提
+        licm(Fn);
+        // 公共子表达式消除
+        cse(Fn);
+    }
+}
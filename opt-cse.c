@@ -0,0 +1,323 @@
+//! 公共子表达式消除(值编号)
+// 按照代码生成的求值顺序遍历函数，记录已经计算过的纯表达式。
+// 再次遇到相同的表达式时，若其值没有被中间的写入或调用改变，则复用之前的值：
+// 第一次出现处改为 T = E，之后出现处改为读取 T
+// 可用表达式表随结构化的控制流变化，只有支配当前位置的计算才会被复用
+#include "opt.h"
+
+// 候选的公共子表达式
+typedef struct Cand Cand;
+struct Cand {
+    Cand *Next;     // 下一候选
+    Node *Def;      // 第一次出现的节点
+    Node **Uses;    // 之后重复出现的节点
+    int NumUses;    // Uses的个数
+    int Cap;        // Uses的容量
+};
+
+// 所有候选
+static Cand *Cands;
+
+// 当前可用的表达式，按栈的方式增减，失效的置为NULL
+static Cand **Avail;
+static int NumAvail;
+static int CapAvail;
+
+// 当前switch开始时可用表达式的个数
+static int SwitchAvail;
+
+static void walkExpr(Node *Nd);
+static void walkAddr(Node *Nd);
+static void walkStmt(Node *Nd);
+
+// 查找可用的相同表达式
+static Cand *findAvail(Node *Nd) {
+    for (int I = NumAvail - 1; I >= 0; I--)
+        if (Avail[I] && sameExpr(Avail[I]->Def, Nd))
+            return Avail[I];
+    return NULL;
+}
+
+// 新建候选，并加入可用表
+static void addCand(Node *Nd) {
+    Cand *C = calloc(1, sizeof(Cand));
+    C->Def = Nd;
+    C->Next = Cands;
+    Cands = C;
+
+    if (NumAvail == CapAvail) {
+        CapAvail = CapAvail ? CapAvail * 2 : 64;
+        Avail = realloc(Avail, sizeof(Cand *) * CapAvail);
+    }
+    Avail[NumAvail++] = C;
+}
+
+// 记录一次重复出现
+static void addUse(Cand *C, Node *Nd) {
+    if (C->NumUses == C->Cap) {
+        C->Cap = C->Cap ? C->Cap * 2 : 4;
+        C->Uses = realloc(C->Uses, sizeof(Node *) * C->Cap);
+    }
+    C->Uses[C->NumUses++] = Nd;
+}
+
+// 丢弃之后加入的表达式，用于离开条件执行的代码
+static void truncate(int N) {
+    NumAvail = N;
+}
+
+// 使被写入影响的表达式失效
+static void killWith(KillSet *KS) {
+    if (!hasKills(KS))
+        return;
+    for (int I = 0; I < NumAvail; I++)
+        if (Avail[I] && isKilled(KS, Avail[I]->Def))
+            Avail[I] = NULL;
+}
+
+// 使被一段代码中的写入影响的表达式失效
+static void killIn(Node *Nd) {
+    KillSet KS = {0};
+    collectKills(Nd, &KS);
+    killWith(&KS);
+    free(KS.Vars);
+}
+
+// 使所有表达式失效
+static void killAll(void) {
+    for (int I = 0; I < NumAvail; I++)
+        Avail[I] = NULL;
+}
+
+// 是否值得作为候选：标量类型，没有副作用，并且比读取一个变量开销大
+static bool isCand(Node *Nd) {
+    return Nd->Ty && isScalar(Nd->Ty) && isPureExpr(Nd) && exprCost(Nd) > 3;
+}
+
+// 遍历表达式
+static void walkExpr(Node *Nd) {
+    if (!Nd)
+        return;
+
+    if (isCand(Nd)) {
+        Cand *C = findAvail(Nd);
+        // 重复出现的表达式整个都会被替换，无需再遍历
+        if (C) {
+            addUse(C, Nd);
+            return;
+        }
+        addCand(Nd);
+    }
+
+    switch (Nd->Kind) {
+        case ND_ASSIGN: {
+            // 先计算左值的地址，再计算右部
+            walkAddr(Nd->LHS);
+            walkExpr(Nd->RHS);
+            KillSet KS = {0};
+            addKillLValue(&KS, Nd->LHS);
+            killWith(&KS);
+            free(KS.Vars);
+            return;
+        }
+        case ND_COMMA:
+            walkExpr(Nd->LHS);
+            walkExpr(Nd->RHS);
+            return;
+        // 右部是条件执行的
+        case ND_LOGAND:
+        case ND_LOGOR: {
+            walkExpr(Nd->LHS);
+            int N = NumAvail;
+            walkExpr(Nd->RHS);
+            truncate(N);
+            return;
+        }
+        case ND_COND: {
+            walkExpr(Nd->Cond);
+            int N = NumAvail;
+            walkExpr(Nd->Then);
+            truncate(N);
+            walkExpr(Nd->Els);
+            truncate(N);
+            return;
+        }
+        case ND_FUNCALL: {
+            // 实参之间的求值顺序不定，先去掉会被任一实参改变的表达式，
+            // 每个实参中新计算的值也不给其他实参使用
+            for (Node *Arg = Nd->Args; Arg; Arg = Arg->Next)
+                killIn(Arg);
+            for (Node *Arg = Nd->Args; Arg; Arg = Arg->Next) {
+                int N = NumAvail;
+                walkExpr(Arg);
+                truncate(N);
+            }
+            int N = NumAvail;
+            walkExpr(Nd->LHS);
+            truncate(N);
+            // 被调用的函数可能写入任何内存
+            KillSet KS = {.Mem = true};
+            killWith(&KS);
+            return;
+        }
+        case ND_STMT_EXPR:
+            for (Node *N = Nd->Body; N; N = N->Next)
+                walkStmt(N);
+            return;
+        case ND_ADDR:
+        case ND_MEMBER:
+            walkAddr(Nd->LHS);
+            return;
+        case ND_MEMZERO: {
+            KillSet KS = {0};
+            addKillVar(&KS, Nd->Var);
+            killWith(&KS);
+            free(KS.Vars);
+            return;
+        }
+        default:
+            break;
+    }
+
+    if (isBinaryOp(Nd->Kind)) {
+        // 固定两侧的求值顺序，使代码生成与这里的遍历顺序一致
+        bool LFirst = lhsFirst(Nd);
+        Nd->Order = LFirst ? ORD_LHS : ORD_RHS;
+        walkExpr(LFirst ? Nd->LHS : Nd->RHS);
+        walkExpr(LFirst ? Nd->RHS : Nd->LHS);
+        return;
+    }
+
+    // 一元运算
+    walkExpr(Nd->LHS);
+}
+
+// 遍历左值，只有计算地址用到的值会被求值
+static void walkAddr(Node *Nd) {
+    switch (Nd->Kind) {
+        case ND_VAR:
+            return;
+        case ND_DEREF:
+            walkExpr(Nd->LHS);
+            return;
+        case ND_MEMBER:
+            walkAddr(Nd->LHS);
+            return;
+        case ND_COMMA:
+            walkExpr(Nd->LHS);
+            walkAddr(Nd->RHS);
+            return;
+        default:
+            walkExpr(Nd);
+            return;
+    }
+}
+
+// 遍历语句
+static void walkStmt(Node *Nd) {
+    if (!Nd)
+        return;
+
+    switch (Nd->Kind) {
+        case ND_BLOCK:
+            for (Node *N = Nd->Body; N; N = N->Next)
+                walkStmt(N);
+            return;
+        case ND_EXPR_STMT:
+        case ND_RETURN:
+            walkExpr(Nd->LHS);
+            return;
+        case ND_IF: {
+            walkExpr(Nd->Cond);
+            int N = NumAvail;
+            walkStmt(Nd->Then);
+            truncate(N);
+            walkStmt(Nd->Els);
+            truncate(N);
+            return;
+        }
+        // 循环头部可以从循环体跳转回来，先去掉循环中会被改变的表达式
+        // 条件中计算的值在循环体、递增语句以及循环结束后都可用
+        case ND_FOR: {
+            walkStmt(Nd->Init);
+            killIn(Nd->Cond);
+            killIn(Nd->Then);
+            killIn(Nd->Inc);
+            if (Nd->Vec)
+                return;
+            walkExpr(Nd->Cond);
+            int N = NumAvail;
+            walkStmt(Nd->Then);
+            // continue会直接跳到递增语句
+            truncate(N);
+            walkExpr(Nd->Inc);
+            truncate(N);
+            return;
+        }
+        case ND_DO: {
+            killIn(Nd->Then);
+            killIn(Nd->Cond);
+            int N = NumAvail;
+            walkStmt(Nd->Then);
+            truncate(N);
+            walkExpr(Nd->Cond);
+            truncate(N);
+            return;
+        }
+        // 每个case都可以从switch直接跳转过来
+        case ND_SWITCH: {
+            walkExpr(Nd->Cond);
+            killIn(Nd->Then);
+            int Saved = SwitchAvail;
+            SwitchAvail = NumAvail;
+            walkStmt(Nd->Then);
+            truncate(SwitchAvail);
+            SwitchAvail = Saved;
+            return;
+        }
+        case ND_CASE:
+            truncate(SwitchAvail);
+            walkStmt(Nd->LHS);
+            return;
+        // 标签可以从任何地方跳转过来
+        case ND_LABEL:
+            killAll();
+            walkStmt(Nd->LHS);
+            return;
+        case ND_GOTO:
+            return;
+        default:
+            return;
+    }
+}
+
+// 对函数进行公共子表达式消除
+void cse(Obj *Fn) {
+    Cands = NULL;
+    NumAvail = 0;
+    walkStmt(Fn->Body);
+
+    for (Cand *C = Cands; C; C = C->Next) {
+        if (!C->NumUses)
+            continue;
+        // 第一次出现处多了一次存储，之后每处都要读取变量
+        if (C->NumUses * (exprCost(C->Def) - 2) <= 3)
+            continue;
+
+        Obj *Var = newTempVar(Fn, C->Def->Ty);
+
+        // 第一次出现处 T = E，保留其在实参链表中的位置
+        Node *Def = C->Def;
+        Node *Next = Def->Next;
+        *Def = *newOptAssign(Var, copyNode(Def));
+        Def->Next = Next;
+
+        // 之后出现处读取T
+        for (int I = 0; I < C->NumUses; I++) {
+            Node *Use = C->Uses[I];
+            Next = Use->Next;
+            *Use = *newOptVar(Var, Use->Tok);
+            Use->Next = Next;
+        }
+    }
+}
@@ -0,0 +1,483 @@
+//! 函数内联
+// 将对小函数的直接调用替换为被调函数体的副本，省去传参、调用和序言/尾声的开销：
+//
+//      f(A, B)  =>  ({ P1 = A; P2 = B; {函数体}; R; })
+//
+// 函数体中的局部变量和标签都换成新的，return改为 R = E 并跳转到函数体末尾。
+// 内联后不再被引用的static函数不会被输出
+#include "opt.h"
+
+// 内联展开的最大嵌套层数，递归函数最多展开这么多层
+#define MAX_INLINE_DEPTH 3
+// 各类函数允许内联的最大节点数
+#define INLINE_LIMIT 20
+#define INLINE_LIMIT_STATIC 40
+#define INLINE_LIMIT_INLINE 80
+// 只有一处调用的static函数，内联后函数本身可以删去
+#define INLINE_LIMIT_ONCE 400
+// 每个函数因内联最多增加的节点数
+#define INLINE_BUDGET 2000
+
+// 复制函数体时的对应关系
+typedef struct {
+    Obj *Fn;            // 被内联的函数
+    // 局部变量
+    Obj **OldVars;
+    Obj **NewVars;
+    int NumVars;
+    // 标签
+    char **OldLabels;
+    char **NewLabels;
+    int NumLabels;
+    int CapLabels;
+    // case语句
+    Node **OldCases;
+    Node **NewCases;
+    int NumCases;
+    int CapCases;
+    // 返回
+    Node *LastRet;      // 函数体最后的return，不需要跳转
+    Obj *RetVar;        // 保存返回值的变量
+    char *RetLabel;     // 函数体末尾的标签
+    bool RetJump;       // 是否有跳转到末尾的return
+} Inliner;
+
+// 所有的函数
+static Obj *Funcs;
+// 当前处理的函数
+static Obj *CurFn;
+// 当前函数剩余的内联预算
+static int Budget;
+// 当前所在的循环层数
+static int LoopDepth;
+// 当前函数中return自身调用的节点，生成代码时会变成循环，不需要展开
+static Node *SelfTail;
+
+static void inlineNode(Node *Nd, int Depth);
+static Node *cloneNode(Inliner *In, Node *Nd);
+
+// 内联产生的标签
+static char *newInlineLabel(void) {
+    static int Id = 0;
+    return format(".L.inline.%d", Id++);
+}
+
+// 查找函数的定义
+static Obj *findFunc(char *Name) {
+    for (Obj *Fn = Funcs; Fn; Fn = Fn->Next)
+        if (Fn->Ty->Kind == TY_FUNC && Fn->IsDefinition && !strcmp(Fn->Name, Name))
+            return Fn;
+    return NULL;
+}
+
+// AST中节点的个数，用来估计函数的大小
+static int countNodes(Node *Nd) {
+    if (!Nd)
+        return 0;
+    int N = 1 + countNodes(Nd->LHS) + countNodes(Nd->RHS) + countNodes(Nd->Cond) +
+            countNodes(Nd->Then) + countNodes(Nd->Els) + countNodes(Nd->Init) +
+            countNodes(Nd->Inc);
+    for (Node *B = Nd->Body; B; B = B->Next)
+        N += countNodes(B);
+    for (Node *A = Nd->Args; A; A = A->Next)
+        N += countNodes(A);
+    return N;
+}
+
+// 统计函数被引用的次数，不计函数对自身的引用
+static void countRefs(Node *Nd, Obj *Self) {
+    if (!Nd)
+        return;
+    if (Nd->Kind == ND_VAR && Nd->Var->Ty->Kind == TY_FUNC) {
+        Obj *Fn = findFunc(Nd->Var->Name);
+        if (Fn && Fn != Self)
+            Fn->NumRefs++;
+    }
+    countRefs(Nd->LHS, Self);
+    countRefs(Nd->RHS, Self);
+    countRefs(Nd->Cond, Self);
+    countRefs(Nd->Then, Self);
+    countRefs(Nd->Els, Self);
+    countRefs(Nd->Init, Self);
+    countRefs(Nd->Inc, Self);
+    for (Node *B = Nd->Body; B; B = B->Next)
+        countRefs(B, Self);
+    for (Node *A = Nd->Args; A; A = A->Next)
+        countRefs(A, Self);
+}
+
+// 重新统计所有函数被引用的次数
+static void countAllRefs(void) {
+    for (Obj *Var = Funcs; Var; Var = Var->Next)
+        Var->NumRefs = 0;
+
+    for (Obj *Var = Funcs; Var; Var = Var->Next) {
+        if (Var->Ty->Kind == TY_FUNC) {
+            if (Var->IsDefinition)
+                countRefs(Var->Body, Var);
+            continue;
+        }
+        // 全局变量初始化时指向的函数
+        for (Relocation *Rel = Var->Rel; Rel; Rel = Rel->Next) {
+            Obj *Fn = findFunc(Rel->Label);
+            if (Fn)
+                Fn->NumRefs++;
+        }
+    }
+}
+
+//
+// 复制函数体
+//
+
+// 新的局部变量
+static Obj *mapVar(Inliner *In, Obj *Var) {
+    for (int I = 0; I < In->NumVars; I++)
+        if (In->OldVars[I] == Var)
+            return In->NewVars[I];
+    return Var;
+}
+
+// 新的标签，第一次遇到时创建
+static char *mapLabel(Inliner *In, char *Label) {
+    if (!Label)
+        return NULL;
+    for (int I = 0; I < In->NumLabels; I++)
+        if (!strcmp(In->OldLabels[I], Label))
+            return In->NewLabels[I];
+
+    if (In->NumLabels == In->CapLabels) {
+        In->CapLabels = In->CapLabels ? In->CapLabels * 2 : 8;
+        In->OldLabels = realloc(In->OldLabels, sizeof(char *) * In->CapLabels);
+        In->NewLabels = realloc(In->NewLabels, sizeof(char *) * In->CapLabels);
+    }
+    In->OldLabels[In->NumLabels] = Label;
+    In->NewLabels[In->NumLabels] = newInlineLabel();
+    return In->NewLabels[In->NumLabels++];
+}
+
+// 新的case语句
+static Node *mapCase(Inliner *In, Node *Case) {
+    for (int I = 0; I < In->NumCases; I++)
+        if (In->OldCases[I] == Case)
+            return In->NewCases[I];
+    return NULL;
+}
+
+static void addCase(Inliner *In, Node *Old, Node *New) {
+    if (In->NumCases == In->CapCases) {
+        In->CapCases = In->CapCases ? In->CapCases * 2 : 8;
+        In->OldCases = realloc(In->OldCases, sizeof(Node *) * In->CapCases);
+        In->NewCases = realloc(In->NewCases, sizeof(Node *) * In->CapCases);
+    }
+    In->OldCases[In->NumCases] = Old;
+    In->NewCases[In->NumCases++] = New;
+}
+
+// 复制语句链表
+static Node *cloneList(Inliner *In, Node *List) {
+    Node Head = {};
+    Node *Cur = &Head;
+    for (Node *N = List; N; N = N->Next)
+        Cur = Cur->Next = cloneNode(In, N);
+    return Head.Next;
+}
+
+// return E  =>  {R = E; goto 末尾;}
+static Node *cloneReturn(Inliner *In, Node *Nd) {
+    Node Head = {};
+    Node *Cur = &Head;
+    if (Nd->LHS) {
+        Node *Val = cloneNode(In, Nd->LHS);
+        Cur = Cur->Next = In->RetVar ? newOptExprStmt(newOptAssign(In->RetVar, Val))
+                                     : newOptExprStmt(Val);
+    }
+    if (Nd != In->LastRet) {
+        Node *Goto = calloc(1, sizeof(Node));
+        Goto->Kind = ND_GOTO;
+        Goto->Tok = Nd->Tok;
+        Goto->UniqueLabel = In->RetLabel;
+        Cur = Cur->Next = Goto;
+        In->RetJump = true;
+    }
+    return newOptBlock(Head.Next, Nd->Tok);
+}
+
+// 复制节点，替换其中的局部变量、标签和return
+static Node *cloneNode(Inliner *In, Node *Nd) {
+    if (!Nd)
+        return NULL;
+    if (Nd->Kind == ND_RETURN)
+        return cloneReturn(In, Nd);
+
+    Node *Cp = calloc(1, sizeof(Node));
+    *Cp = *Nd;
+    Cp->Next = NULL;
+    Cp->RegNeed = 0;
+    Cp->Order = ORD_ANY;
+    Cp->GotoNext = NULL;
+
+    if (Nd->Var)
+        Cp->Var = mapVar(In, Nd->Var);
+    if (Nd->RetBuffer)
+        Cp->RetBuffer = mapVar(In, Nd->RetBuffer);
+    Cp->LHS = cloneNode(In, Nd->LHS);
+    Cp->RHS = cloneNode(In, Nd->RHS);
+    Cp->Cond = cloneNode(In, Nd->Cond);
+    Cp->Then = cloneNode(In, Nd->Then);
+    Cp->Els = cloneNode(In, Nd->Els);
+    Cp->Init = cloneNode(In, Nd->Init);
+    Cp->Inc = cloneNode(In, Nd->Inc);
+    Cp->Body = cloneList(In, Nd->Body);
+    Cp->Args = cloneList(In, Nd->Args);
+
+    switch (Nd->Kind) {
+        case ND_FOR:
+        case ND_DO:
+        case ND_SWITCH:
+            Cp->BrkLabel = mapLabel(In, Nd->BrkLabel);
+            Cp->ContLabel = mapLabel(In, Nd->ContLabel);
+            break;
+        case ND_GOTO:
+        case ND_LABEL:
+            Cp->UniqueLabel = mapLabel(In, Nd->UniqueLabel);
+            break;
+        case ND_CASE:
+            Cp->Label = mapLabel(In, Nd->Label);
+            addCase(In, Nd, Cp);
+            break;
+        default:
+            break;
+    }
+
+    // case语句都已在Then中复制过，重建switch的case链表
+    if (Nd->Kind == ND_SWITCH) {
+        Node Head = {};
+        Node *Cur = &Head;
+        for (Node *C = Nd->CaseNext; C; C = C->CaseNext)
+            Cur = Cur->CaseNext = mapCase(In, C);
+        Cur->CaseNext = NULL;
+        Cp->CaseNext = Head.CaseNext;
+        Cp->DefaultCase = mapCase(In, Nd->DefaultCase);
+    }
+    return Cp;
+}
+
+// 函数体中return的个数
+static int countReturns(Node *Nd) {
+    if (!Nd)
+        return 0;
+    int N = Nd->Kind == ND_RETURN;
+    N += countReturns(Nd->Then) + countReturns(Nd->Els) + countReturns(Nd->LHS) +
+         countReturns(Nd->RHS) + countReturns(Nd->Init) + countReturns(Nd->Inc) +
+         countReturns(Nd->Cond);
+    for (Node *B = Nd->Body; B; B = B->Next)
+        N += countReturns(B);
+    return N;
+}
+
+//
+// 内联
+//
+
+// 能否内联：直接调用有定义的函数，实参与形参一一对应，
+// 不支持可变参数和返回结构体
+static bool canInline(Node *Call, Obj *Fn) {
+    if (!Fn || Fn->VaArea || Fn->IsNoInline)
+        return false;
+    Type *RetTy = Fn->Ty->ReturnTy;
+    if (RetTy->Kind != TY_VOID && !isScalar(RetTy))
+        return false;
+
+    Obj *Param = Fn->Params;
+    for (Node *Arg = Call->Args; Arg; Arg = Arg->Next, Param = Param->Next) {
+        if (!Param || !isScalar(Param->Ty) || !Arg->Ty)
+            return false;
+        if (Arg->Ty->Kind != Param->Ty->Kind || Arg->Ty->Size != Param->Ty->Size)
+            return false;
+    }
+    return !Param;
+}
+
+// 是否值得内联：根据函数的大小、说明符和调用的频率
+static bool shouldInline(Obj *Fn, int Depth, int Size) {
+    if (Depth >= MAX_INLINE_DEPTH)
+        return false;
+    if (Fn->IsAlwaysInline)
+        return true;
+
+    int Limit = INLINE_LIMIT;
+    if (Fn->IsInline)
+        Limit = INLINE_LIMIT_INLINE;
+    else if (Fn->IsStatic)
+        Limit = INLINE_LIMIT_STATIC;
+    // 循环中的调用执行次数多，放宽限制
+    if (LoopDepth)
+        Limit *= 2;
+    // 只有这一处调用
+    if (Fn->IsStatic && Fn->NumRefs == 1 && Fn != CurFn && !Depth)
+        Limit = INLINE_LIMIT_ONCE;
+
+    return Size <= Limit && Size <= Budget;
+}
+
+// 将调用替换为函数体
+static void inlineCall(Node *Call, Obj *Fn, int Depth) {
+    Inliner In = {.Fn = Fn};
+
+    // 所有局部变量(包括形参)都换成调用者中新的变量
+    for (Obj *Var = Fn->Locals; Var; Var = Var->Next)
+        In.NumVars++;
+    In.OldVars = calloc(In.NumVars, sizeof(Obj *));
+    In.NewVars = calloc(In.NumVars, sizeof(Obj *));
+    int I = 0;
+    for (Obj *Var = Fn->Locals; Var; Var = Var->Next, I++) {
+        Obj *New = calloc(1, sizeof(Obj));
+        *New = *Var;
+        New->Offset = 0;
+        New->IsAddrTaken = false;
+        // 块的时刻是被调函数中的，不能和调用者的比较
+        New->LiveEnd = 0;
+        New->Next = CurFn->Locals;
+        CurFn->Locals = New;
+        In.OldVars[I] = Var;
+        In.NewVars[I] = New;
+    }
+
+    // 只在函数体最后有一个return时，其值直接作为结果
+    Node *Last = NULL;
+    for (Node *N = Fn->Body->Body; N; N = N->Next)
+        Last = N;
+    if (Last && Last->Kind == ND_RETURN)
+        In.LastRet = Last;
+    Type *RetTy = Fn->Ty->ReturnTy;
+    bool Direct = In.LastRet && In.LastRet->LHS && countReturns(Fn->Body) == 1;
+    if (RetTy->Kind != TY_VOID && !Direct)
+        In.RetVar = newTempVar(CurFn, RetTy);
+    In.RetLabel = newInlineLabel();
+
+    // 递归函数的函数体中包含Call本身，要在拆开实参链表之前复制和展开
+    Node *Body = cloneNode(&In, Fn->Body);
+    inlineNode(Body, Depth + 1);
+
+    Node Head = {};
+    Node *Cur = &Head;
+
+    // 形参 = 实参
+    Obj *Param = Fn->Params;
+    for (Node *Arg = Call->Args; Arg; Param = Param->Next) {
+        Node *Next = Arg->Next;
+        Arg->Next = NULL;
+        Cur = Cur->Next = newOptExprStmt(newOptAssign(mapVar(&In, Param), Arg));
+        Arg = Next;
+    }
+
+    // 函数体
+    Cur = Cur->Next = Body;
+
+    // 函数体末尾
+    if (In.RetJump) {
+        Node *Label = calloc(1, sizeof(Node));
+        Label->Kind = ND_LABEL;
+        Label->Tok = Call->Tok;
+        Label->UniqueLabel = In.RetLabel;
+        Label->LHS = newOptBlock(NULL, Call->Tok);
+        Cur = Cur->Next = Label;
+    }
+    if (In.RetVar)
+        Cur = Cur->Next = newOptExprStmt(newOptVar(In.RetVar, Call->Tok));
+
+    // 原节点改为语句表达式，保留其在实参链表中的位置
+    Node *Next = Call->Next;
+    Type *Ty = Call->Ty;
+    Token *Tok = Call->Tok;
+    *Call = (Node){0};
+    Call->Kind = ND_STMT_EXPR;
+    Call->Body = Head.Next;
+    Call->Ty = Ty;
+    Call->Tok = Tok;
+    Call->Next = Next;
+
+    free(In.OldVars);
+    free(In.NewVars);
+    free(In.OldLabels);
+    free(In.NewLabels);
+    free(In.OldCases);
+    free(In.NewCases);
+}
+
+// return f(...)中f为当前函数时返回该调用
+static Node *selfTailCall(Node *Ret) {
+    Node *Call = Ret->LHS;
+    while (Call && Call->Kind == ND_CAST && Call->LHS->Ty->Size == Call->Ty->Size)
+        Call = Call->LHS;
+    if (!Call || Call->Kind != ND_FUNCALL || Call->LHS->Kind != ND_VAR ||
+        strcmp(Call->LHS->Var->Name, CurFn->Name))
+        return NULL;
+    return Call;
+}
+
+// 遍历AST，内联其中的调用
+static void inlineNode(Node *Nd, int Depth) {
+    if (!Nd)
+        return;
+    if (Nd->Kind == ND_RETURN && !Depth)
+        SelfTail = selfTailCall(Nd);
+
+    bool IsLoop = Nd->Kind == ND_FOR || Nd->Kind == ND_DO;
+    inlineNode(Nd->Init, Depth);
+    LoopDepth += IsLoop;
+    inlineNode(Nd->LHS, Depth);
+    inlineNode(Nd->RHS, Depth);
+    inlineNode(Nd->Cond, Depth);
+    inlineNode(Nd->Then, Depth);
+    inlineNode(Nd->Els, Depth);
+    inlineNode(Nd->Inc, Depth);
+    LoopDepth -= IsLoop;
+    for (Node *B = Nd->Body; B; B = B->Next)
+        inlineNode(B, Depth);
+    for (Node *A = Nd->Args; A; A = A->Next)
+        inlineNode(A, Depth);
+
+    if (Nd->Kind != ND_FUNCALL || Nd->LHS->Kind != ND_VAR ||
+        Nd->LHS->Var->Ty->Kind != TY_FUNC || Nd == SelfTail)
+        return;
+    Obj *Fn = findFunc(Nd->LHS->Var->Name);
+    if (!canInline(Nd, Fn))
+        return;
+    int Size = countNodes(Fn->Body);
+    if (!shouldInline(Fn, Depth, Size))
+        return;
+    if (!Fn->IsAlwaysInline)
+        Budget -= Size;
+    inlineCall(Nd, Fn, Depth);
+}
+
+// 对整个程序进行内联
+void inlineFuncs(Obj *Prog) {
+    Funcs = Prog;
+    countAllRefs();
+
+    for (Obj *Fn = Prog; Fn; Fn = Fn->Next) {
+        if (Fn->Ty->Kind != TY_FUNC || !Fn->IsDefinition)
+            continue;
+        CurFn = Fn;
+        Budget = INLINE_BUDGET;
+        LoopDepth = 0;
+        inlineNode(Fn->Body, 0);
+    }
+
+    // 删去不再被引用的static函数，直到没有可删的
+    bool Changed = true;
+    while (Changed) {
+        Changed = false;
+        countAllRefs();
+        for (Obj *Fn = Prog; Fn; Fn = Fn->Next) {
+            if (Fn->Ty->Kind == TY_FUNC && Fn->IsDefinition && Fn->IsStatic &&
+                !Fn->NumRefs) {
+                Fn->IsDefinition = false;
+                Changed = true;
+            }
+        }
+    }
+}
@@ -0,0 +1,335 @@
+//! 循环不变量外提
+// 对于for、while和do循环，找出循环中每次计算结果都相同的纯表达式，
+// 在进入循环前的前置块中计算一次并保存到临时变量，循环中改为读取临时变量
+//
+//      for (Init; Cond; Inc) Then      =>  for ({Init; T = E;}; Cond; Inc) Then[E := T]
+//      do Then while (Cond)            =>  {T = E; do Then[E := T] while (Cond);}
+#include "opt.h"
+
+// 外提到前置块的表达式
+typedef struct Hoist Hoist;
+struct Hoist {
+    Hoist *Next;    // 下一个
+    Node *Expr;     // 被外提的表达式
+    Obj *Var;       // 保存其值的临时变量
+};
+
+// 当前处理的函数
+static Obj *CurFn;
+// 当前循环中的所有写入
+static KillSet LoopKills;
+// 当前循环外提的表达式
+static Hoist *Hoists;
+static Hoist *HoistsTail;
+
+static void hoistExpr(Node *Nd, bool Always);
+static void hoistAddr(Node *Nd, bool Always);
+static bool hoistStmt(Node *Nd, bool Always);
+
+// 循环中是否有可以从循环外跳转进来的位置
+static bool hasEntry(Node *Nd, bool InSwitch) {
+    if (!Nd)
+        return false;
+    switch (Nd->Kind) {
+        case ND_LABEL:
+            return true;
+        // 循环内switch的case只能从该switch跳转过来
+        case ND_CASE:
+            if (!InSwitch)
+                return true;
+            break;
+        case ND_SWITCH:
+            return hasEntry(Nd->Cond, InSwitch) || hasEntry(Nd->Then, true);
+        default:
+            break;
+    }
+
+    if (hasEntry(Nd->LHS, InSwitch) || hasEntry(Nd->RHS, InSwitch) ||
+        hasEntry(Nd->Cond, InSwitch) || hasEntry(Nd->Then, InSwitch) ||
+        hasEntry(Nd->Els, InSwitch) || hasEntry(Nd->Init, InSwitch) ||
+        hasEntry(Nd->Inc, InSwitch))
+        return true;
+    for (Node *N = Nd->Body; N; N = N->Next)
+        if (hasEntry(N, InSwitch))
+            return true;
+    for (Node *N = Nd->Args; N; N = N->Next)
+        if (hasEntry(N, InSwitch))
+            return true;
+    return false;
+}
+
+// 纯表达式求值时是否可能访问非法地址
+// 直接读取变量总是安全的，通过指针读取则不一定
+// Addr表示Nd处于取地址的上下文中
+static bool mayFault(Node *Nd, bool Addr) {
+    if (!Nd)
+        return false;
+    switch (Nd->Kind) {
+        case ND_NUM:
+        case ND_VAR:
+            return false;
+        case ND_DEREF:
+            return (!Addr && isScalar(Nd->Ty)) || mayFault(Nd->LHS, false);
+        case ND_MEMBER: {
+            // 结构体位于变量中时，读取成员也是安全的
+            Node *Base = Nd;
+            while (Base->Kind == ND_MEMBER)
+                Base = Base->LHS;
+            if (!Addr && isScalar(Nd->Ty) && Base->Kind != ND_VAR)
+                return true;
+            return mayFault(Nd->LHS, true);
+        }
+        case ND_ADDR:
+            return mayFault(Nd->LHS, true);
+        default:
+            return mayFault(Nd->LHS, false) || mayFault(Nd->RHS, false);
+    }
+}
+
+// 表达式中是否用到了变量，不用变量的是常量，外提没有好处
+static bool hasVar(Node *Nd) {
+    if (!Nd)
+        return false;
+    if (Nd->Kind == ND_VAR)
+        return true;
+    return hasVar(Nd->LHS) || hasVar(Nd->RHS);
+}
+
+// 是否可以外提：循环中值不变的纯标量表达式，开销比读取临时变量大
+// 不含变量的表达式中只外提常量池中的浮点常量，省去每次迭代中的地址计算
+// 外提后即使循环一次都不执行也会被求值，
+// 所以只有在每次进入循环都一定会被求值(Always)时，才能外提可能访问非法地址的读取
+static bool canHoist(Node *Nd, bool Always) {
+    if (!Nd->Ty || !isScalar(Nd->Ty) || !isPureExpr(Nd))
+        return false;
+    if (exprCost(Nd) <= 2 || (!hasVar(Nd) && !inFConstPool(Nd)) || isKilled(&LoopKills, Nd))
+        return false;
+    return Always || !mayFault(Nd, false);
+}
+
+// 将表达式外提到前置块，原处改为读取临时变量
+static void hoist(Node *Nd) {
+    Hoist *H = Hoists;
+    while (H && !sameExpr(H->Expr, Nd))
+        H = H->Next;
+
+    if (!H) {
+        H = calloc(1, sizeof(Hoist));
+        H->Expr = copyNode(Nd);
+        H->Var = newTempVar(CurFn, Nd->Ty);
+        if (HoistsTail)
+            HoistsTail->Next = H;
+        else
+            Hoists = H;
+        HoistsTail = H;
+    }
+
+    // 保留其在实参链表中的位置
+    Node *Next = Nd->Next;
+    *Nd = *newOptVar(H->Var, Nd->Tok);
+    Nd->Next = Next;
+}
+
+// 外提表达式中的循环不变量
+// Always表示每次进入循环时，Nd都至少会被求值一次
+static void hoistExpr(Node *Nd, bool Always) {
+    if (!Nd)
+        return;
+
+    if (canHoist(Nd, Always)) {
+        hoist(Nd);
+        return;
+    }
+
+    switch (Nd->Kind) {
+        case ND_ASSIGN:
+            hoistAddr(Nd->LHS, Always);
+            hoistExpr(Nd->RHS, Always);
+            return;
+        case ND_LOGAND:
+        case ND_LOGOR:
+            hoistExpr(Nd->LHS, Always);
+            hoistExpr(Nd->RHS, false);
+            return;
+        case ND_COND:
+            hoistExpr(Nd->Cond, Always);
+            hoistExpr(Nd->Then, false);
+            hoistExpr(Nd->Els, false);
+            return;
+        case ND_FUNCALL:
+            for (Node *Arg = Nd->Args; Arg; Arg = Arg->Next)
+                hoistExpr(Arg, Always);
+            hoistExpr(Nd->LHS, Always);
+            return;
+        case ND_STMT_EXPR:
+            for (Node *N = Nd->Body; N; N = N->Next)
+                Always = hoistStmt(N, Always);
+            return;
+        case ND_ADDR:
+        case ND_MEMBER:
+            hoistAddr(Nd->LHS, Always);
+            return;
+        case ND_MEMZERO:
+            return;
+        default:
+            hoistExpr(Nd->LHS, Always);
+            hoistExpr(Nd->RHS, Always);
+            return;
+    }
+}
+
+// 外提左值地址计算中的循环不变量
+static void hoistAddr(Node *Nd, bool Always) {
+    switch (Nd->Kind) {
+        case ND_VAR:
+            return;
+        case ND_DEREF:
+            hoistExpr(Nd->LHS, Always);
+            return;
+        case ND_MEMBER:
+            hoistAddr(Nd->LHS, Always);
+            return;
+        case ND_COMMA:
+            hoistExpr(Nd->LHS, Always);
+            hoistAddr(Nd->RHS, Always);
+            return;
+        default:
+            hoistExpr(Nd, Always);
+            return;
+    }
+}
+
+// 外提语句中的循环不变量，返回其后的语句是否仍然一定会被执行
+static bool hoistStmt(Node *Nd, bool Always) {
+    if (!Nd)
+        return Always;
+
+    switch (Nd->Kind) {
+        case ND_BLOCK:
+            for (Node *N = Nd->Body; N; N = N->Next)
+                Always = hoistStmt(N, Always);
+            return Always;
+        case ND_EXPR_STMT:
+            hoistExpr(Nd->LHS, Always);
+            return Always;
+        case ND_RETURN:
+            hoistExpr(Nd->LHS, Always);
+            return false;
+        case ND_IF:
+            hoistExpr(Nd->Cond, Always);
+            hoistStmt(Nd->Then, false);
+            hoistStmt(Nd->Els, false);
+            return false;
+        case ND_FOR:
+            hoistStmt(Nd->Init, Always);
+            hoistExpr(Nd->Cond, Always);
+            hoistStmt(Nd->Then, Always && !Nd->Cond);
+            hoistExpr(Nd->Inc, false);
+            return false;
+        case ND_DO:
+            hoistStmt(Nd->Then, Always);
+            hoistExpr(Nd->Cond, false);
+            return false;
+        case ND_SWITCH:
+            hoistExpr(Nd->Cond, Always);
+            hoistStmt(Nd->Then, false);
+            return false;
+        case ND_CASE:
+        case ND_LABEL:
+            hoistStmt(Nd->LHS, false);
+            return false;
+        default:
+            return false;
+    }
+}
+
+// 对一个循环进行外提，返回前置块中的语句
+static Node *hoistLoop(Node *Nd) {
+    LoopKills = (KillSet){0};
+    collectKills(Nd->Cond, &LoopKills);
+    collectKills(Nd->Then, &LoopKills);
+    collectKills(Nd->Inc, &LoopKills);
+    Hoists = HoistsTail = NULL;
+
+    if (Nd->Kind == ND_FOR) {
+        // 条件每次进入循环都会被求值，没有条件时循环体一定会被执行
+        hoistExpr(Nd->Cond, true);
+        hoistStmt(Nd->Then, !Nd->Cond);
+        hoistExpr(Nd->Inc, false);
+    } else {
+        hoistStmt(Nd->Then, true);
+        hoistExpr(Nd->Cond, false);
+    }
+    free(LoopKills.Vars);
+
+    Node Head = {};
+    Node *Cur = &Head;
+    for (Hoist *H = Hoists; H; H = H->Next)
+        Cur = Cur->Next = newOptExprStmt(newOptAssign(H->Var, H->Expr));
+    return Head.Next;
+}
+
+// 遍历语句，由外向内处理其中的循环
+static void licmStmt(Node *Nd) {
+    if (!Nd)
+        return;
+
+    switch (Nd->Kind) {
+        case ND_BLOCK:
+            for (Node *N = Nd->Body; N; N = N->Next)
+                licmStmt(N);
+            return;
+        case ND_IF:
+            licmStmt(Nd->Then);
+            licmStmt(Nd->Els);
+            return;
+        case ND_SWITCH:
+            licmStmt(Nd->Then);
+            return;
+        case ND_CASE:
+        case ND_LABEL:
+            licmStmt(Nd->LHS);
+            return;
+        case ND_FOR: {
+            if (Nd->Vec)
+                return;
+            // 通过goto或case进入循环会跳过前置块
+            Node *Pre = hasEntry(Nd, false) ? NULL : hoistLoop(Nd);
+            if (Pre) {
+                // 前置块放在初始化语句之后
+                if (Nd->Init) {
+                    Nd->Init->Next = Pre;
+                    Pre = Nd->Init;
+                }
+                Nd->Init = newOptBlock(Pre, Nd->Tok);
+            }
+            licmStmt(Nd->Then);
+            return;
+        }
+        case ND_DO: {
+            Node *Loop = Nd;
+            Node *Pre = hasEntry(Nd, false) ? NULL : hoistLoop(Nd);
+            if (Pre) {
+                // 原节点改为 {前置块; do循环}，保留其在语句链表中的位置
+                Loop = copyNode(Nd);
+                Node *Next = Nd->Next;
+                Node *Last = Pre;
+                while (Last->Next)
+                    Last = Last->Next;
+                Last->Next = Loop;
+                *Nd = *newOptBlock(Pre, Nd->Tok);
+                Nd->Next = Next;
+            }
+            licmStmt(Loop->Then);
+            return;
+        }
+        default:
+            return;
+    }
+}
+
+// 对函数进行循环不变量外提
+void licm(Obj *Fn) {
+    CurFn = Fn;
+    licmStmt(Fn->Body);
+}
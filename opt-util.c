@@ -0,0 +1,353 @@
+#include "opt.h"
+
+//
+// 变量
+//
+
+// 是否为标量类型，即可以放在一个寄存器中的类型
+bool isScalar(Type *Ty) {
+    return isNumeric(Ty) || Ty->Kind == TY_PTR;
+}
+
+// 是否为只会被直接赋值的局部变量
+// 这类变量的值只会在对其赋值时改变，不受通过指针的写入和函数调用的影响
+bool isRegVar(Obj *Var) {
+    return Var->IsLocal && isScalar(Var->Ty) && !Var->IsAddrTaken;
+}
+
+// 遍历AST中的所有节点，对每个节点调用Fn
+static void forEachNode(Node *Nd, void (*Fn)(Node *)) {
+    if (!Nd)
+        return;
+    Fn(Nd);
+    forEachNode(Nd->LHS, Fn);
+    forEachNode(Nd->RHS, Fn);
+    forEachNode(Nd->Cond, Fn);
+    forEachNode(Nd->Then, Fn);
+    forEachNode(Nd->Els, Fn);
+    forEachNode(Nd->Init, Fn);
+    forEachNode(Nd->Inc, Fn);
+    // 语句链表和实参链表
+    for (Node *N = Nd->Body; N; N = N->Next)
+        forEachNode(N, Fn);
+    for (Node *N = Nd->Args; N; N = N->Next)
+        forEachNode(N, Fn);
+}
+
+// 标记被取地址的局部变量
+static void markAddr(Node *Nd) {
+    if (Nd->Kind != ND_ADDR)
+        return;
+    // &x, &x.a.b, &(..., x)
+    Node *N = Nd->LHS;
+    while (N->Kind == ND_MEMBER || N->Kind == ND_COMMA)
+        N = N->Kind == ND_MEMBER ? N->LHS : N->RHS;
+    if (N->Kind == ND_VAR)
+        N->Var->IsAddrTaken = true;
+}
+
+// 计算函数中每个局部变量的地址是否被取过
+// 数组和结构体本身就在内存中，这里只关心标量
+void markAddrTaken(Obj *Fn) {
+    forEachNode(Fn->Body, markAddr);
+}
+
+// 在函数中新建一个匿名的局部变量，用于保存优化中产生的临时值
+Obj *newTempVar(Obj *Fn, Type *Ty) {
+    Obj *Var = calloc(1, sizeof(Obj));
+    Var->Name = "";
+    Var->Ty = Ty;
+    Var->Align = Ty->Align;
+    Var->IsLocal = true;
+    Var->IsDefinition = true;
+    Var->Next = Fn->Locals;
+    Fn->Locals = Var;
+    return Var;
+}
+
+//
+// 节点
+//
+
+// 复制一个节点，子节点共用
+Node *copyNode(Node *Nd) {
+    Node *Cp = calloc(1, sizeof(Node));
+    *Cp = *Nd;
+    Cp->Next = NULL;
+    return Cp;
+}
+
+// 新建变量节点
+Node *newOptVar(Obj *Var, Token *Tok) {
+    Node *Nd = calloc(1, sizeof(Node));
+    Nd->Kind = ND_VAR;
+    Nd->Tok = Tok;
+    Nd->Var = Var;
+    Nd->Ty = Var->Ty;
+    return Nd;
+}
+
+// 新建赋值节点 Var = Expr，类型与Var相同
+Node *newOptAssign(Obj *Var, Node *Expr) {
+    Node *Nd = calloc(1, sizeof(Node));
+    Nd->Kind = ND_ASSIGN;
+    Nd->Tok = Expr->Tok;
+    Nd->LHS = newOptVar(Var, Expr->Tok);
+    Nd->RHS = Expr;
+    Nd->Ty = Var->Ty;
+    return Nd;
+}
+
+// 新建表达式语句
+Node *newOptExprStmt(Node *Expr) {
+    Node *Nd = calloc(1, sizeof(Node));
+    Nd->Kind = ND_EXPR_STMT;
+    Nd->Tok = Expr->Tok;
+    Nd->LHS = Expr;
+    return Nd;
+}
+
+// 新建代码块，Body为语句链表
+Node *newOptBlock(Node *Body, Token *Tok) {
+    Node *Nd = calloc(1, sizeof(Node));
+    Nd->Kind = ND_BLOCK;
+    Nd->Tok = Tok;
+    Nd->Body = Body;
+    return Nd;
+}
+
+// 是否为二元运算，其两侧的求值顺序不定
+bool isBinaryOp(NodeKind Kind) {
+    switch (Kind) {
+        case ND_ADD:
+        case ND_SUB:
+        case ND_MUL:
+        case ND_DIV:
+        case ND_MOD:
+        case ND_SHL:
+        case ND_SHR:
+        case ND_BITAND:
+        case ND_BITOR:
+        case ND_BITXOR:
+        case ND_EQ:
+        case ND_NE:
+        case ND_LT:
+        case ND_LE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// 是否为没有副作用、不含控制流的表达式
+// 除零在RISC-V上不会产生异常，所以除法也是纯的
+bool isPureExpr(Node *Nd) {
+    if (!Nd)
+        return true;
+    switch (Nd->Kind) {
+        case ND_NUM:
+        case ND_VAR:
+            return true;
+        case ND_NEG:
+        case ND_NOT:
+        case ND_BITNOT:
+        case ND_CLZ:
+        case ND_CTZ:
+        case ND_POPCOUNT:
+        case ND_CAST:
+        case ND_DEREF:
+        case ND_ADDR:
+        case ND_MEMBER:
+            return isPureExpr(Nd->LHS);
+        default:
+            if (isBinaryOp(Nd->Kind))
+                return isPureExpr(Nd->LHS) && isPureExpr(Nd->RHS);
+            return false;
+    }
+}
+
+// 类型在寄存器中的表示是否相同
+static bool sameType(Type *A, Type *B) {
+    return A->Kind == B->Kind && A->Size == B->Size && A->IsUnsigned == B->IsUnsigned;
+}
+
+// 两个纯表达式是否计算相同的值
+bool sameExpr(Node *A, Node *B) {
+    if (A == B)
+        return true;
+    if (!A || !B || A->Kind != B->Kind || !sameType(A->Ty, B->Ty))
+        return false;
+
+    switch (A->Kind) {
+        case ND_NUM:
+            return A->Val == B->Val && !memcmp(&A->FVal, &B->FVal, sizeof(double));
+        case ND_VAR:
+            return A->Var == B->Var;
+        case ND_MEMBER:
+            return A->Mem->Offset == B->Mem->Offset && sameExpr(A->LHS, B->LHS);
+        default:
+            return sameExpr(A->LHS, B->LHS) && sameExpr(A->RHS, B->RHS);
+    }
+}
+
+// 估计纯表达式求值需要的指令数
+static int addrCost(Node *Nd);
+
+int exprCost(Node *Nd) {
+    if (!Nd)
+        return 0;
+    switch (Nd->Kind) {
+        // 常量池中的double需要lla(auipc+addi)再读取
+        case ND_NUM:
+            return inFConstPool(Nd) ? 3 : 1;
+        // 数组等聚合类型的值是其地址
+        // 全局变量的地址需要两条指令(auipc+addi)
+        case ND_VAR:
+            return (Nd->Var->IsLocal ? 1 : 2) + (isScalar(Nd->Ty) ? 1 : 0);
+        case ND_ADDR:
+            return addrCost(Nd->LHS);
+        case ND_DEREF:
+            return exprCost(Nd->LHS) + (isScalar(Nd->Ty) ? 1 : 0);
+        case ND_MEMBER:
+            return addrCost(Nd) + (isScalar(Nd->Ty) ? 1 : 0);
+        // 类型转换一般需要移位两次
+        case ND_CAST:
+            return exprCost(Nd->LHS) + 2;
+        default:
+            return exprCost(Nd->LHS) + exprCost(Nd->RHS) + 1;
+    }
+}
+
+// 估计计算左值地址需要的指令数
+static int addrCost(Node *Nd) {
+    switch (Nd->Kind) {
+        case ND_VAR:
+            return Nd->Var->IsLocal ? 1 : 2;
+        case ND_DEREF:
+            return exprCost(Nd->LHS);
+        case ND_MEMBER:
+            return addrCost(Nd->LHS) + 2;
+        default:
+            return exprCost(Nd);
+    }
+}
+
+//
+// 写集合
+//
+
+// 加入一个被赋值的变量
+void addKillVar(KillSet *KS, Obj *Var) {
+    if (!isRegVar(Var)) {
+        KS->Mem = true;
+        return;
+    }
+    for (int I = 0; I < KS->NumVars; I++)
+        if (KS->Vars[I] == Var)
+            return;
+    if (KS->NumVars == KS->Cap) {
+        KS->Cap = KS->Cap ? KS->Cap * 2 : 8;
+        KS->Vars = realloc(KS->Vars, sizeof(Obj *) * KS->Cap);
+    }
+    KS->Vars[KS->NumVars++] = Var;
+}
+
+// 加入一个被赋值的左值
+void addKillLValue(KillSet *KS, Node *LHS) {
+    Node *N = LHS;
+    while (N->Kind == ND_MEMBER)
+        N = N->LHS;
+    if (N->Kind == ND_VAR)
+        addKillVar(KS, N->Var);
+    else
+        KS->Mem = true;
+}
+
+// 收集一段代码中的所有写入
+static KillSet *CurKills;
+
+static void collectKill(Node *Nd) {
+    switch (Nd->Kind) {
+        case ND_ASSIGN:
+            addKillLValue(CurKills, Nd->LHS);
+            return;
+        case ND_FUNCALL:
+            CurKills->Mem = true;
+            return;
+        case ND_MEMZERO:
+            addKillVar(CurKills, Nd->Var);
+            return;
+        default:
+            return;
+    }
+}
+
+void collectKills(Node *Nd, KillSet *KS) {
+    KillSet *Saved = CurKills;
+    CurKills = KS;
+    forEachNode(Nd, collectKill);
+    CurKills = Saved;
+}
+
+// 是否有写入
+bool hasKills(KillSet *KS) {
+    return KS->Mem || KS->NumVars;
+}
+
+// 纯表达式是否读取了内存(而不仅是寄存器变量)
+// Addr表示Nd处于取地址的上下文中
+static bool readsMem2(Node *Nd, bool Addr) {
+    if (!Nd)
+        return false;
+    switch (Nd->Kind) {
+        case ND_NUM:
+            return false;
+        case ND_VAR:
+            return !Addr && isScalar(Nd->Ty) && !isRegVar(Nd->Var);
+        case ND_DEREF:
+            return (!Addr && isScalar(Nd->Ty)) || readsMem2(Nd->LHS, false);
+        case ND_MEMBER:
+            return (!Addr && isScalar(Nd->Ty)) || readsMem2(Nd->LHS, true);
+        case ND_ADDR:
+            return readsMem2(Nd->LHS, true);
+        default:
+            return readsMem2(Nd->LHS, false) || readsMem2(Nd->RHS, false);
+    }
+}
+
+bool readsMem(Node *Nd) {
+    return readsMem2(Nd, false);
+}
+
+// 纯表达式是否读取了变量Var的值
+static bool readsVar2(Node *Nd, Obj *Var, bool Addr) {
+    if (!Nd)
+        return false;
+    switch (Nd->Kind) {
+        case ND_NUM:
+            return false;
+        case ND_VAR:
+            return !Addr && Nd->Var == Var;
+        case ND_DEREF:
+            return readsVar2(Nd->LHS, Var, false);
+        case ND_MEMBER:
+        case ND_ADDR:
+            return readsVar2(Nd->LHS, Var, true);
+        default:
+            return readsVar2(Nd->LHS, Var, false) || readsVar2(Nd->RHS, Var, false);
+    }
+}
+
+bool readsVar(Node *Nd, Obj *Var) {
+    return readsVar2(Nd, Var, false);
+}
+
+// 纯表达式的值是否会被写集合中的写入改变
+bool isKilled(KillSet *KS, Node *Nd) {
+    if (KS->Mem && readsMem(Nd))
+        return true;
+    for (int I = 0; I < KS->NumVars; I++)
+        if (readsVar(Nd, KS->Vars[I]))
+            return true;
+    return false;
+}
@@ -0,0 +1,487 @@
+//! 循环向量化
+// 识别对数组逐元素计算的简单for循环，代码生成时将其变为RVV的strip-mining循环：
+// 每次由vsetvli得到本次处理的元素个数vl，归纳变量每次加vl，不需要标量的收尾循环
+//
+//      for (Init; i < End; i++) {      条件也可以是 i <= End
+//          a[i] = E;                   数组元素的赋值
+//          s = s op E;                 归约，op为 + & | ^
+//      }
+//
+// E中只能读取以i为下标的数组元素和循环中不变的值，所有数组元素的大小都相同
+// 不同的数组可能重叠时，在运行时检查，重叠则执行原来的循环
+#include "opt.h"
+
+// 当前分析的循环
+static VecLoop *Loop;
+// 循环体中的所有写入
+static KillSet Kills;
+
+// 循环中访问的数组
+typedef struct Access Access;
+struct Access {
+    Access *Next;
+    Node *Base;     // 数组基址
+    bool IsStore;   // 是否为写入
+};
+
+static Access *Accesses;
+// 运行时检查的最大数量，超过时重叠的可能太多，不进行向量化
+#define MAX_CHECKS 8
+
+// 整数或指针
+static bool isIntLike(Type *Ty) {
+    return isInteger(Ty) || Ty->Kind == TY_PTR;
+}
+
+// 去掉不改变值的类型转换：相同类型之间，或者整数(包括指针)的扩展
+static Node *peelCasts(Node *Nd) {
+    while (Nd->Kind == ND_CAST) {
+        Type *To = Nd->Ty, *From = Nd->LHS->Ty;
+        bool Same = To->Kind == From->Kind && To->Size == From->Size &&
+                    To->IsUnsigned == From->IsUnsigned;
+        bool Widen = isIntLike(To) && isIntLike(From) && To->Kind != TY_BOOL &&
+                     To->Size >= From->Size;
+        if (!Same && !Widen)
+            break;
+        Nd = Nd->LHS;
+    }
+    return Nd;
+}
+
+// 是否为常数Val
+static bool isNum(Node *Nd, int64_t Val) {
+    Nd = peelCasts(Nd);
+    return Nd->Kind == ND_NUM && Nd->Val == Val;
+}
+
+// 是否为读取变量Var
+static bool isVarOf(Node *Nd, Obj *Var) {
+    Nd = peelCasts(Nd);
+    return Nd->Kind == ND_VAR && Nd->Var == Var;
+}
+
+// 以Iv为下标的数组元素 *(Base + Iv * Size)，返回其基址
+Node *vecBase(Node *Nd, Obj *Iv) {
+    if (Nd->Kind != ND_DEREF || !isScalar(Nd->Ty))
+        return NULL;
+    Node *Add = peelCasts(Nd->LHS);
+    if (Add->Kind != ND_ADD || !Add->LHS->Ty->Base)
+        return NULL;
+    Node *Mul = peelCasts(Add->RHS);
+    if (Mul->Kind != ND_MUL || !isNum(Mul->RHS, Nd->Ty->Size) || !isVarOf(Mul->LHS, Iv))
+        return NULL;
+    return Add->LHS;
+}
+
+// 循环中不变的值，只需在循环外(或每次vsetvli后)求值一次
+static bool isInvariant(Node *Nd) {
+    return isPureExpr(Nd) && isScalar(Nd->Ty) && !readsVar(Nd, Loop->Iv) &&
+           !isKilled(&Kills, Nd);
+}
+
+// 记录一次数组访问，元素大小决定了向量元素的宽度
+static bool addAccess(Node *Nd, bool IsStore) {
+    Node *Base = vecBase(Nd, Loop->Iv);
+    if (!Base || !isInvariant(Base))
+        return false;
+    if (!Loop->SEW)
+        Loop->SEW = Nd->Ty->Size;
+    if (Nd->Ty->Size != Loop->SEW)
+        return false;
+
+    Access *A = calloc(1, sizeof(Access));
+    A->Base = Base;
+    A->IsStore = IsStore;
+    A->Next = Accesses;
+    Accesses = A;
+    return true;
+}
+
+// 右移被提升过的窄类型时，结果的低位只与原类型的符号有关
+// 返回右移时应当使用的类型，不能向量化时返回NULL
+static Type *shrType(Node *LHS) {
+    if (LHS->Ty->Size == Loop->SEW)
+        return LHS->Ty;
+    if (LHS->Kind == ND_CAST && LHS->LHS->Ty->Size == Loop->SEW && isInteger(LHS->LHS->Ty))
+        return LHS->LHS->Ty;
+    return NULL;
+}
+
+// 检查表达式能否按元素计算，返回需要的向量寄存器组数，不能时返回-1
+// 整数运算在SEW位上进行，结果最终会被截断到元素的大小，所以加减乘、位运算和左移
+// 可以忽略中间的整数提升
+static int vecNeed(Node *Nd) {
+    if (isInvariant(Nd))
+        return 1;
+    if (vecBase(Nd, Loop->Iv))
+        return addAccess(Nd, false) ? 1 : -1;
+
+    bool Flo = isFloNum(Nd->Ty);
+    if (Flo ? Nd->Ty->Size != Loop->SEW || !Loop->SEW
+            : !isInteger(Nd->Ty) || Nd->Ty->Kind == TY_BOOL)
+        return -1;
+
+    switch (Nd->Kind) {
+        case ND_CAST:
+            // 浮点数只允许相同类型间的转换
+            if (Flo ? Nd->LHS->Ty->Kind != Nd->Ty->Kind : !isInteger(Nd->LHS->Ty))
+                return -1;
+            // 整数转换的两侧都不能窄于元素
+            if (!Flo && (Nd->Ty->Size < Loop->SEW || Nd->LHS->Ty->Size < Loop->SEW))
+                return -1;
+            return vecNeed(Nd->LHS);
+        case ND_NEG:
+        case ND_BITNOT:
+            return Flo ? -1 : vecNeed(Nd->LHS);
+        case ND_ADD:
+        case ND_SUB:
+        case ND_MUL:
+            break;
+        // 没有用标量作被除数的指令
+        case ND_DIV:
+            if (!Flo || isInvariant(Nd->LHS))
+                return -1;
+            break;
+        case ND_BITAND:
+        case ND_BITOR:
+        case ND_BITXOR:
+            if (Flo)
+                return -1;
+            break;
+        case ND_SHL:
+        case ND_SHR: {
+            // 移位量必须不变，提升过的窄类型还要求移位量小于元素的位数
+            if (Flo || !isInvariant(Nd->RHS))
+                return -1;
+            if (Nd->LHS->Ty->Size > Loop->SEW) {
+                Node *Amt = peelCasts(Nd->RHS);
+                if (Amt->Kind != ND_NUM || Amt->Val < 0 || Amt->Val >= Loop->SEW * 8)
+                    return -1;
+            }
+            if (Nd->Kind == ND_SHR && !shrType(Nd->LHS))
+                return -1;
+            return vecNeed(Nd->LHS);
+        }
+        default:
+            return -1;
+    }
+
+    // 一侧不变时，使用标量操作数的指令形式
+    if (isInvariant(Nd->RHS))
+        return vecNeed(Nd->LHS);
+    if (isInvariant(Nd->LHS))
+        return vecNeed(Nd->RHS);
+    int L = vecNeed(Nd->LHS);
+    int R = vecNeed(Nd->RHS);
+    if (L < 0 || R < 0)
+        return -1;
+    return MAX(L, R + 1);
+}
+
+// 是否为可以向量化的元素类型
+static bool vecType(Type *Ty) {
+    return (isInteger(Ty) && Ty->Kind != TY_BOOL) || isFloNum(Ty);
+}
+
+// 检查赋值语句，Assign为规范化后的 a[i] = E 或 s = s op E
+static bool vecAssign(Node *Assign) {
+    Node *LHS = Assign->LHS;
+    if (!vecType(LHS->Ty))
+        return false;
+
+    // a[i] = E
+    if (vecBase(LHS, Loop->Iv)) {
+        if (!addAccess(LHS, true))
+            return false;
+        // 赋值时的类型转换同样需要满足vecNeed的要求
+        int N = vecNeed(Assign->RHS);
+        return N > 0 && N <= VEC_GROUPS;
+    }
+
+    // s = s op E
+    if (LHS->Kind != ND_VAR || !isRegVar(LHS->Var) || LHS->Var == Loop->Iv)
+        return false;
+    if (Loop->NumRed == VEC_MAX_RED)
+        return false;
+    Obj *S = LHS->Var;
+    Node *Op = Assign->RHS;
+    Op = peelCasts(Op);
+    switch (Op->Kind) {
+        case ND_ADD:
+            break;
+        case ND_BITAND:
+        case ND_BITOR:
+        case ND_BITXOR:
+            if (isFloNum(S->Ty))
+                return false;
+            break;
+        default:
+            return false;
+    }
+    // 累加不会被截断，所以s和运算的类型都要与元素一样宽
+    if (!Loop->SEW)
+        Loop->SEW = S->Ty->Size;
+    if (S->Ty->Size != Loop->SEW || Op->Ty->Size != Loop->SEW ||
+        isFloNum(Op->Ty) != isFloNum(S->Ty))
+        return false;
+
+    Node *E;
+    if (isVarOf(Op->LHS, S))
+        E = Op->RHS;
+    else if (isVarOf(Op->RHS, S))
+        E = Op->LHS;
+    else
+        return false;
+    if (readsVar(E, S))
+        return false;
+    int N = vecNeed(E);
+    if (N <= 0 || N > VEC_GROUPS)
+        return false;
+    Loop->NumRed++;
+
+    // 改为运算节点 s op= E
+    Node *Next = Assign->Next;
+    *Assign = *Op;
+    Assign->LHS = LHS;
+    Assign->RHS = E;
+    Assign->Next = Next;
+    return true;
+}
+
+// 将语句规范化为赋值，不是赋值时返回NULL
+//      Tmp = &X, *Tmp = *Tmp op E  =>  X = X op E
+static Node *toVecAssign(Node *Nd) {
+    if (Nd->Kind == ND_ASSIGN)
+        return copyNode(Nd);
+    if (Nd->Kind != ND_COMMA)
+        return NULL;
+
+    Node *Set = Nd->LHS, *Upd = Nd->RHS;
+    if (Set->Kind != ND_ASSIGN || Set->LHS->Kind != ND_VAR ||
+        Upd->Kind != ND_ASSIGN || Upd->LHS->Kind != ND_DEREF)
+        return NULL;
+    Node *Addr = peelCasts(Set->RHS);
+    if (Addr->Kind != ND_ADDR)
+        return NULL;
+    Obj *Tmp = Set->LHS->Var;
+    Node *X = Addr->LHS;
+    if (!isVarOf(Upd->LHS->LHS, Tmp) || !isPureExpr(X))
+        return NULL;
+
+    // 复制运算节点，将其中的*Tmp换为X
+    Node *RHS = copyNode(Upd->RHS);
+    Node *Op = RHS;
+    if (Op->Kind == ND_CAST)
+        Op = RHS->LHS = copyNode(RHS->LHS);
+    if (!isBinaryOp(Op->Kind) || readsVar(Op->RHS, Tmp))
+        return NULL;
+    // *Tmp外面可能还有一层整数提升
+    Node **Ref = &Op->LHS;
+    if ((*Ref)->Kind == ND_CAST) {
+        *Ref = copyNode(*Ref);
+        Ref = &(*Ref)->LHS;
+    }
+    if ((*Ref)->Kind != ND_DEREF || !isVarOf((*Ref)->LHS, Tmp))
+        return NULL;
+    *Ref = X;
+
+    Node *Assign = copyNode(Upd);
+    Assign->LHS = X;
+    Assign->RHS = RHS;
+    return Assign;
+}
+
+// 收集循环体中的赋值语句，有其他语句时返回false
+static bool collectStmts(Node *Nd, Node **Cur) {
+    switch (Nd->Kind) {
+        case ND_BLOCK:
+            for (Node *N = Nd->Body; N; N = N->Next)
+                if (!collectStmts(N, Cur))
+                    return false;
+            return true;
+        case ND_EXPR_STMT: {
+            Node *Assign = toVecAssign(Nd->LHS);
+            if (!Assign)
+                return false;
+            *Cur = (*Cur)->Next = Assign;
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+// 递增语句为 i = i + 1，或者后置的 (i = i + 1) - 1，返回i
+static Obj *incVar(Node *Inc) {
+    Inc = peelCasts(Inc);
+    if (Inc->Kind == ND_ADD && isNum(Inc->RHS, -1))
+        Inc = peelCasts(Inc->LHS);
+    if (Inc->Kind != ND_ASSIGN || Inc->LHS->Kind != ND_VAR)
+        return NULL;
+    Obj *Var = Inc->LHS->Var;
+    Node *Add = peelCasts(Inc->RHS);
+    if (Add->Kind != ND_ADD || !isVarOf(Add->LHS, Var) || !isNum(Add->RHS, 1))
+        return NULL;
+    return Var;
+}
+
+// 两个基址是否一定是不同的数组
+static bool distinct(Node *A, Node *B) {
+    return A->Kind == ND_VAR && B->Kind == ND_VAR && A->Var != B->Var &&
+           A->Ty->Kind == TY_ARRAY && B->Ty->Kind == TY_ARRAY;
+}
+
+// 为可能重叠的写入和其他访问加入运行时检查
+static bool addChecks(void) {
+    int N = 0;
+    for (Access *S = Accesses; S; S = S->Next) {
+        if (!S->IsStore)
+            continue;
+        for (Access *X = Accesses; X; X = X->Next) {
+            // 两次写入之间只需检查一次
+            if (X == S || (X->IsStore && X < S) || sameExpr(S->Base, X->Base) ||
+                distinct(S->Base, X->Base))
+                continue;
+
+            bool Dup = false;
+            for (VecCheck *C = Loop->Checks; C; C = C->Next)
+                if ((sameExpr(C->A, S->Base) && sameExpr(C->B, X->Base)) ||
+                    (sameExpr(C->A, X->Base) && sameExpr(C->B, S->Base)))
+                    Dup = true;
+            if (Dup)
+                continue;
+            if (++N > MAX_CHECKS)
+                return false;
+
+            VecCheck *C = calloc(1, sizeof(VecCheck));
+            C->A = S->Base;
+            C->B = X->Base;
+            C->Next = Loop->Checks;
+            Loop->Checks = C;
+        }
+    }
+    return true;
+}
+
+// 检查循环能否向量化
+static bool vecLoop(Node *Nd) {
+    if (!Nd->Cond || !Nd->Inc || !Nd->Then)
+        return false;
+
+    Obj *Iv = incVar(Nd->Inc);
+    if (!Iv || !isRegVar(Iv) || !isInteger(Iv->Ty) || Iv->Ty->Size < 4)
+        return false;
+    Loop->Iv = Iv;
+
+    Node Head = {};
+    Node *Cur = &Head;
+    if (!collectStmts(Nd->Then, &Cur) || !Head.Next)
+        return false;
+    Loop->Stmts = Head.Next;
+
+    collectKills(Nd->Then, &Kills);
+    for (int I = 0; I < Kills.NumVars; I++)
+        if (Kills.Vars[I] == Iv)
+            return false;
+
+    // 条件为 i < End 或 i <= End，End在循环中不变
+    Node *Cond = Nd->Cond;
+    if ((Cond->Kind != ND_LT && Cond->Kind != ND_LE) || !isInteger(Cond->LHS->Ty) ||
+        !isVarOf(Cond->LHS, Iv) || !isInvariant(Cond->RHS))
+        return false;
+    Loop->Cond = Cond;
+
+    for (Node *S = Loop->Stmts; S; S = S->Next)
+        if (!vecAssign(S))
+            return false;
+
+    // 归约变量只能在自己的语句中出现
+    for (Node *S = Loop->Stmts; S; S = S->Next) {
+        if (S->LHS->Kind != ND_VAR)
+            continue;
+        for (Node *T = Loop->Stmts; T; T = T->Next)
+            if (T != S && (readsVar(T->RHS, S->LHS->Var) ||
+                           (T->LHS->Kind == ND_VAR && T->LHS->Var == S->LHS->Var)))
+                return false;
+    }
+    return addChecks();
+}
+
+// 遍历语句，找出可以向量化的循环
+static void vectorizeStmt(Node *Nd);
+
+// 表达式中的语句表达式(例如内联的函数体)也可能含有循环
+static void vectorizeExpr(Node *Nd) {
+    if (!Nd)
+        return;
+
+    if (Nd->Kind == ND_STMT_EXPR) {
+        for (Node *N = Nd->Body; N; N = N->Next)
+            vectorizeStmt(N);
+        return;
+    }
+    vectorizeExpr(Nd->LHS);
+    vectorizeExpr(Nd->RHS);
+    vectorizeExpr(Nd->Cond);
+    vectorizeExpr(Nd->Then);
+    vectorizeExpr(Nd->Els);
+    for (Node *Arg = Nd->Args; Arg; Arg = Arg->Next)
+        vectorizeExpr(Arg);
+}
+
+static void vectorizeStmt(Node *Nd) {
+    if (!Nd)
+        return;
+
+    switch (Nd->Kind) {
+        case ND_BLOCK:
+            for (Node *N = Nd->Body; N; N = N->Next)
+                vectorizeStmt(N);
+            return;
+        case ND_IF:
+            vectorizeExpr(Nd->Cond);
+            vectorizeStmt(Nd->Then);
+            vectorizeStmt(Nd->Els);
+            return;
+        case ND_SWITCH:
+            vectorizeExpr(Nd->Cond);
+            vectorizeStmt(Nd->Then);
+            return;
+        case ND_CASE:
+        case ND_LABEL:
+            vectorizeStmt(Nd->LHS);
+            return;
+        case ND_DO:
+            vectorizeStmt(Nd->Then);
+            vectorizeExpr(Nd->Cond);
+            return;
+        case ND_FOR: {
+            vectorizeStmt(Nd->Init);
+            Loop = calloc(1, sizeof(VecLoop));
+            Kills = (KillSet){0};
+            Accesses = NULL;
+            bool Ok = vecLoop(Nd);
+            free(Kills.Vars);
+            if (Ok) {
+                Nd->Vec = Loop;
+                return;
+            }
+            free(Loop);
+            vectorizeExpr(Nd->Cond);
+            vectorizeStmt(Nd->Then);
+            vectorizeExpr(Nd->Inc);
+            return;
+        }
+        case ND_EXPR_STMT:
+        case ND_RETURN:
+            vectorizeExpr(Nd->LHS);
+            return;
+        default:
+            return;
+    }
+}
+
+// 对函数中的循环进行向量化
+void vectorize(Obj *Fn) {
+    vectorizeStmt(Fn->Body);
+}
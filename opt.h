@@ -0,0 +1,53 @@
+//! 优化阶段用到的数据结构和公共函数
+#include"rvcc.h"
+
+//
+// 写集合
+//
+
+// 一段代码可能写入的对象，用来判断表达式的值是否失效
+typedef struct KillSet KillSet;
+struct KillSet {
+    bool Mem;       // 写了内存(全局变量、取过地址的变量、解引用)或有函数调用
+    Obj **Vars;     // 被直接赋值的局部变量
+    int NumVars;    // Vars的个数
+    int Cap;        // Vars的容量
+};
+
+//
+// helper functions
+//
+
+// ---------- variables ----------
+
+bool isScalar(Type *Ty);
+bool isRegVar(Obj *Var);
+void markAddrTaken(Obj *Fn);
+Obj *newTempVar(Obj *Fn, Type *Ty);
+
+// ---------- nodes ----------
+
+Node *copyNode(Node *Nd);
+Node *newOptVar(Obj *Var, Token *Tok);
+Node *newOptAssign(Obj *Var, Node *Expr);
+Node *newOptExprStmt(Node *Expr);
+Node *newOptBlock(Node *Body, Token *Tok);
+bool isBinaryOp(NodeKind Kind);
+int exprCost(Node *Nd);
+
+// ---------- kill sets ----------
+
+void addKillVar(KillSet *KS, Obj *Var);
+void addKillLValue(KillSet *KS, Node *LHS);
+void collectKills(Node *Nd, KillSet *KS);
+bool hasKills(KillSet *KS);
+bool readsMem(Node *Nd);
+bool readsVar(Node *Nd, Obj *Var);
+bool isKilled(KillSet *KS, Node *Nd);
+
+// ---------- passes ----------
+
+void inlineFuncs(Obj *Prog);
+void cse(Obj *Fn);
+void licm(Obj *Fn);
+void vectorize(Obj *Fn);
@@ -120,7 +120,9 @@
 //              | structDecl | unionDecl | typedefName
 //              | enumSpecifier
 //              | "const" | "volatile" | "auto" | "register" | "restrict"
-//              | "__restrict" | "__restrict__" | "_Noreturn")+
+//              | "__restrict" | "__restrict__" | "_Noreturn"
+//              | "inline" | attribute)+
+// attribute = "__attribute__" "(" "(" (ident ("(" ... ")")?)? ("," ...)* ")" ")"
 
 
 // enumSpecifier = ident? "{" enumList? "}"
@@ -199,6 +201,7 @@
 //         | num
 //         | "sizeof" "(typeName)"
 //         | "_Alignof" unary
+//         | bitBuiltin "(" assign ")"
 
 // typeName = declspec abstractDeclarator
 // abstractDeclarator = "*"* ("(" abstractDeclarator ")")? typeSuffix
@@ -209,6 +212,7 @@
 static Token *function(Token *Tok, Type *BaseTy, VarAttr *Attr);
 static Node *declaration(Token **Rest, Token *Tok, Type *BaseTy, VarAttr *Attr);
 static Type *declspec(Token **Rest, Token *Tok, VarAttr *Attr);
+static Token *attribute(Token *Tok, VarAttr *Attr);
 static Type *typename(Token **Rest, Token *Tok);
 static Type *enumSpecifier(Token **Rest, Token *Tok);
 static Type *structDecl(Token **Rest, Token *Tok);
@@ -299,6 +303,10 @@ static Token *function(Token *Tok, Type *BaseTy, VarAttr *Attr) {
     // functions are also global variables
     Obj *Fn = newGVar(getIdent(Ty->Name), Ty);
     Fn->IsStatic = Attr->IsStatic;
+    Fn->IsInline = Attr->IsInline;
+    Fn->IsAlwaysInline = Attr->IsAlwaysInline;
+    Fn->IsNoInline = Attr->IsNoInline;
+    Fn->IsNoreturn = Attr->IsNoreturn;
     Fn->IsDefinition = !consume(&Tok, Tok, ";");
     // no function body, just a defination
     if(!Fn->IsDefinition)
@@ -316,6 +324,10 @@ static Token *function(Token *Tok, Type *BaseTy, VarAttr *Attr) {
     if (Ty->IsVariadic)
         Fn->VaArea = newLVar("__va_area__", arrayOf(TyChar, 64));
 
+    // 返回较大的结构体时，a0中传入存放返回值的地址
+    if (isStructOrUnion(Ty->ReturnTy) && Ty->ReturnTy->Size > 16)
+        Fn->RetPtr = newLVar("", pointerTo(Ty->ReturnTy));
+
     // 函数体存储语句的AST，Locals存储变量
     Fn->Body = compoundStmt(&Tok, Tok);
     Fn->Locals = Locals;
@@ -326,6 +338,43 @@ static Token *function(Token *Tok, Type *BaseTy, VarAttr *Attr) {
 }
 
 
+// attribute = "__attribute__" "(" "(" (ident ("(" ... ")")?)? ("," ...)* ")" ")"
+// 只识别always_inline、noinline和noreturn，其余的属性被忽略
+static Token *attribute(Token *Tok, VarAttr *Attr) {
+    Tok = skip(Tok->Next, "(");
+    Tok = skip(Tok, "(");
+    while (!equal(Tok, ")")) {
+        if (Tok->Kind == TK_EOF)
+            errorTok(Tok, "unterminated __attribute__");
+        if (Attr && equal2(Tok, 2, (char*[]){"always_inline", "__always_inline__"}))
+            Attr->IsAlwaysInline = true;
+        if (Attr && equal2(Tok, 2, (char*[]){"noinline", "__noinline__"}))
+            Attr->IsNoInline = true;
+        if (Attr && equal2(Tok, 2, (char*[]){"noreturn", "__noreturn__"}))
+            Attr->IsNoreturn = true;
+
+        // 跳过属性的参数
+        Tok = Tok->Next;
+        if (equal(Tok, "(")) {
+            int Depth = 0;
+            do {
+                if (Tok->Kind == TK_EOF)
+                    errorTok(Tok, "unterminated __attribute__");
+                if (equal(Tok, "("))
+                    Depth++;
+                else if (equal(Tok, ")"))
+                    Depth--;
+                Tok = Tok->Next;
+            } while (Depth);
+        }
+
+        if (!equal(Tok, ")"))
+            Tok = skip(Tok, ",");
+    }
+    Tok = skip(Tok, ")");
+    return skip(Tok, ")");
+}
+
 // declspec = ("int" | "char" | "long" | "short" | "void"  | "_Bool"
 //              | "typedef" | "static" | "extern"
 //              | "signed" | "unsigned"
@@ -333,7 +382,8 @@ static Token *function(Token *Tok, Type *BaseTy, VarAttr *Attr) {
 //              | structDecl | unionDecl | typedefName
 //              | enumSpecifier
 //              | "const" | "volatile" | "auto" | "register" | "restrict"
-//              | "__restrict" | "__restrict__" | "_Noreturn")+
+//              | "__restrict" | "__restrict__" | "_Noreturn"
+//              | "inline" | attribute)+
 // 声明的 基础类型. declaration specifiers
 static Type *declspec(Token **Rest, Token *Tok, VarAttr *Attr) {
     // 类型的组合，被表示为例如：LONG+LONG=1<<9
@@ -378,13 +428,33 @@ static Type *declspec(Token **Rest, Token *Tok, VarAttr *Attr) {
 
         char * dontcare[] = 
             {"const", "volatile", "auto", "register", "restrict",
-                "__restrict", "__restrict__", "_Noreturn"
+                "__restrict", "__restrict__"
             };
         if(equal2(Tok, sizeof(dontcare) / sizeof(*dontcare), dontcare)){
             Tok = Tok->Next;
             continue;
         }
 
+        // 不返回的函数，调用它的分支很少执行
+        if (equal(Tok, "_Noreturn")) {
+            if (Attr)
+                Attr->IsNoreturn = true;
+            Tok = Tok->Next;
+            continue;
+        }
+
+        // 函数说明符和属性，只在内联时使用
+        if (equal2(Tok, 3, (char*[]){"inline", "__inline", "__inline__"})) {
+            if (Attr)
+                Attr->IsInline = true;
+            Tok = Tok->Next;
+            continue;
+        }
+        if (equal(Tok, "__attribute__")) {
+            Tok = attribute(Tok, Attr);
+            continue;
+        }
+
         // _Alignas "(" typeName | constExpr ")"
         if (equal(Tok, "_Alignas")) {
             // 不存在变量属性时，无法设置对齐值
@@ -1308,8 +1378,81 @@ static Node *expr(Token **Rest, Token *Tok) {
     return Nd;
 }
 
+static bool isSimpleLValue(Node *Nd);
+
+// 地址表达式是否没有副作用: 由变量、常量、成员访问、解引用和算术运算构成，如a[i]的a + i
+static bool isPureAddr(Node *Nd) {
+    switch (Nd->Kind) {
+        case ND_VAR:
+        case ND_NUM:
+            return true;
+        case ND_CAST:
+            return isPureAddr(Nd->LHS);
+        case ND_ADD:
+        case ND_SUB:
+        case ND_MUL:
+            return isPureAddr(Nd->LHS) && isPureAddr(Nd->RHS);
+        case ND_ADDR:
+        case ND_MEMBER:
+        case ND_DEREF:
+            return isSimpleLValue(Nd->Kind == ND_ADDR ? Nd->LHS : Nd);
+        default:
+            return false;
+    }
+}
+
+// 左值A是否可以安全地求值两次: 变量，或者由变量构成的成员访问、解引用
+static bool isSimpleLValue(Node *Nd) {
+    switch (Nd->Kind) {
+        case ND_VAR:
+            return true;
+        case ND_MEMBER:
+            return isSimpleLValue(Nd->LHS);
+        case ND_DEREF:
+            return isPureAddr(Nd->LHS);
+        default:
+            return false;
+    }
+}
+
+// 左值A的地址是否固定，即不读取任何变量的值
+static bool isFixedLValue(Node *Nd) {
+    if (Nd->Kind == ND_MEMBER)
+        return isFixedLValue(Nd->LHS);
+    return Nd->Kind == ND_VAR;
+}
+
+// 表达式是否可能有副作用: 赋值、函数调用或语句表达式
+static bool hasSideEffect(Node *Nd) {
+    if (!Nd)
+        return false;
+    switch (Nd->Kind) {
+        case ND_ASSIGN:
+        case ND_FUNCALL:
+        case ND_STMT_EXPR:
+        case ND_MEMZERO:
+            return true;
+        default:
+            return hasSideEffect(Nd->LHS) || hasSideEffect(Nd->RHS) ||
+                   hasSideEffect(Nd->Cond) || hasSideEffect(Nd->Then) ||
+                   hasSideEffect(Nd->Els);
+    }
+}
+
+// 复制isSimpleLValue的左值A，AST中的节点不能共用
+static Node *copyLValue(Node *Nd) {
+    Node *Cp = calloc(1, sizeof(Node));
+    *Cp = *Nd;
+    if (Nd->LHS)
+        Cp->LHS = copyLValue(Nd->LHS);
+    if (Nd->RHS)
+        Cp->RHS = copyLValue(Nd->RHS);
+    return Cp;
+}
+
 // 转换 A op= B为 TMP = &A, *TMP = *TMP op B
 // let the result be reflected in A
+// A没有副作用时直接转换为 A = A op B，避免A的地址被取出
 static Node *toAssign(Node *Binary) {
     // A
     addType(Binary->LHS);
@@ -1317,6 +1460,12 @@ static Node *toAssign(Node *Binary) {
     addType(Binary->RHS);
     Token *Tok = Binary->Tok;
 
+    // A = A op B
+    // 地址依赖于变量时，B不能有副作用，否则两次求出的地址可能不同
+    if (isSimpleLValue(Binary->LHS) &&
+        (isFixedLValue(Binary->LHS) || !hasSideEffect(Binary->RHS)))
+        return newBinary(ND_ASSIGN, copyLValue(Binary->LHS), Binary, Tok);
+
     // TMP
     Obj *Var = newLVar("", pointerTo(Binary->LHS->Ty));
 
@@ -1634,8 +1783,8 @@ static Node *cast(Token **Rest, Token *Tok) {
         if (equal(Tok, "{"))
             return unary(Rest, Start);
 
-        // 解析嵌套的类型转换
-        Node *Nd = newCast(cast(Rest, Tok), Ty);
+        // 解析嵌套的类型转换，显式的转换结果不是左值，总是需要转换节点
+        Node *Nd = newCastNode(cast(Rest, Tok), Ty);
         Nd->Tok = Start;
         return Nd;
     }
@@ -1823,8 +1972,6 @@ static Node *funCall(Token **Rest, Token *Tok, Node *Fn) {
         addType(Arg);
 
         if (ParamTy) {
-            if (ParamTy->Kind == TY_STRUCT || ParamTy->Kind == TY_UNION)
-                errorTok(Arg->Tok, "passing struct or union is not supported yet");
             // 将参数节点的类型进行转换
             Arg = newCast(Arg, ParamTy);
             // 前进到下一个形参类型
@@ -1834,6 +1981,13 @@ static Node *funCall(Token **Rest, Token *Tok, Node *Fn) {
             // 若无形参类型，浮点数会被提升为double
             Arg = newCast(Arg, TyDouble);
         }
+        // 较大的结构体通过地址传递，被调函数可以修改它，所以先复制一份
+        if (isStructOrUnion(Arg->Ty) && Arg->Ty->Size > 16) {
+            Obj *Var = newLVar("", Arg->Ty);
+            Node *Copy = newBinary(ND_ASSIGN, newVarNode(Var, Tok), Arg, Tok);
+            Arg = newBinary(ND_COMMA, Copy, newVarNode(Var, Tok), Tok);
+            addType(Arg);
+        }
         // 对参数进行存储
         Cur->Next = Arg;
 
@@ -1847,6 +2001,9 @@ static Node *funCall(Token **Rest, Token *Tok, Node *Fn) {
     Nd->Args = Head.Next;
     Nd->FuncType = Ty;
     Nd->Ty = Ty->ReturnTy;
+    // 返回的结构体存入调用者的局部变量中
+    if (isStructOrUnion(Nd->Ty))
+        Nd->RetBuffer = newLVar("", Nd->Ty);
 
     return newCast(Nd, Ty->ReturnTy);
 }
@@ -1882,6 +2039,23 @@ static Type *typename(Token **Rest, Token *Tok) {
 }
 
 
+// 位计数的内建函数，后缀为l或ll时参数为unsigned long，否则为unsigned int
+static struct {
+    char *Name;
+    NodeKind Kind;
+    bool IsLong;
+} BitBuiltins[] = {
+    {"__builtin_clz", ND_CLZ, false},
+    {"__builtin_clzl", ND_CLZ, true},
+    {"__builtin_clzll", ND_CLZ, true},
+    {"__builtin_ctz", ND_CTZ, false},
+    {"__builtin_ctzl", ND_CTZ, true},
+    {"__builtin_ctzll", ND_CTZ, true},
+    {"__builtin_popcount", ND_POPCOUNT, false},
+    {"__builtin_popcountl", ND_POPCOUNT, true},
+    {"__builtin_popcountll", ND_POPCOUNT, true},
+};
+
 // 解析括号、数字
 // primary = "(" "{" stmt+ "}" ")"
 //         | "(" expr ")"
@@ -1891,6 +2065,7 @@ static Type *typename(Token **Rest, Token *Tok) {
 //         | num
 //         | "_Alignof" "(" typeName ")"
 //         | "_Alignof" unary
+//         | bitBuiltin "(" assign ")"
 // FuncArgs = "(" (expr ("," expr)*)? ")"
 static Node *primary(Token **Rest, Token *Tok) {
     // this needs to be parsed before "(" expr ")", otherwise the "(" will be consumed
@@ -1898,7 +2073,11 @@ static Node *primary(Token **Rest, Token *Tok) {
     if (equal(Tok, "(") && equal(Tok->Next, "{")) {
         // This is a GNU statement expresssion.
         Node *Nd = newNode(ND_STMT_EXPR, Tok);
+        Obj *Outer = Locals;
         Nd->Body = compoundStmt(&Tok, Tok->Next)->Body;
+        // 语句表达式的值可能是其中变量的地址(如结构体)，这些变量存活到外层的域结束
+        for (Obj *Var = Locals; Var != Outer; Var = Var->Next)
+            Var->LiveEnd = 0;
         *Rest = skip(Tok, ")");
         return Nd;
     }
@@ -1960,6 +2139,44 @@ static Node *primary(Token **Rest, Token *Tok) {
         return newULong(Nd->Ty->Align, Tok);
     }
 
+    // "__builtin_clz" "(" assign ")"等位计数的内建函数
+    if (Tok->Kind == TK_IDENT) {
+        for (int I = 0; I < sizeof(BitBuiltins) / sizeof(*BitBuiltins); I++) {
+            if (!equal(Tok, BitBuiltins[I].Name))
+                continue;
+            Token *Start = Tok;
+            Tok = skip(Tok->Next, "(");
+            Node *Arg = newCast(assign(&Tok, Tok), BitBuiltins[I].IsLong ? TyULong : TyUInt);
+            Node *Nd = newUnary(BitBuiltins[I].Kind, Arg, Start);
+            Nd->Ty = TyInt;
+            *Rest = skip(Tok, ")");
+            return Nd;
+        }
+    }
+
+    // "__builtin_expect" "(" assign "," constExpr ")"
+    // "__builtin_expect_with_probability" "(" assign "," constExpr "," assign ")"
+    // 值为第一个参数，并提示它很可能(以给定的概率)等于第二个参数
+    if (equal(Tok, "__builtin_expect") || equal(Tok, "__builtin_expect_with_probability")) {
+        bool WithProb = equal(Tok, "__builtin_expect_with_probability");
+        Tok = skip(Tok->Next, "(");
+        Node *Nd = newCastNode(assign(&Tok, Tok), TyLong);
+        Tok = skip(Tok, ",");
+        bool NonZero = constExpr(&Tok, Tok) != 0;
+        // 值为真的概率
+        double Prob = NonZero ? 1 : 0;
+        if (WithProb) {
+            Tok = skip(Tok, ",");
+            double P = evalDouble(assign(&Tok, Tok));
+            if (P < 0 || P > 1)
+                errorTok(Tok, "probability must be in [0, 1]");
+            Prob = NonZero ? P : 1 - P;
+        }
+        Nd->Expect = Prob > 0.5 ? 1 : Prob < 0.5 ? -1 : 0;
+        *Rest = skip(Tok, ")");
+        return Nd;
+    }
+
     // ident
     if (Tok->Kind == TK_IDENT) {
         VarScope *S = findVar(Tok);
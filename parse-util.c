@@ -14,10 +14,14 @@ extern Node *Labels;
 // 所有的域的链表
 extern Scope *Scp;
 
+// 进入、离开域时递增的时刻，用来划分局部变量的生存期
+static int ScopeClock;
+
 // 进入域
 // insert from head，后来加入的会先被移除出去。 其实也就是越深的作用域存活时间越短
 void enterScope(void) {
     Scope *S = calloc(1, sizeof(Scope));
+    S->Begin = ++ScopeClock;
     // 后来的在链表头部
     // 类似于栈的结构，栈顶对应最近的域
     S->Next = Scp;
@@ -26,6 +30,11 @@ void enterScope(void) {
 
 // 结束当前域
 void leaveScope(void) {
+    // 在此域内声明的局部变量都在Locals的头部，此时结束生存期
+    ScopeClock++;
+    for (Obj *Var = Locals; Var && Var->LiveBegin >= Scp->Begin; Var = Var->Next)
+        if (!Var->LiveEnd)
+            Var->LiveEnd = ScopeClock;
     Scp = Scp->Next;
 }
 
@@ -78,6 +87,7 @@ Obj *newVar(char *Name, Type *Ty) {
 Obj *newLVar(char *Name, Type *Ty) {
     Obj *Var = newVar(Name, Ty);
     Var->IsLocal = true;
+    Var->LiveBegin = Scp->Begin;
     // 将变量插入头部
     Var->Next = Locals;
     Var->IsDefinition = true;
@@ -161,6 +171,7 @@ bool isTypename(Token *Tok)
             "static", "extern", "_Alignas", "signed", "unsigned",
             "const", "volatile", "auto", "register", 
             "restrict", "__restrict", "__restrict__", "_Noreturn",
+            "inline", "__inline", "__inline__", "__attribute__",
         };
 
     return equal2(Tok, sizeof(types) / sizeof(*types), types) || findTypedef(Tok);
@@ -317,8 +328,8 @@ Token *globalVariable(Token *Tok, Type *BaseTy, VarAttr *Attr) {
     return Tok;
 }
 
-// 新转换
-Node *newCast(Node *Expr, Type *Ty) {
+// 新转换，总是生成转换节点
+Node *newCastNode(Node *Expr, Type *Ty) {
     addType(Expr);
     Node *Nd = calloc(1, sizeof(Node));
     Nd->Kind = ND_CAST;
@@ -328,6 +339,16 @@ Node *newCast(Node *Expr, Type *Ty) {
     return Nd;
 }
 
+// 隐式的类型转换，转换前后是相同的算术类型时值不变，不需要转换节点
+Node *newCast(Node *Expr, Type *Ty) {
+    addType(Expr);
+    Type *From = Expr->Ty;
+    if (isNumeric(From) && From->Kind == Ty->Kind && From->Size == Ty->Size &&
+        From->IsUnsigned == Ty->IsUnsigned)
+        return Expr;
+    return newCastNode(Expr, Ty);
+}
+
 //
 // others
 //
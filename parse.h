@@ -39,6 +39,7 @@ struct Scope {
     Scope *Next;            // 指向上一级的域
     VarScope *Vars;         // 指向当前域内的变量
     TagScope *Tags;         // 指向当前域内的结构体/union/enum标签
+    int Begin;              // 进入此域的时刻
 };
 
 // 变量属性
@@ -46,6 +47,10 @@ typedef struct {
     bool IsTypedef; // 是否为类型别名
     bool IsStatic;  // 是否为文件域内
     bool IsExtern;  // 是否为外部变量
+    bool IsInline;  // 是否有inline说明符
+    bool IsAlwaysInline; // __attribute__((always_inline))
+    bool IsNoInline;     // __attribute__((noinline))
+    bool IsNoreturn;     // _Noreturn或__attribute__((noreturn))
     int Align;      // 对齐量, 通过_Alignas手动设置
 } VarAttr;
 
@@ -121,6 +126,7 @@ Node *newAdd(Node *LHS, Node *RHS, Token *Tok);
 Node *newSub(Node *LHS, Node *RHS, Token *Tok);
 Node *newVarNode(Obj* Var, Token *Tok);
 Node *newCast(Node *Expr, Type *Ty);
+Node *newCastNode(Node *Expr, Type *Ty);
 Node *newLong(int64_t Val, Token *Tok);
 Node *newULong(long Val, Token *Tok);
 
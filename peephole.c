@@ -0,0 +1,411 @@
+//! 窥孔优化
+// 代码生成的每一行先放入缓冲区，每个函数生成完后，在缓冲区上用一个滑动窗口
+// 匹配规则表中的指令序列，替换为更短的序列，然后再写入文件
+#include "rvcc.h"
+
+// 行的种类
+typedef enum {
+    LN_INSN,    // 指令
+    LN_LABEL,   // 标签
+    LN_LOC,     // .loc调试信息
+    LN_DIRECT,  // 其他伪指令
+    LN_COMMENT, // 注释或空行
+} LineKind;
+
+// 缓冲区中的一行
+typedef struct {
+    char *Text;     // 原始文本，被删除时为NULL
+    LineKind Kind;  // 种类
+} Line;
+
+static Line *Lines;
+static int NumLines;
+static int CapLines;
+
+//
+// 缓冲区
+//
+
+// 判断行的种类
+static LineKind lineKind(char *S) {
+    while (*S == ' ' || *S == '\t' || *S == '\n')
+        S++;
+    if (!*S || *S == '#')
+        return LN_COMMENT;
+    if (!strncmp(S, ".loc", 4))
+        return LN_LOC;
+    // 行尾的注释不算在内
+    char *End = strchr(S, '#');
+    int Len = End ? End - S : strlen(S);
+    while (Len > 0 && (S[Len - 1] == ' ' || S[Len - 1] == '\t'))
+        Len--;
+    if (Len > 0 && S[Len - 1] == ':')
+        return LN_LABEL;
+    if (*S == '.')
+        return LN_DIRECT;
+    return LN_INSN;
+}
+
+// 输出一行到缓冲区，由println调用
+void emitLine(char *Fmt, ...) {
+    char *Buf;
+    size_t BufLen;
+    FILE *Out = open_memstream(&Buf, &BufLen);
+    va_list VA;
+    va_start(VA, Fmt);
+    vfprintf(Out, Fmt, VA);
+    va_end(VA);
+    fclose(Out);
+
+    // 类型转换表等一次输出多行，拆开后每行单独匹配
+    for (char *S = Buf; S; ) {
+        char *NL = strchr(S, '\n');
+        if (NumLines == CapLines) {
+            CapLines = CapLines ? CapLines * 2 : 1024;
+            Lines = realloc(Lines, sizeof(Line) * CapLines);
+        }
+        char *Text = NL ? strndup(S, NL - S) : strdup(S);
+        Lines[NumLines].Text = Text;
+        Lines[NumLines].Kind = lineKind(Text);
+        NumLines++;
+        S = NL ? NL + 1 : NULL;
+    }
+    free(Buf);
+}
+
+// 当前缓冲区中的行数，用于标记之后输出的行
+int lineMark(void) {
+    return NumLines;
+}
+
+// 将Mark之后输出的行移动到第To行之前
+void moveLines(int To, int Mark) {
+    int N = NumLines - Mark;
+    Line *Tmp = calloc(N, sizeof(Line));
+    memcpy(Tmp, Lines + Mark, sizeof(Line) * N);
+    memmove(Lines + To + N, Lines + To, sizeof(Line) * (Mark - To));
+    memcpy(Lines + To, Tmp, sizeof(Line) * N);
+    free(Tmp);
+}
+
+static char *stripLine(char *S, char *Buf, int Size);
+
+// 第From行起的代码大小的上限(字节)，用来判断分支是否一定不会超出范围
+// 伪指令按展开后最多的指令数计算
+int codeSize(int From) {
+    char Buf[256];
+    int Size = 0;
+    for (int I = From; I < NumLines; I++) {
+        if (!Lines[I].Text || Lines[I].Kind != LN_INSN)
+            continue;
+        char *S = stripLine(Lines[I].Text, Buf, sizeof(Buf));
+        if (!strncmp(S, "li ", 3)) {
+            char *Comma = strchr(S, ',');
+            long V = Comma ? strtol(Comma + 1, NULL, 0) : 0;
+            Size += V >= -2048 && V < 2048 ? 4 : V == (int)V ? 8 : 32;
+        } else if (!strncmp(S, "la ", 3) || !strncmp(S, "lla ", 4) ||
+                   !strncmp(S, "call ", 5) || !strncmp(S, "tail ", 5)) {
+            Size += 8;
+        } else {
+            Size += 4;
+        }
+    }
+    return Size;
+}
+
+//
+// 规则
+//
+
+// 模式中的%1-%9匹配一个操作数(寄存器、立即数或符号)，同一编号需匹配相同的文本
+#define MAX_CAPS 10
+#define MAX_WINDOW 4
+
+typedef struct Rule Rule;
+struct Rule {
+    char *Name;                 // 规则名
+    char *Pat[MAX_WINDOW];      // 要匹配的连续指令，以NULL结束
+    char *Rep[MAX_WINDOW];      // 替换为的指令，以NULL结束
+    bool (*Guard)(char **Caps, int End); // 附加条件，End为窗口后的第一行
+    int Hits;                   // 命中次数
+};
+
+static bool deadAfter(int I, char *Reg);
+
+// 是否为12位立即数
+static bool isImm12Str(char *S) {
+    char *End;
+    long V = strtol(S, &End, 10);
+    return *S && !*End && V >= -0x800 && V <= 0x7ff;
+}
+
+// la/li的目标寄存器在mv之后不再使用
+static bool mvSrcDead(char **Caps, int End) {
+    return deadAfter(End, Caps[1]);
+}
+
+// li装入的常量可以作为立即数，且装入的寄存器之后不再使用
+static bool liAddImm(char **Caps, int End) {
+    if (!isImm12Str(Caps[2]) || !strcmp(Caps[4], Caps[1]))
+        return false;
+    return !strcmp(Caps[3], Caps[1]) || deadAfter(End, Caps[1]);
+}
+
+static Rule Rules[] = {
+    // 压栈后立即弹栈，改为寄存器间的移动
+    {"push-pop",
+     {"addi sp, sp, -8", "sd %1, 0(sp)", "ld %2, 0(sp)", "addi sp, sp, 8"},
+     {"mv %2, %1"}},
+    {"push-pop-f",
+     {"addi sp, sp, -8", "fsd %1, 0(sp)", "fld %2, 0(sp)", "addi sp, sp, 8"},
+     {"fmv.d %2, %1"}},
+    // 刚存入栈中的值直接使用寄存器中的
+    {"store-load", {"sd %1, %2(sp)", "ld %3, %2(sp)"}, {"sd %1, %2(sp)", "mv %3, %1"}},
+    {"store-load-f", {"fsd %1, %2(sp)", "fld %3, %2(sp)"}, {"fsd %1, %2(sp)", "fmv.d %3, %1"}},
+    // 地址或常量直接装入目标寄存器
+    {"la-mv", {"la %1, %2", "mv %3, %1"}, {"la %3, %2"}, mvSrcDead},
+    {"li-mv", {"li %1, %2", "mv %3, %1"}, {"li %3, %2"}, mvSrcDead},
+    // 加上较小的常量时使用立即数
+    {"li-add", {"li %1, %2", "add %3, %4, %1"}, {"addi %3, %4, %2"}, liAddImm},
+    {"li-addw", {"li %1, %2", "addw %3, %4, %1"}, {"addiw %3, %4, %2"}, liAddImm},
+    // 跳转到紧随其后的标签
+    {"jump-next", {"j %1", "%1:"}, {"%1:"}},
+    {"jump-next2", {"j %1", "%2:", "%1:"}, {"%2:", "%1:"}},
+    // 没有指令的.loc
+    {"loc-loc", {".loc %1 %2", ".loc %1 %3"}, {".loc %1 %3"}},
+    // 无用的移动和加0
+    {"mv-self", {"mv %1, %1"}, {NULL}},
+    {"addi-zero", {"addi %1, %1, 0"}, {NULL}},
+};
+
+#define NUM_RULES (int)(sizeof(Rules) / sizeof(*Rules))
+
+// 去掉行首空白和行尾的注释，结果放入Buf
+static char *stripLine(char *S, char *Buf, int Size) {
+    while (*S == ' ' || *S == '\t')
+        S++;
+    int Len = 0;
+    while (S[Len] && S[Len] != '#' && S[Len] != '\n' && Len < Size - 1)
+        Len++;
+    while (Len > 0 && (S[Len - 1] == ' ' || S[Len - 1] == '\t'))
+        Len--;
+    memcpy(Buf, S, Len);
+    Buf[Len] = '\0';
+    return Buf;
+}
+
+// 操作数中的字符
+static bool isOperandChar(char C) {
+    return C && C != ',' && C != ' ' && C != '\t' && C != '(' && C != ')' && C != ':';
+}
+
+// 用模式匹配一行，成功时记录捕获的操作数
+static bool matchLine(char *Pat, char *S, char **Caps) {
+    while (*Pat) {
+        if (*Pat == '%') {
+            int N = Pat[1] - '0';
+            int Len = 0;
+            while (isOperandChar(S[Len]))
+                Len++;
+            if (!Len)
+                return false;
+            if (Caps[N]) {
+                if (strlen(Caps[N]) != Len || strncmp(Caps[N], S, Len))
+                    return false;
+            } else {
+                Caps[N] = strndup(S, Len);
+            }
+            S += Len;
+            Pat += 2;
+            continue;
+        }
+        if (*Pat != *S)
+            return false;
+        Pat++;
+        S++;
+    }
+    return !*S;
+}
+
+// 用捕获的操作数替换模板中的%N
+static char *expand(char *Tmpl, char **Caps) {
+    char *Buf;
+    size_t BufLen;
+    FILE *Out = open_memstream(&Buf, &BufLen);
+    // 标签不缩进
+    if (Tmpl[strlen(Tmpl) - 1] != ':')
+        fprintf(Out, "  ");
+    for (char *P = Tmpl; *P; P++) {
+        if (*P == '%') {
+            fprintf(Out, "%s", Caps[P[1] - '0']);
+            P++;
+        } else {
+            fputc(*P, Out);
+        }
+    }
+    fclose(Out);
+    return Buf;
+}
+
+//
+// 寄存器的使用
+//
+
+// 寄存器是否为操作数文本中的一部分，如 a0 或 8(a0)
+static bool mentions(char *Operand, char *Reg) {
+    int Len = strlen(Reg);
+    for (char *P = Operand; *P; P++) {
+        if (strncmp(P, Reg, Len))
+            continue;
+        bool Begin = P == Operand || !isOperandChar(P[-1]);
+        if (Begin && !isOperandChar(P[Len]))
+            return true;
+    }
+    return false;
+}
+
+// 是否为调用者保存、且不用于传递参数和返回值的临时寄存器
+static bool isTmpReg(char *Reg) {
+    return (Reg[0] == 't' && isdigit(Reg[1])) || (Reg[0] == 'f' && Reg[1] == 't');
+}
+
+// 从第I行开始，寄存器Reg的值是否一定不会再被读取
+// 只在基本块内向后查找，遇到标签或跳转时保守地认为仍被使用
+static bool deadAfter(int I, char *Reg) {
+    char Buf[256];
+    for (int Steps = 0; I < NumLines && Steps < 64; I++) {
+        Line *L = &Lines[I];
+        if (!L->Text || L->Kind == LN_COMMENT || L->Kind == LN_LOC)
+            continue;
+        if (L->Kind != LN_INSN)
+            return false;
+        Steps++;
+
+        // 拆分为操作码和操作数
+        char *S = stripLine(L->Text, Buf, sizeof(Buf));
+        char *Op = S;
+        while (*S && *S != ' ' && *S != '\t')
+            S++;
+        if (*S)
+            *S++ = '\0';
+
+        // 调用破坏所有临时寄存器，a和fa寄存器可能是实参
+        if (!strcmp(Op, "call") || !strcmp(Op, "jalr"))
+            return isTmpReg(Reg) && !mentions(S, Reg);
+        // 离开函数时临时寄存器都已无用
+        if (!strcmp(Op, "ret") || !strcmp(Op, "tail"))
+            return isTmpReg(Reg);
+        // 跳转和分支
+        if (Op[0] == 'j' || Op[0] == 'b')
+            return false;
+
+        // 存储指令的所有操作数都是读取
+        bool IsStore = !strcmp(Op, "sd") || !strcmp(Op, "sw") || !strcmp(Op, "sh") ||
+                       !strcmp(Op, "sb") || !strcmp(Op, "fsd") || !strcmp(Op, "fsw");
+        char *Comma = strchr(S, ',');
+        if (IsStore || !Comma) {
+            if (mentions(S, Reg))
+                return false;
+            continue;
+        }
+
+        // 其余指令的第一个操作数为目标寄存器
+        if (mentions(Comma + 1, Reg))
+            return false;
+        *Comma = '\0';
+        if (mentions(S, Reg))
+            return true;
+    }
+    return false;
+}
+
+//
+// 窗口匹配
+//
+
+// 是否为规则窗口中要跳过的行
+static bool skipLine(Line *L, bool Loc) {
+    if (!L->Text || L->Kind == LN_COMMENT)
+        return true;
+    // .loc对其他规则是透明的
+    return !Loc && L->Kind == LN_LOC;
+}
+
+// 尝试在第I行应用规则R
+static bool applyRule(Rule *R, int I) {
+    bool Loc = !strncmp(R->Pat[0], ".loc", 4);
+    char *Caps[MAX_CAPS] = {0};
+    int Idx[MAX_WINDOW];
+    char Buf[256];
+    int N = 0;
+    bool Ok = true;
+
+    for (; N < MAX_WINDOW && R->Pat[N]; N++) {
+        while (I < NumLines && skipLine(&Lines[I], Loc))
+            I++;
+        if (I >= NumLines ||
+            !matchLine(R->Pat[N], stripLine(Lines[I].Text, Buf, sizeof(Buf)), Caps)) {
+            Ok = false;
+            break;
+        }
+        Idx[N] = I++;
+    }
+
+    if (Ok && R->Guard)
+        Ok = R->Guard(Caps, I);
+
+    if (Ok) {
+        // 替换窗口中的前几条，删除其余的
+        int J = 0;
+        for (; J < MAX_WINDOW && R->Rep[J]; J++) {
+            char *Text = expand(R->Rep[J], Caps);
+            Lines[Idx[J]].Text = Text;
+            Lines[Idx[J]].Kind = lineKind(Text);
+        }
+        for (; J < N; J++)
+            Lines[Idx[J]].Text = NULL;
+        R->Hits++;
+    }
+
+    for (int K = 0; K < MAX_CAPS; K++)
+        free(Caps[K]);
+    return Ok;
+}
+
+// 在缓冲区上应用所有规则，直到不再有变化
+static void peephole(void) {
+    bool Changed = true;
+    while (Changed) {
+        Changed = false;
+        for (int I = 0; I < NumLines; I++) {
+            if (!Lines[I].Text)
+                continue;
+            for (int R = 0; R < NUM_RULES; R++) {
+                if (applyRule(&Rules[R], I)) {
+                    Changed = true;
+                    if (!Lines[I].Text)
+                        break;
+                }
+            }
+        }
+    }
+}
+
+// 将缓冲区写入文件，-O1起先进行窥孔优化
+void flushLines(FILE *Out) {
+    if (OptLevel)
+        peephole();
+    for (int I = 0; I < NumLines; I++) {
+        if (!Lines[I].Text)
+            continue;
+        fprintf(Out, "%s\n", Lines[I].Text);
+        free(Lines[I].Text);
+    }
+    NumLines = 0;
+}
+
+// 输出每条规则的命中次数
+void printPeepholeStats(FILE *Out) {
+    for (int I = 0; I < NUM_RULES; I++)
+        fprintf(Out, "%-12s %d\n", Rules[I].Name, Rules[I].Hits);
+}
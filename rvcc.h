@@ -30,6 +30,8 @@ typedef struct Node Node;
 typedef struct Type Type;
 typedef struct Member Member;
 typedef struct Relocation Relocation;
+typedef struct VecLoop VecLoop;
+typedef struct VecCheck VecCheck;
 
 // put some data structures and useful macros here
 
@@ -78,6 +80,7 @@ struct Obj {
     int Offset;     // fp的偏移量
     Type *Ty;       // 变量类型
     bool IsLocal;   // 是局部变量
+    bool IsByRef;   // 通过地址传入的较大结构体形参，栈中只存放它的地址
     bool IsStatic;  // 是否为文件域内的
     bool IsDefinition; // 是否为函数定义
     int Align;      // 对齐量
@@ -91,6 +94,16 @@ struct Obj {
     char *InitData;  // 用于初始化的数据
     Relocation *Rel; // 指向其他全局变量的指针
     Obj *VaArea;     // 可变参数区域
+    Obj *RetPtr;     // 返回较大的结构体时，调用者传入的存放返回值的地址
+    bool IsInline;       // 是否有inline说明符
+    bool IsAlwaysInline; // 是否要求总是内联
+    bool IsNoInline;     // 是否禁止内联
+    bool IsNoreturn;     // 函数是否不会返回
+    // 优化使用
+    bool IsAddrTaken; // 局部变量的地址是否被取过
+    int NumRefs;      // 函数被引用的次数
+    int LiveBegin;    // 局部变量所在块的进入时刻
+    int LiveEnd;      // 所在块的离开时刻，为0时在整个函数内存活
 
 };
 
@@ -138,8 +151,39 @@ typedef enum {
     ND_COND,        // ?:，条件运算符
     ND_NULL_EXPR,   // 空表达式
     ND_MEMZERO,     // 栈中变量清零
+    ND_CLZ,         // __builtin_clz，前导零的个数
+    ND_CTZ,         // __builtin_ctz，末尾零的个数
+    ND_POPCOUNT,    // __builtin_popcount，1的个数
 } NodeKind;
 
+// 二元运算两侧的求值顺序
+typedef enum {
+    ORD_ANY,        // 不限，由代码生成决定
+    ORD_LHS,        // 先求值左侧
+    ORD_RHS,        // 先求值右侧
+} EvalOrder;
+
+// 向量化时可用的向量寄存器组数(LMUL=4，v4-v28)和归约的个数(v1-v3)
+#define VEC_GROUPS 7
+#define VEC_MAX_RED 3
+
+// 运行时需要检查不重叠的两个数组基址
+struct VecCheck {
+    VecCheck *Next;
+    Node *A;
+    Node *B;
+};
+
+// 可以向量化的for循环，由优化阶段识别，在代码生成时使用
+struct VecLoop {
+    Obj *Iv;            // 归纳变量，每次加1
+    Node *Cond;         // 循环条件，Iv < End 或 Iv <= End
+    int SEW;            // 元素的字节数
+    Node *Stmts;        // 循环体中的语句，a[i] = E的赋值，或s op= E的运算节点(LHS为s)
+    int NumRed;         // 归约的个数
+    VecCheck *Checks;   // 基址可能重叠的数组
+};
+
 // AST中二叉树节点
 struct Node {
     // node*中都是存储了一串指令(保存至ast中)。
@@ -153,11 +197,13 @@ struct Node {
     Type *Ty;       // 节点中数据的类型
     int64_t Val;    // 存储ND_NUM种类的值
     double FVal;    // 存储ND_NUM种类的浮点值
+    int Expect;     // __builtin_expect的提示：1为值很可能非零，-1为很可能为零
     Token * Tok;    // 节点对应的终结符. debug
     // 函数
     char *FuncName; // 函数名
     Node *Args;     // 函数被调用时代入的实参，可看作是一串表达式链表。 形参则保存在Nd->Ty->Parms中
     Type *FuncType; // 函数类型
+    Obj *RetBuffer; // 返回结构体时，存放返回值的局部变量
     // "if"语句
     Node *Cond;     // 条件内的表达式
     Node *Then;     // 符合条件后的语句(do/while/if代码块内的语句)
@@ -178,6 +224,10 @@ struct Node {
     // switch和case
     Node *CaseNext;
     Node *DefaultCase;
+    // 代码生成使用
+    int RegNeed;    // Sethi-Ullman编号，求值所需的寄存器数，0表示未计算
+    EvalOrder Order; // 二元运算的求值顺序，优化时会被固定下来
+    VecLoop *Vec;   // 可以向量化的for循环
 
 };
 
@@ -265,6 +315,26 @@ extern Type *TyDouble;
 
 // functions
 
+/* ---------- main.c ---------- */
+// 优化等级，由-O<n>指定
+extern int OptLevel;
+// 是否输出窥孔优化的统计，由-fpeephole-stats指定
+extern bool OptPeepholeStats;
+// 是否省略帧指针，-O1起默认开启
+extern bool OptOmitFP;
+// 是否对循环进行向量化，-O2起默认开启
+extern bool OptVectorize;
+// 是否将浮点乘法和加减法融合，由-ffp-contract=fast或-ffast-math开启
+extern bool OptFPContract;
+// 是否忽略NaN和舍入的差异，允许重新结合等变换，由-ffast-math开启
+extern bool OptFastMath;
+// 目标是否支持Zba、Zbb、Zbs、Zicond和V扩展，由-march指定
+extern bool ExtZba;
+extern bool ExtZbb;
+extern bool ExtZbs;
+extern bool ExtZicond;
+extern bool ExtV;
+
 /* ---------- tokenize.c ---------- */
 // 词法分析
 Token* tokenizeFile(char* Path);
@@ -282,6 +352,39 @@ Obj *parse(Token *Tok);
 /* ---------- codegen.c ---------- */
 // 代码生成入口函数
 void codegen(Obj *Prog, FILE *Out);
+// 计算表达式求值所需的寄存器数
+int regNeed(Node *Nd);
+// 二元运算是否先求值左侧
+bool lhsFirst(Node *Nd);
+// 浮点常量是否从常量池中读取
+bool inFConstPool(Node *Nd);
+
+/* ---------- peephole.c ---------- */
+// 输出一行汇编到缓冲区
+void emitLine(char *Fmt, ...);
+// 标记和移动缓冲区中的行
+int lineMark(void);
+void moveLines(int To, int Mark);
+// 第From行起的代码大小的上限
+int codeSize(int From);
+// 将缓冲区写入文件，-O1起先进行窥孔优化
+void flushLines(FILE *Out);
+// 输出窥孔优化每条规则的命中次数
+void printPeepholeStats(FILE *Out);
+
+/* ---------- opt-core.c ---------- */
+// 优化入口函数，在代码生成前对AST进行变换
+void optimize(Obj *Prog);
+
+/* ---------- opt-util.c ---------- */
+// 表达式是否没有副作用
+bool isPureExpr(Node *Nd);
+// 两个纯表达式是否计算相同的值
+bool sameExpr(Node *A, Node *B);
+
+/* ---------- opt-vectorize.c ---------- */
+// 以Iv为下标的数组元素的基址，不是时返回NULL
+Node *vecBase(Node *Nd, Obj *Iv);
 
 
 /* ---------- type.c ---------- */
@@ -291,6 +394,8 @@ bool isInteger(Type *TY);
 bool isFloNum(Type *Ty);
 // 判断是否为数字
 bool isNumeric(Type *Ty);
+// 判断是否为结构体或联合体
+bool isStructOrUnion(Type *Ty);
 // 为节点内的所有节点添加类型
 void addType(Node *Nd);
 // 构建一个指针类型，并指向基类
@@ -355,7 +460,7 @@ uint32_t simpleLog2(uint32_t v);
     }\
     while(0);
 
-#define println(format, ...) fprintf(OutputFile, format "\n", ## __VA_ARGS__)
+#define println(format, ...) emitLine(format, ## __VA_ARGS__)
 
 #define todo() Assert(0, "todo")
 
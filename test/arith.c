@@ -148,6 +148,73 @@ int main() {
   // [134] 将指针作为无符号类型进行比较
   ASSERT(1, (void *)0xffffffffffffffff > (void *)0);
 
+  // 表达式临时寄存器: 先算需求大的一侧，寄存器池用完时退回到压栈
+  ASSERT(-164, ({ int a=1,b=2,c=3,d=4,e=5,f=6,g=7,h=8; ((a+b)*(c+d))-((e+f)*(g+h)) + ((a-b)*(c-d)+(e-f)*(g-h))*((a*b)-(c*d)); }));
+  ASSERT(-32, ({ int a=1,b=2,c=3,d=4,e=5,f=6,g=7,h=8; ((((a+b)-(c+d))*((e-f)+(g-h))) - (((a*b)+(c*d))-((e*f)-(g*h)))) + ((((a-c)*(b-d))+((e-g)*(f-h))) * (((a+h)-(b+g))+((c+f)-(d+e)))); }));
+
+  // 乘除以常数
+  ASSERT(-70, ({ int x=-7; x*10; }));
+  ASSERT(-45, ({ int x=5; x*-9; }));
+  ASSERT(217, ({ int x=7; 31*x; }));
+  ASSERT(-3, ({ int x=-7; x/2; }));
+  ASSERT(-1, ({ int x=-7; x%2; }));
+  ASSERT(-12, ({ int x=-123; x/10; }));
+  ASSERT(-3, ({ int x=-123; x%10; }));
+  ASSERT(12, ({ int x=-123; x/-10; }));
+  ASSERT(-3, ({ int x=-123; x%-10; }));
+  ASSERT(2, ({ int x=-7; x/-3; }));
+  ASSERT(429496729, ({ unsigned x=-1; x/10; }));
+  ASSERT(5, ({ unsigned x=-1; x%10; }));
+  ASSERT(15, ({ unsigned x=-1; x%16; }));
+  ASSERT(1, ({ long x=-1000000000001; x/-1000000000000; }));
+  ASSERT(-1, ({ long x=-1000000000001; x%-1000000000000; }));
+  ASSERT(1844674407, ({ unsigned long x=-1; (int)(x/10000000000); }));
+  ASSERT(-3, ({ long x=-9223372036854775807; (int)(x/3074457345618258602); }));
+
+  // 立即数操作数
+  ASSERT(2052, ({ int x=5; 2047+x; }));
+  ASSERT(-2043, ({ long x=5; x-2048; }));
+  ASSERT(2047, ({ unsigned x=-1; x&0x7ff; }));
+  ASSERT(-2048, ({ int x=-1; (x|-2048)^2047; }));
+  ASSERT(6, ({ long x=3; x<<40 >> 39; }));
+  ASSERT(1, ({ unsigned x=0x80000000; (int)(x>>31); }));
+  ASSERT(-4, ({ int x=-16; x>>2; }));
+  ASSERT(1, ({ unsigned x=-1; x==4294967295u; }));
+  ASSERT(1, ({ unsigned x=5; 10>x; }));
+  ASSERT(0, ({ unsigned x=-1; x<=2047; }));
+  ASSERT(1, ({ unsigned long x=-1; x>=-1; }));
+  ASSERT(1, ({ long x=-2049; -2048>x; }));
+  ASSERT(1, ({ int x=10; 10<=x && x<11 && !(x>10); }));
+
+  // 位操作
+  ASSERT(0, ({ unsigned x=0x12345678; int n=8; (x << n | x >> (32 - n)) - 0x34567812; }));
+  ASSERT(1, ({ unsigned long x=0x0123456789abcdefUL; int n=12; (x >> n | x << (64 - n)) == 0xdef0123456789abcUL; }));
+  ASSERT(255, ({ unsigned x=0xf000000f; (int)((x << 4) | (x >> 28)); }));
+  ASSERT(4660, ({ unsigned short s=0x3412; int x=s; (unsigned short)(x << 8 | x >> 8); }));
+  ASSERT(25, ({ long a[8]={1,4,9,16,25,36,49,64}; int i=2; a[i+2] + a[i-2] - a[0]; }));
+  ASSERT(12, ({ short a[8]={1,2,3,4,5,6,7,8}; int *p; int b[4]={9,10,11,12}; p=b; long i=3; p[i] + a[i] - a[3]; }));
+  ASSERT(-8, ({ long x=-8; int i=x; (long)(unsigned)i - 4294967296L; }));
+  ASSERT(-128, ({ long x=0x180; (signed char)x; }));
+  ASSERT(-32768, ({ long x=0x18000; (short)x; }));
+  ASSERT(32768, ({ long x=-0x8000; (unsigned short)x; }));
+  ASSERT(1, ({ long x=5; int n=40; (x | (1L << n)) == 0x10000000005L; }));
+  ASSERT(1, ({ long x=-1; int n=63; (x & ~(1L << n)) == 0x7fffffffffffffffL; }));
+  ASSERT(1, ({ long x=-1; (x & 0xFFFFFFFFFFFFEFFF) == -4097 && (x & 0x7FFFFFFFFFFFFFFF) == 0x7fffffffffffffffL; }));
+  ASSERT(1, ({ long x=3; (x ^ (1L << 40)) == 0x10000000003L && (x ^ 0x4000) == 0x4003; }));
+  ASSERT(5, ({ int x=0x500000; ((x >> 20) & 1) + ((x >> 22) & 1) * 4 + (1 & (x >> 21)) * 2; }));
+  ASSERT(2, ({ int x=-1; int n=31; ((x >> n) & 1) + ((unsigned)x >> 31 & 1); }));
+  ASSERT(1, ({ int x=5; (x | 0x100000) == 0x100005 && (x & ~0x4) == 1 && ((x | 0x100000) & ~0x100000) == 5; }));
+  ASSERT(-2147483643, ({ int x=5; x | (int)0x80000000; }));
+  ASSERT(1, ({ long a=0xff, b=0x0f; int c=6, d=3; (a & ~b) == 0xf0 && (~c | d) == -5 && (c ^ ~d) == -6; }));
+  ASSERT(28, __builtin_clz(10));
+  ASSERT(60, __builtin_clzl(10));
+  ASSERT(0, __builtin_clz(-1));
+  ASSERT(4, __builtin_ctz(16));
+  ASSERT(63, __builtin_ctzll(1UL << 63));
+  ASSERT(32, ({ unsigned x=0; __builtin_ctz(x) + __builtin_popcount(x); }));
+  ASSERT(32, __builtin_popcount(-1));
+  ASSERT(64, __builtin_popcountll(-1L));
+  ASSERT(10, ({ long x=0x1234; int y=-2; __builtin_popcountl(x) + __builtin_clz(y) + __builtin_ctzl(x) + 3; }));
   printf("OK\n");
   return 0;
 }
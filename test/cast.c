@@ -1,5 +1,11 @@
 #include "test.h"
 
+unsigned castU32(unsigned x) { return x; }
+int castSwitch(unsigned x) { switch (x) { case 0xffffffffu: return 1; case 7: return 2; } return 0; }
+unsigned char castShl(unsigned char c) { return (int)(c << 4); }
+unsigned char castNot(unsigned char c, int k) { return k ? ~c : 0; }
+unsigned short castShl16(unsigned short s, int k) { return k ? s << 3 : 1; }
+
 int main() {
   // [67] 支持类型转换
   ASSERT(131585, (int)8590066177);
@@ -61,6 +67,26 @@ int main() {
   ASSERT(3, (float)3L);
   ASSERT(3, (double)3L);
 
+  // 已经扩展好的值不需要再转换
+  ASSERT(1, ({ unsigned x = 0xffffffff; castU32(x) == x; }));
+  ASSERT(1, ({ unsigned x = 0x80000000; unsigned y = castU32(x); x == y; }));
+  ASSERT(0, ({ unsigned x = 0x80000000; castU32(x) != x; }));
+  ASSERT(1, castSwitch(castU32(-1)));
+  ASSERT(2, ({ unsigned x = 7; castSwitch(x); }));
+  ASSERT(127, ({ char c = -1; (unsigned char)(c & 0x7f); }));
+  ASSERT(255, ({ signed char c = -1; (unsigned char)c; }));
+  ASSERT(-1, ({ unsigned char c = 255; (signed char)(c | 0x80); }));
+  ASSERT(-128, ({ int i = 0x180; (signed char)(i & 0xff); }));
+  ASSERT(4294967295, ({ int i = -1; (unsigned long)(unsigned)i; }));
+  ASSERT(1, ({ unsigned short s = 65535; (short)s == -1; }));
+  ASSERT(2, ({ _Bool b = 2; (char)b + (int)b; }));
+  ASSERT(1, ({ unsigned x = 1u << 31; (x ^ 0x80000000u) == 0; }));
+  ASSERT(240, castShl(0xff));
+  ASSERT(240, castNot(0x0f, 1));
+  ASSERT(65528, castShl16(0xffff, 1));
+  ASSERT(252, ({ unsigned char c = 0xff; (unsigned char)((c << 4) >> 2); }));
+  ASSERT(240, ({ unsigned char c = 0x0f; (unsigned char)({ ~c; }); }));
+
   printf("OK\n");
   return 0;
 }
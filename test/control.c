@@ -4,6 +4,93 @@
  * This is a block comment.
  */
 
+// 跳转表与二分查找
+static int swDense(int x) {
+  switch (x) {
+  case 0: return 10; case 1: return 11; case 2: return 12; case 3: return 13;
+  case 4: return 14; case 6: return 16; case 7: return 17; case 8: return 18;
+  default: return -1;
+  }
+}
+static int swSparse(int x) {
+  switch (x) {
+  case -1000: return 1; case -7: return 2; case 3: return 3; case 100: return 4;
+  case 2048: return 5; case 40000: return 6; case 1000000: return 7;
+  }
+  return 0;
+}
+static int swMixed(long x) {
+  switch (x) {
+  case -3: return 1; case -2: return 2; case -1: return 3; case 0: return 4; case 1: return 5;
+  case 500: return 6;
+  case 3000: return 7; case 3001: return 8; case 3003: return 9; case 3004: return 10; case 3005: return 11;
+  case 90000: return 12;
+  default: return 0;
+  }
+}
+static int swUnsigned(unsigned x) {
+  switch (x) {
+  case 0x7ffffffe: return 1; case 0x7fffffff: return 2; case 0x80000000: return 3;
+  case 0x80000001: return 4; case 0xfffffffe: return 5; case 0xffffffff: return 6;
+  }
+  return 0;
+}
+static int swULong(unsigned long x) {
+  switch (x) {
+  case 1: return 1; case 2: return 2; case 3: return 3; case 4: return 4;
+  case -2: return 5; case -1: return 6;
+  }
+  return 0;
+}
+
+// 条件跳转
+static int condMix(int a, int b, unsigned u, double d, int *p) {
+  int s = 0;
+  if (a < b && (u == 3 || !p)) s += 1;
+  if (!(a <= b) || p != 0) s += 2;
+  if (u >= 0x80000000 && d) s += 4;
+  if (a == 0 || (b > 5 && !(d < 0.5))) s += 8;
+  while (a > 0 && s < 100) { a--; s += 16; }
+  return s;
+}
+
+// 分支布局：很少执行的一侧移到函数末尾
+_Noreturn static void bail(int n) { exit(n); }
+static int coldPaths(int *p, int n, int k) {
+  int s = 0;
+  if (!p) return -1;
+  if (n > 1000) bail(3);
+  for (int i = 0; i < n; i++) {
+    if (__builtin_expect(p[i] < 0, 0)) { s -= p[i]; continue; }
+    if (__builtin_expect_with_probability(p[i] == k, 1, 0.1)) s += 100; else s += p[i];
+    if (p[i] == 99) { s += 1000; break; }
+    if (i > 5) return s * 2;
+  }
+  if (__builtin_expect(n, 1)) s += 1; else s -= 1;
+  return s;
+}
+
+// 条件选择：两侧都很简单时不使用分支
+static int G = 7;
+static int selects(int a, int b, unsigned u, unsigned v, long l, char c) {
+  long s = 0;
+  s += a < 0 ? -a : a;
+  s += 0 <= b ? b : -b;
+  s += a < b ? a : b;
+  s += a < b ? b : a;
+  s += u < v ? u : v;
+  s += u <= v ? v : u;
+  s += l < 0 ? -l : l;
+  s += c ? G : a + 1;
+  s += a > 3 ? b * 2 : 0;
+  s += a > 3 ? 0 : b ^ 5;
+  s += c < 10 ? c : 10;
+  int x = a;
+  if (x > 5) x = 5;
+  if (b) x += 100; else x -= 100;
+  return (s % 1000003) * 1000 + x;
+}
+
 int main() {
   // [15] 支持if语句
   ASSERT(3, ({ int x; if (0) x=2; else x=3; x; }));
@@ -77,6 +164,18 @@ int main() {
   ASSERT(0, ({ int i=0; switch(3) { case 0: 0; case 1: 0; case 2: 0; i=2; } i; }));
 
   ASSERT(3, ({ int i=0; switch(-1) { case 0xffffffff: i=3; break; } i; }));
+  ASSERT(980, ({ int s=0; for (int i=-3; i<12; i++) s += (i+5) * swDense(i); s; }));
+  ASSERT(205, ({ int v[]={-1000,-999,-7,0,3,100,2048,2047,40000,1000000,999999}; int s=0; for (int i=0; i<11; i++) s += (i+1) * swSparse(v[i]); s; }));
+  ASSERT(529, ({ long w[]={-4,-3,-1,1,2,500,501,2999,3000,3002,3003,3005,3006,90000}; int s=0; for (int i=0; i<14; i++) s += (i+1) * swMixed(w[i]); s; }));
+  ASSERT(102, ({ unsigned u[]={0x7ffffffe,0x7fffffff,0x80000000,0x80000001,0x80000002,0xfffffffe,0xffffffff,0}; int s=0; for (int i=0; i<8; i++) s += (i+1) * swUnsigned(u[i]); s; }));
+  ASSERT(74, ({ unsigned long u[]={0,1,4,5,-1,-2,-3}; int s=0; for (int i=0; i<7; i++) s += (i+1) * swULong(u[i]); s; }));
+
+  ASSERT(17, condMix(1, 2, 3, 0.0, 0));
+  ASSERT(54, ({ int x; condMix(3, 2, 0x80000000u, 1.5, &x); }));
+  ASSERT(14, ({ int x; condMix(0, 9, 0xffffffffu, 0.25, &x); }));
+  ASSERT(41, condMix(2, 6, 4, 0.5, 0));
+  ASSERT(6, ({ int i=0, n=0; do n += i; while (i++, i < 5 && n != 6); n; }));
+  ASSERT(1, ({ float f=0.0f; int k=0; for (; !f; f += 0.5f) k++; k; }));
 
   // [124] 支持do while语句
   ASSERT(7, ({ int i=0; int j=0; do { j++; } while (i++ < 6); j; }));
@@ -98,6 +197,30 @@ int main() {
   ASSERT(10, ({ double i=10.0; int j=0; for (; i; i--, j++); j; }));
   ASSERT(10, ({ double i=10.0; int j=0; do j++; while(--i); j; }));
 
+  // 循环转为入口判断一次、末尾条件跳转的形式
+  ASSERT(6, ({ int i=0, n=0; while (n++, i < 5) i++; n; }));
+  ASSERT(0, ({ int n=0; for (int i=10; i < 5; i++) n++; n; }));
+  ASSERT(20, ({ int s=0; for (int i=0; i<10; i++) { if (i%2) continue; s+=i; } s; }));
+  ASSERT(3, ({ int j=0; for (int i=0; ({ i < 3; }); i++) j += i; j; }));
+
+  // __builtin_expect和分支布局
+  ASSERT(5, __builtin_expect(5, 0));
+  ASSERT(0, __builtin_expect_with_probability(0, 1, 0.9));
+  ASSERT(8, sizeof(__builtin_expect(1, 1)));
+  ASSERT(-1, coldPaths(0, 3, 0));
+  ASSERT(-1, ({ int a[]={1}; coldPaths(a, 0, 0); }));
+  ASSERT(107, ({ int a[]={1,-2,3,10}; coldPaths(a, 4, 10); }));
+  ASSERT(1106, ({ int a[]={1,2,3,99,5}; coldPaths(a, 5, 0); }));
+  ASSERT(56, ({ int a[]={1,2,3,4,5,6,7,8}; coldPaths(a, 8, 0); }));
+
+  ASSERT(27103, selects(3, -4, 5, 9, -10, 0));
+  ASSERT(477259093, selects(-7, 9, 0x80000000, 2, 3, 'x'));
+  ASSERT(954478105, selects(8, 8, 0xffffffff, 0, 0, 20));
+  ASSERT(-2134583, selects(-2147483, 0, 0, 0, 0, 1));
+  ASSERT(2, ({ int i=0, j=0, k=1; k = i++ ? j : 2; k + i - 1; }));
+  ASSERT(10, ({ int i=0, j=10; int k = i ? i++ : j++; k + i + (j - 11); }));
+  ASSERT(5, ({ int a[]={1,5}; int *p = a[0] > 3 ? a : a + 1; *p; }));
+
   printf("OK\n");
   return 0;
 }
@@ -38,4 +38,117 @@ $rvcc --help 2>&1 | grep -q rvcc
 # 将--help传入check函数
 check --help
 
+# -fpeephole-stats
+# 在标准错误中输出每条窥孔规则的命中次数
+echo 'int main() { int x = 1; return x + 2; }' > $tmp/peep.c
+$rvcc -O1 -fpeephole-stats -o $tmp/out $tmp/peep.c 2>&1 | grep -q '^push-pop '
+check -fpeephole-stats
+
+# -fomit-frame-pointer
+# 省略帧指针后，局部变量相对于sp寻址
+echo 'int main() { int x = 1; return x; }' > $tmp/fp.c
+$rvcc -fomit-frame-pointer -o- $tmp/fp.c | grep -q '(sp)' &&
+  ! $rvcc -O1 -fno-omit-frame-pointer -o- $tmp/fp.c | grep -q 'addi a0, sp'
+check -fomit-frame-pointer
+
+# -fvectorize
+# 有V扩展时，-O2默认将简单的数组循环向量化
+echo 'void f(int *a, int *b, int n) { for (int i = 0; i < n; i++) a[i] = b[i] + 1; }' > $tmp/vec.c
+$rvcc -O2 -march=rv64gcv -o- $tmp/vec.c | grep -q 'vsetvli' &&
+  ! $rvcc -O2 -march=rv64gcv -fno-vectorize -o- $tmp/vec.c | grep -q 'vsetvli' &&
+  ! $rvcc -O2 -o- $tmp/vec.c | grep -q 'vsetvli' &&
+  $rvcc -O1 -fvectorize -march=rv64gcv -o- $tmp/vec.c | grep -q 'vle32.v'
+check -fvectorize
+
+# -march
+# 默认只使用基础指令集，指定的扩展中的指令才会被选用
+echo 'long f(long *a, int i) { return a[i]; } unsigned g(unsigned x) { return __builtin_popcount(x); }' > $tmp/march.c
+$rvcc -O1 -march=rv64gc_zba_zbb -o- $tmp/march.c | grep -q 'sh3add' &&
+  $rvcc -O1 -march=rv64gc_zbb -o- $tmp/march.c | grep -q 'cpopw' &&
+  ! $rvcc -O1 -march=rv64gc_zbb -o- $tmp/march.c | grep -q 'sh3add' &&
+  ! $rvcc -O1 -o- $tmp/march.c | grep -qE 'sh3add|cpop'
+check -march
+
+# Zbs：清除单个位的常数掩码
+echo 'long f(long x) { return x & 0xFFFFFFFFFFFFEFFF; } long g(long x) { return x & 0x7FFFFFFFFFFFFFFF; }' > $tmp/zbs.c
+$rvcc -O1 -march=rv64gc_zbs -o- $tmp/zbs.c | grep -q 'bclri a0, a0, 12' &&
+  $rvcc -O1 -march=rv64gc_zbs -o- $tmp/zbs.c | grep -q 'bclri a0, a0, 63'
+check 'zbs bclri'
+$rvcc -march=rv32gc -o- $tmp/march.c 2>&1 | grep -q 'unsupported -march'
+check '-march error'
+
+# 直接调用函数名时使用call，通过函数指针调用时才使用jalr，函数带有类型和大小
+echo 'int g(void); int f(int (*p)(void)) { return g() + p(); }' > $tmp/call.c
+$rvcc -o- $tmp/call.c | grep -q 'call g' &&
+  $rvcc -o- $tmp/call.c | grep -q 'jalr t5' &&
+  ! $rvcc -o- $tmp/call.c | grep -q 'la t5, g' &&
+  $rvcc -o- $tmp/call.c | grep -q '.type f, @function' &&
+  $rvcc -o- $tmp/call.c | grep -q '.size f, .-f'
+check 'direct call'
+
+# __builtin_expect
+# 很少执行的分支移到函数末尾，常见的一侧顺序执行
+echo 'void g(void); int f(int x) { if (__builtin_expect(x, 0)) g(); return x; }' > $tmp/expect.c
+$rvcc -O1 -o- $tmp/expect.c | sed -n '/ret$/,$p' | grep -q 'call g' &&
+  ! $rvcc -o- $tmp/expect.c | sed -n '/ret$/,$p' | grep -q 'call g'
+check __builtin_expect
+
+# 循环转换后每次迭代只有末尾的条件跳转
+echo 'int f(int n) { int s = 0; for (int i = 0; i < n; i++) s += i; return s; }' > $tmp/rotate.c
+! $rvcc -O1 -o- $tmp/rotate.c | grep -q 'j .L.begin' &&
+  $rvcc -o- $tmp/rotate.c | grep -q 'j .L.begin'
+check 'loop rotation'
+
+# 浮点常量从去重的常量池中读取，+0.0使用zero寄存器
+echo 'double f(double x) { return x * 3.14159 + 3.14159 + 0.0; }' > $tmp/fconst.c
+[ "$($rvcc -O1 -o- $tmp/fconst.c | grep -c '^.L.fconst')" = 1 ] &&
+  [ "$($rvcc -O1 -o- $tmp/fconst.c | grep -c 'lla t0, .L.fconst')" = 2 ] &&
+  $rvcc -O1 -o- $tmp/fconst.c | grep -q 'fmv.d.x fa0, zero' &&
+  ! $rvcc -o- $tmp/fconst.c | grep -q '.L.fconst'
+check 'float constant pool'
+
+# 浮点乘加融合默认关闭，由-ffp-contract=fast或-ffast-math开启
+echo 'double f(double a, double b, double c) { return a * b + c; }' > $tmp/fma.c
+$rvcc -ffp-contract=fast -o- $tmp/fma.c | grep -q 'fmadd.d fa0' &&
+  $rvcc -O1 -ffast-math -o- $tmp/fma.c | grep -q 'fmadd.d fa0' &&
+  ! $rvcc -O2 -o- $tmp/fma.c | grep -q 'fmadd' &&
+  ! $rvcc -O2 -ffast-math -ffp-contract=off -o- $tmp/fma.c | grep -q 'fmadd'
+check -ffp-contract
+
+# -ffast-math：除以任意常数改为乘法，不考虑NaN时使用fmin/fmax和相反的比较
+echo 'double f(double x) { return x / 3.0; } double g(double x) { return x / 4.0; }
+double h(double a, double b) { return a < b ? a : b; } int k(double a, double b) { return !(a < b); }' > $tmp/fastmath.c
+$rvcc -O1 -ffast-math -o- $tmp/fastmath.c | grep -q 'fmin.d' &&
+  $rvcc -O1 -ffast-math -o- $tmp/fastmath.c | grep -q 'fle.d' &&
+  ! $rvcc -O1 -ffast-math -o- $tmp/fastmath.c | grep -q 'fdiv' &&
+  [ "$($rvcc -O1 -o- $tmp/fastmath.c | grep -c 'fdiv')" = 1 ] &&
+  ! $rvcc -O1 -o- $tmp/fastmath.c | grep -q 'fmin'
+check -ffast-math
+
+# 两侧都很简单的条件表达式不使用分支，有Zicond时使用czero
+echo 'int f(int c, int a, int b) { return c ? a : b; } int g(int x) { return x < 0 ? -x : x; }' > $tmp/select.c
+! $rvcc -O1 -o- $tmp/select.c | grep -q 'beqz\|bnez\|bge\|blt' &&
+  $rvcc -O1 -o- $tmp/select.c | grep -q 'srai t0, a0, 63' &&
+  $rvcc -O1 -march=rv64gc_zicond -o- $tmp/select.c | grep -q 'czero.nez' &&
+  $rvcc -O1 -march=rv64gc_zbb -o- $tmp/select.c | grep -q 'max a0' &&
+  $rvcc -o- $tmp/select.c | grep -q 'beqz'
+check 'branchless select'
+
+# 成员和常量下标的偏移并入访存指令，全局变量的偏移并入%pcrel_hi
+echo 'struct C { int x, c; }; struct B { long y; struct C b; }; struct A { int z; struct B a; };
+int g[8]; int f(struct A *p) { return p->a.b.c; } int h(void) { return g[3]; }' > $tmp/addr.c
+$rvcc -O1 -o- $tmp/addr.c | grep -q 'lw a0, 20(a0)' &&
+  ! $rvcc -O1 -o- $tmp/addr.c | grep -q 'li t0' &&
+  $rvcc -O1 -o- $tmp/addr.c | grep -q '%pcrel_hi(g+12)' &&
+  ! $rvcc -o- $tmp/addr.c | grep -q 'lw a0, 20(a0)'
+check 'address folding'
+
+# 标量排在大数组之前，生存期不相交的块中的数组共用栈槽
+echo 'int g(int *p); int f(int n) { int x = n; int big[1000]; big[0] = x; g(big); return x; }
+int h(int n) { if (n) { int a[100]; return g(a); } else { int b[100]; return g(b); } }' > $tmp/frame.c
+$rvcc -o- $tmp/frame.c | grep -q 'addi a0, fp, -4$' &&
+  $rvcc -O1 -o- $tmp/frame.c | grep -q 'addi sp, sp, -432' &&
+  $rvcc -o- $tmp/frame.c | grep -q 'addi sp, sp, -816'
+check 'frame layout'
+
 echo OK
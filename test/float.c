@@ -1,5 +1,8 @@
 #include "test.h"
 
+// 全局变量，避免被常量折叠
+double G1=3, G2=5, GX=1, GY=2;
+
 int main() {
   // [140] 支持float和double用于局部变量或类型转换
   ASSERT(35, (float)(char)35);
@@ -92,6 +95,34 @@ int main() {
   ASSERT(5, 0.0 ? 3 : 5);
   ASSERT(3, 1.2 ? 3 : 5);
 
+  // 表达式临时寄存器
+  ASSERT(-1, ({ double a=1.5, b=2.5; (int)(4*((a+b)*(a-b)+(a*b)/(b-a))); }));
+  ASSERT(11, ({ float a=1, b=2, c=3; (int)((a+b)*(b+c)-(a+c)*(c-b)-(a*b+b*c-(a+b+c))-(a-b)*(c-a)); }));
+
+  // 浮点常量池
+  ASSERT(1, 3.14159 == 3.14159);
+  ASSERT(314, (int)(100 * 3.14159));
+  ASSERT(1, 3.14159f != 3.14159);
+  ASSERT(-314, (int)(-100 * 3.14159));
+  ASSERT(1, 0.0 == -0.0);
+  ASSERT(1, 1 / -0.0 < 0);
+  ASSERT(1, 1 / 0.0 > 0);
+  ASSERT(1, 1 / -0.0f < 0);
+  ASSERT(-170, (int)(-1.7f * 100));
+  ASSERT(40, (int)(10.0 + 2.5 * 12.0));
+  ASSERT(25, ({ double s=0; for (int i=0; i<10; i++) s+=2.5; (int)s; }));
+  ASSERT(31, ({ double s=0; for (int i=0; i<10; i++) s+=i*0.1+2.65; (int)s; }));
+
+  // 除以2的幂改为乘以倒数
+  ASSERT(2, ({ double x=10; (int)(x/4.0*100)==250 ? 2 : 0; }));
+  ASSERT(-125, ({ float x=10; (int)(x/-8.0f*100); }));
+  ASSERT(3, ({ double x=3; (int)(x/0.5/2); }));
+  ASSERT(333, ({ double x=10; (int)(x/3.0*100); }));
+  ASSERT(1, ({ double x=1; x/0.0 > 1e308; }));
+  ASSERT(47, (G1*G2 + GX) * GY + G1*G2);
+  ASSERT(1, !(G1*G2 < G1*G2 - GX));
+  ASSERT(0, !(G1*G2 - GX <= G1*G2));
+
   printf("OK\n");
   return 0;
 }
@@ -116,6 +116,65 @@ double add_double3(double x, double y, double z) {
   return x + y + z;
 }
 
+// 寄存器用完后，其余的实参通过栈传递
+long many_int(long a, long b, long c, long d, long e, long f, long g, long h, long i, int j, char k) {
+  return a + b*2 + c*3 + d*4 + e*5 + f*6 + g*7 + h*8 + i*9 + j*10 + k*11;
+}
+double many_mixed(int a, double b, int c, double d, int e, double f, int g, double h, int i, double j,
+                  int k, double l, int m, double n, int o, double p, int q, double r, int s, float t, int u) {
+  return a + b*2 + c*3 + d*4 + e*5 + f*6 + g*7 + h*8 + i*9 + j*10 + k*11 + l*12 + m*13 + n*14 +
+         o*15 + p*16 + q*17 + r*18 + s*19 + t*20 + u*21;
+}
+
+// 结构体按LP64D的约定通过寄存器传递和返回
+typedef struct { int a, b; short c; char d; } Ty4;
+typedef struct { char a[3]; } Ty5;
+typedef struct { float a; double b; } Ty6;
+typedef struct { double a; int b; } Ty7;
+typedef struct { float a[2]; } Ty8;
+typedef union { double d; long l; } Ty9;
+typedef struct { long a, b, c; } Ty10;
+typedef struct { char buf[300]; } Ty11;
+
+int struct_test4(Ty4 x, int n) {
+  switch (n) {
+  case 0: return x.a;
+  case 1: return x.b;
+  case 2: return x.c;
+  default: return x.d;
+  }
+}
+int struct_test5(Ty5 x, int n) { return x.a[n]; }
+double struct_test6(Ty6 x) { return x.a * 10 + x.b; }
+double struct_test7(int n, Ty7 x) { return x.a * n + x.b; }
+double struct_test8(Ty8 x, Ty6 y) { return x.a[0] + x.a[1] * 2 + y.a * 3 + y.b * 4; }
+long struct_test9(Ty9 x) { return x.l; }
+long struct_test10(Ty10 x) { long r = x.a + x.b * 2 + x.c * 3; x.a = 100; return r; }
+int struct_test11(Ty11 x, int n) { x.buf[0] = 9; return x.buf[n]; }
+// 前一半在a7中，后一半在栈中；浮点寄存器用完时按整型约定
+long struct_split(long a, long b, long c, long d, long e, long f, long g, Ty4 x, Ty4 y) {
+  return a + b + c + d + e + f + g + x.a * 10 + x.d * 100 + y.b * 1000;
+}
+// 较大结构体的地址在栈中传入，形参就使用调用者的副本
+long struct_stack10(long a, long b, long c, long d, long e, long f, long g, long h, Ty10 x) {
+  Ty10 *p = &x;
+  p->b += a + h;
+  return x.a + x.b * 10 + x.c * 100;
+}
+double struct_nofp(double a, double b, double c, double d, double e, double f, double g, Ty6 x, Ty7 y) {
+  return a + b + c + d + e + f + g + x.a * 10 + x.b * 100 + y.a * 1000 + y.b * 10000;
+}
+
+Ty4 struct_ret4(void) { return (Ty4){10, 20, 30, 40}; }
+Ty5 struct_ret5(void) { return (Ty5){{1, 2, 3}}; }
+Ty6 struct_ret6(float a, double b) { Ty6 x = {a, b}; return x; }
+Ty7 struct_ret7(void) { return (Ty7){2.5, -3}; }
+Ty8 struct_ret8(void) { return (Ty8){{1.5, 2.5}}; }
+Ty10 struct_ret10(long n) { return (Ty10){n, n * 2, n * 3}; }
+Ty10 struct_ret10b(Ty10 x) { Ty10 y = x; y.a += 1; return y; }
+Ty10 struct_fwd10(long n) { return struct_ret10(n + 1); }
+Ty11 struct_ret11(int n) { Ty11 x; for (int i = 0; i < 300; i++) x.buf[i] = i + n; return x; }
+
 // [151] 支持函数指针
 int (*fnptr(int (*fn)(int n, ...)))(int, ...) {
   return fn;
@@ -220,6 +279,53 @@ int main() {
   // [152] 在函数参数中退化函数为指针
   ASSERT(3, param_decay2(ret3));
 
+  // 表达式临时寄存器: 含调用的一侧先算，两侧都有调用时压栈
+  ASSERT(25, add2(1,2) * (sub2(9,4) - add2(1,1)) + fib(5) * 2);
+  ASSERT(22, (add2(1,2)+add2(3,4)) * (sub2(5,1)-sub2(2,1)) - (fib(3)+fib(4)));
+
+  // 多于8个的实参通过栈传递，含调用的实参先计算
+  ASSERT(506, many_int(1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11));
+  ASSERT(440, many_int(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10));
+  ASSERT(551, many_int(add2(1, 1), 2, sub2(5, 2), 4, 5, add2(3, 3), 7, 8, sub2(10, 1), add2(4, 6), 11) + many_int(0,0,0,0,0,0,0,0,0,0,4));
+  ASSERT(3311, many_mixed(1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21));
+  ASSERT(3311, many_mixed(1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, add2(8, 9), 18, 19, 20, sub2(22, 1)));
+  ASSERT(0, ({ char buf[100]; sprintf(buf, "%d %d %d %d %d %d %d %d %d %d", 1, 2, 3, 4, 5, 6, 7, 8, 9, 10); strcmp(buf, "1 2 3 4 5 6 7 8 9 10"); }));
+  ASSERT(0, ({ char buf[100]; sprintf(buf, "%d %.1f %d %.1f %d %.1f %d %.1f %d %.1f", 1, 2.5, 3, 4.5, 5, 6.5, 7, 8.5, 9, 10.5); strcmp(buf, "1 2.5 3 4.5 5 6.5 7 8.5 9 10.5"); }));
+
+
+  // 结构体的传递和返回
+  ASSERT(10, ({ Ty4 x={10,20,30,40}; struct_test4(x, 0); }));
+  ASSERT(20, ({ Ty4 x={10,20,30,40}; struct_test4(x, 1); }));
+  ASSERT(30, ({ Ty4 x={10,20,30,40}; struct_test4(x, 2); }));
+  ASSERT(40, ({ Ty4 x={10,20,30,40}; struct_test4(x, 3); }));
+  ASSERT(3, ({ Ty5 x={{1,2,3}}; struct_test5(x, 2); }));
+  ASSERT(17, ({ Ty6 x={1.5,2}; struct_test6(x); }));
+  ASSERT(-5, ({ Ty7 x={2.5,-10}; struct_test7(2, x); }));
+  ASSERT(23, ({ Ty8 x={{1,2}}; Ty6 y={2,3}; struct_test8(x, y); }));
+  ASSERT(42, ({ Ty9 x; x.l=42; struct_test9(x); }));
+  ASSERT(14, ({ Ty10 x={1,2,3}; struct_test10(x); }));
+  ASSERT(1, ({ Ty10 x={1,2,3}; struct_test10(x); x.a; }));
+  ASSERT(7, ({ Ty11 x; x.buf[0]=1; x.buf[299]=7; struct_test11(x, 299); }));
+  ASSERT(1, ({ Ty11 x; x.buf[0]=1; struct_test11(x, 0); x.buf[0]; }));
+  ASSERT(48128, struct_split(1, 2, 3, 4, 5, 6, 7, (Ty4){10,20,30,40}, (Ty4){1,44,3,4}));
+  ASSERT(321, struct_stack10(1, 2, 3, 4, 5, 6, 7, 8, (Ty10){1,3,2}));
+  ASSERT(3, ({ Ty10 x={1,3,2}; struct_stack10(1, 2, 3, 4, 5, 6, 7, 8, x); x.b; }));
+  ASSERT(-27907, struct_nofp(1, 2, 3, 4, 5, 6, 7, (Ty6){1.5,0.5}, (Ty7){2,-3}));
+  ASSERT(10, struct_ret4().a);
+  ASSERT(40, struct_ret4().d);
+  ASSERT(3, struct_ret5().a[2]);
+  ASSERT(32, ({ Ty6 x = struct_ret6(3, 2); x.a * 10 + x.b; }));
+  ASSERT(-3, struct_ret7().b);
+  ASSERT(5, ({ Ty7 x = struct_ret7(); x.a * 2; }));
+  ASSERT(4, ({ Ty8 x = struct_ret8(); x.a[0] + x.a[1]; }));
+  ASSERT(15, struct_ret10(5).c);
+  ASSERT(6, ({ Ty10 x = struct_ret10(2); x.a + x.b; }));
+  ASSERT(61, ({ Ty10 x = struct_ret10(20); x = struct_ret10b(x); x.a + x.b; }));
+  ASSERT(9, struct_fwd10(2).c);
+  ASSERT(140, ({ Ty10 x; x = struct_ret10(10); struct_test10(x); }));
+  ASSERT(50, ({ Ty11 x = struct_ret11(1); x.buf[49]; }));
+  ASSERT(44, ({ Ty9 u; u.l=22; struct_test4(struct_ret4(), 1) + struct_test5(struct_ret5(), 1) + struct_test9(u); }));
+
   printf("OK\n");
   return 0;
 }
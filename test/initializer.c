@@ -38,6 +38,29 @@ char g43[][4] = {'f', 'o', 'o', 0, 'b', 'a', 'r', 0};
 // [109] 允许标量初始化时有多余的大括号
 char *g44 = {"foo"};
 
+// 块内存清零
+int blkDirty(void) {
+  long x[1200];
+  for (int i = 0; i < 1200; i++)
+    x[i] = -1;
+  return x[1199];
+}
+
+int blkZero(int n) {
+  char c[3] = {1};
+  long pad[300];
+  long s[2] = {n};
+  int m[30] = {n};
+  char b[101] = {n};
+  long big[600] = {n};
+  pad[0] = 0;
+  long sum = c[0] + c[1] + c[2] + s[0] + s[1];
+  for (int i = 0; i < 30; i++) sum += m[i];
+  for (int i = 0; i < 101; i++) sum += b[i];
+  for (int i = 0; i < 600; i++) sum += big[i];
+  return sum;
+}
+
 int main() {
   // [97] 支持局部变量初始化器
   ASSERT(1, ({ int x[3]={1,2,3}; x[0]; }));
@@ -196,6 +219,9 @@ int main() {
   ASSERT(1, ({ union {int a; char b;} x={1,}; x.a; }));
   ASSERT(2, ({ enum {x,y,z,}; z; }));
 
+  // 块内存清零
+  ASSERT(21, ({ blkDirty(); blkZero(5); }));
+
   printf("OK\n");
   return 0;
 }
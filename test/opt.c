@@ -0,0 +1,149 @@
+#include "test.h"
+
+typedef struct { int x, y; } Pt;
+
+int OptG;
+int optBump(void) { return ++OptG; }
+int optSet(int *p, int v) { *p = v; return v; }
+Pt OptPt = {3, 4};
+int OptArr[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+
+static int optGetX(Pt *p) { return p->x; }
+static inline int optMax(int a, int b) { if (a > b) return a; return b; }
+static int optFact(int n) { return n <= 1 ? 1 : n * optFact(n - 1); }
+static int optSum(int n) { int s = 0; for (int i = 0; i < n; i++) { if (i == 3) continue; if (i > 6) break; s += i; } return s; }
+static int optSw(int x) { switch (x) { case 1: return 10; case 2: return 20; default: return 30; } }
+static int optLbl(int x) { if (x) goto out; x = 5; out: return x + 1; }
+static void optClear(int *p, int n) { if (!p) return; for (int i = 0; i < n; i++) p[i] = 0; }
+static int optAddr(int a) { int *p = &a; *p += 1; return a; }
+static int OptIdx;
+static int optNextIdx(void) { OptIdx++; return 1; }
+static int optCompound(int *a, int i) {
+  struct { int v[4]; } s = {{1, 2, 3, 4}};
+  a[i] += a[i] * 2; a[i + 1] <<= 2; a[i]++; s.v[i] -= 3;
+  int b[2] = {10, 20};
+  OptIdx = 0;
+  // 地址依赖于被调用修改的变量，只能求值一次
+  b[OptIdx] += optNextIdx();
+  int r = b[0] * 100 + b[1];
+  return (r == 1120 || r == 1021) * 10000 + a[i] * 100 + a[i + 1] * 10 + s.v[i];
+}
+static double optHalf(double d) { return d / 2; }
+static int optPtrFn(int x) { return x + 7; }
+__attribute__((noinline)) static int optNo(int x) { return x + 1; }
+static __attribute__((always_inline)) int optAlways(int x) { return x * 2; }
+
+// 尾调用
+long optTailSum(long n, long acc) { if (!n) return acc; return optTailSum(n - 1, acc + n); }
+int optIsOdd(int n);
+int optIsEven(int n) { if (!n) return 1; return optIsOdd(n - 1); }
+int optIsOdd(int n) { if (!n) return 0; return optIsEven(n - 1); }
+long optTailCast(int x) { return optSet(&OptG, x); }
+char optTailChar(int x) { return optSet(&OptG, x); }
+int optTailEsc(int x) { Pt p = {x, 0}; return optGetX(&p) * 2; }
+double optTailF(double d, int n) { return n ? optTailF(d * 2, n - 1) : d; }
+
+// 省略帧指针
+static int optLeaf(int a, int b) { return a * b + 3; }
+int optBigFrame(int x) {
+  int big[600];
+  for (int i = 0; i < 600; i++) big[i] = i;
+  double d = x;
+  return optLeaf(x, big[599]) + (optLeaf(big[1], 2) + (optLeaf(x, x) + (int)(d * optHalf(4.0))));
+}
+
+// 循环向量化
+float VecX[37], VecY[37];
+int VecGa[50], VecGb[50], VecGc[50];
+static void vecSaxpy(float a, float *x, float *y, int n) { for (int i = 0; i < n; i++) y[i] = a * x[i] + y[i]; }
+static void vecHalfAdd(unsigned char *d, unsigned char *s, int n) { for (int i = 0; i < n; i++) d[i] += s[i] >> 1; }
+static void vecShort(short *d, short *s, int n) { for (int i = 0; i < n; i++) d[i] = -s[i] + ~d[i]; }
+static int vecSum(int *a, int n) { int s = 0; for (int i = 0; i < n; i++) s += a[i]; return s; }
+static int vecXor(int *a, int n) { int x = 0; for (int i = 0; i < n; i++) x ^= a[i] * 3 + 1; return x; }
+static long vecLong(long *d, long *a, long *b, long k, int n) { long s = 0; for (int i = 0; i < n; i++) { d[i] = a[i] * k - b[i]; s += d[i]; } return s; }
+static double vecDot(double *x, double *y, int n) { double s = 0; for (int i = 0; i < n; i++) s += x[i] * y[i]; return s; }
+static void vecInc(int *d, int *s, int n) { for (int i = 0; i < n; i++) d[i] = s[i] + 1; }
+static int vecLast(int *a, int m, int n) { int i; for (i = m; i < n; i++) a[i] = a[i] * 2 + 1; return i; }
+static int vecLe(int *a, unsigned n) { unsigned i; for (i = 0; i <= n; i++) a[i] = a[i] << 3; return i; }
+static int vecRow(int m[4][20], int j, int n) { int s = 0; for (int i = 0; i < n; i++) { m[j][i] = m[j][i] ^ j; s |= m[j][i] << j; } return s; }
+static void vecGlobal(int n) { for (int i = 0; i < n; i++) VecGa[i] = (VecGb[i] & VecGc[i]) - (VecGb[i] >> 2); }
+
+int main() {
+  // [CSE] 相同的纯表达式只计算一次
+  ASSERT(7, ({ Pt a[3]={{0,0},{1,2},{3,4}}; int i=2; a[i].x + a[i].y; }));
+  ASSERT(30, ({ int a=2,b=3,c=4; (a*b+c)*(a*b-c) + (a*b+c); }));
+  ASSERT(12, ({ int x[4]={1,2,3,4}; int i=1; x[i+1]*x[i+1] + x[i+1]; }));
+  // 中间的写入会使表达式失效
+  ASSERT(8, ({ int a=2,b=3; int s=a*b+1; a=4; s + (a*b+1) - 12; }));
+  ASSERT(9, ({ int x[2]={1,2}; int *p=x; int s=p[1]*p[1]; p[1]=3; s + p[1]*p[1] - 4; }));
+  ASSERT(10, ({ int a=2; int *p=&a; int s=a*a+1; *p=3; s + (a*a+1) - 5; }));
+  ASSERT(3, ({ OptG=1; int s=OptG*OptG+OptG; optBump(); s + OptG*OptG+OptG - 5; }));
+  ASSERT(20, ({ int v=1; int s=v*v+v; optSet(&v, 3); s + v*v+v + 6; }));
+  // 条件执行的计算不会被之后复用
+  ASSERT(6, ({ int a=2,b=3,r=0; if (a>5) r=a*b+1; r + (a*b+1) - 1; }));
+  ASSERT(7, ({ int a=2,b=3; (a>5 && a*b+1) + (a*b+1); }));
+  // 循环中的写入
+  ASSERT(45, ({ int s=0,i=0,k=1; for (; i<5; i++) { s += k*k+2; k++; } s - 20; }));
+  ASSERT(18, ({ int s=0,i=0; do { s += i*i+1; i++; } while (i*i+1 < 17); s; }));
+  ASSERT(10, ({ int r=0,a=2,b=3; switch (a) { case 1: r=a*b+4; case 2: r+=a*b+4; } r; }));
+
+  // [LICM] 循环不变量外提
+  ASSERT(44, ({ int s=0; for (int i=0; i<4; i++) s += OptArr[i] * (OptPt.x + OptPt.y) - OptPt.x * 4 + OptArr[i]; s + 12; }));
+  ASSERT(28, ({ int s=0,n=3; int *p=OptArr; int i=0; do { s += p[n] + p[n+1]; } while (++i < 3); s + 1; }));
+  ASSERT(3, ({ int s=0,k=2; for (int i=0; i<5; i++) { s += k*k-2; if (i==2) k=1; } s - 1; }));
+  ASSERT(16, ({ int s=0; for (int i=0; i<4; i++) { s += OptPt.x + 1; OptPt.x = 3; } OptPt.x=3; s; }));
+  ASSERT(6, ({ int s=0; int *p=0; for (int i=0; i<0; i++) s += p[3]; s + 6; }));
+  ASSERT(9, ({ int s=0; int *p=0; for (int i=0; i<3; i++) if (p) s += p[1]; else s += 3; s; }));
+  ASSERT(12, ({ int s=0,i=0; for (;;) { if (i++ == 3) break; s += optBump() * 0 + OptArr[3]; } s; }));
+  ASSERT(15, ({ int s=0,t=0; for (int i=0; i<3; i++) for (int j=0; j<2; j++) { s += OptArr[i] + OptArr[2]; t++; } s - t - 9; }));
+  ASSERT(9, ({ int s=0,i=0; goto in; for (; i<3; i++) { in: s += OptArr[1] * 2; } s - 3; }));
+
+  // [内联] 函数内联
+  ASSERT(3, ({ Pt q={3,4}; optGetX(&q); }));
+  ASSERT(7, optMax(3, 7));
+  ASSERT(9, optMax(9, 2));
+  ASSERT(16, ({ int s=0; for (int i=0; i<6; i++) s += optMax(i, 1); s; }));
+  ASSERT(120, optFact(5));
+  ASSERT(18, optSum(10));
+  ASSERT(60, optSw(1) + optSw(2) + optSw(5));
+  ASSERT(10, optLbl(3) + optLbl(0));
+  ASSERT(0, ({ int a[3]={1,2,3}; optClear(a, 3); optClear(0, 3); a[0]+a[1]+a[2]; }));
+  ASSERT(6, optAddr(5));
+  ASSERT(10819, ({ int a[3] = {0, 2, 3}; optCompound(a, 1); }));
+  ASSERT(3, (int)optHalf(7.0));
+  ASSERT(15, ({ int (*fp)(int) = optPtrFn; fp(1) + optPtrFn(0); }));
+  ASSERT(4, optNo(3));
+  ASSERT(10, optAlways(5));
+
+  ASSERT(50005000, optTailSum(10000, 0));
+  ASSERT(1, optIsEven(10000));
+  ASSERT(1, optIsOdd(9999));
+  ASSERT(-3, optTailCast(-3));
+  ASSERT(44, optTailChar(300));
+  ASSERT(14, optTailEsc(7));
+  ASSERT(24, (int)optTailF(3.0, 3));
+  ASSERT(1823, optBigFrame(3));
+
+  // [向量化] 简单的数组循环
+  ASSERT(1403, ({ for (int i=0; i<37; i++) { VecX[i]=i; VecY[i]=i%5; } vecSaxpy(2.0f, VecX, VecY, 37); int s=0; for (int i=0; i<37; i++) s += VecY[i]; s; }));
+  ASSERT(13924, ({ unsigned char d[100], s[100]; for (int i=0; i<100; i++) { d[i]=i*7; s[i]=255-i; } vecHalfAdd(d, s, 100); int r=0; for (int i=0; i<100; i++) r += d[i]; r; }));
+  ASSERT(-6900, ({ short d[30], s[30]; for (int i=0; i<30; i++) { d[i]=i*300; s[i]=1000-i*77; } vecShort(d, s, 30); int r=0; for (int i=0; i<30; i++) r += d[i] ^ i; r % 10000; }));
+  ASSERT(4950, ({ int a[100]; for (int i=0; i<100; i++) a[i]=i; vecSum(a, 100); }));
+  ASSERT(0, ({ int a[3]={1,2,3}; vecSum(a, 0) + vecSum(a, -5); }));
+  ASSERT(2581, ({ int a[61]; for (int i=0; i<61; i++) a[i]=i*i; vecXor(a, 61); }));
+  ASSERT(11, ({ long d[19], a[19], b[19]; for (int i=0; i<19; i++) { a[i]=i*1000000007L; b[i]=i; } long r=vecLong(d, a, b, 3, 19); r % 7 + d[18] % 11; }));
+  ASSERT(1, ({ double x[45], y[45]; for (int i=0; i<45; i++) { x[i]=0.1*i; y[i]=1.0/(i+1); } double s=0; for (int i=0; i<45; i++) s += x[i]*y[i]; vecDot(x, y, 45) == s; }));
+  // 重叠的数组退回标量循环
+  ASSERT(55, ({ int a[11]={0}; vecInc(a+1, a, 10); int s=0; for (int i=0; i<11; i++) s += a[i]; s; }));
+  ASSERT(10, ({ int a[11]={0}; vecInc(a, a+1, 10); int s=0; for (int i=0; i<11; i++) s += a[i]; s; }));
+  ASSERT(1, ({ int a[20]={0}; vecInc(a, a, 20); vecInc(a, a, 20); a[0]==2 && a[19]==2; }));
+  // 循环变量的最终值
+  ASSERT(504079, ({ int a[40]; for (int i=0; i<40; i++) a[i]=i; int r=vecLast(a, 3, 40) * 100; r + a[39] + vecLast(a, 50, 40) * 10000; }));
+  ASSERT(162, ({ int a[18]; for (int i=0; i<18; i++) a[i]=i; int r=vecLe(a, 16); r + a[16] + a[17]; }));
+  ASSERT(1, ({ int m[4][20]={0}; vecRow(m, 2, 17); m[2][16]==2 && m[2][17]==0 && m[1][16]==0 && m[3][0]==0; }));
+  ASSERT(252, ({ int m[4][20]; for (int i=0; i<20; i++) m[2][i]=i*3; vecRow(m, 2, 20); }));
+  ASSERT(-1131, ({ for (int i=0; i<50; i++) { VecGb[i]=i*13; VecGc[i]=i*5+3; } vecGlobal(50); int s=0; for (int i=0; i<50; i++) s += VecGa[i]; s; }));
+
+  printf("OK\n");
+  return 0;
+}
@@ -43,6 +43,10 @@ int main() {
   ASSERT(4, ({ int x[2][3]; int *y=x; y[4]=4; x[1][1]; }));
   ASSERT(5, ({ int x[2][3]; int *y=x; y[5]=5; x[1][2]; }));
 
+  ASSERT(5, ({ struct {int a,b,c;} s[10]; &s[7] - &s[2]; }));
+  ASSERT(-5, ({ struct {int a,b,c;} s[10]; &s[2] - &s[7]; }));
+  ASSERT(3, ({ struct {char a[24];} s[10]; &s[9] - &s[6]; }));
+
   printf("OK\n");
   return 0;
 }
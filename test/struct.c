@@ -1,5 +1,50 @@
 #include "test.h"
 
+// 块复制
+typedef struct { unsigned char a[3]; } Blk3;
+typedef struct { long a[3]; } Blk24;
+typedef struct { int a[25]; } Blk100;
+typedef struct { unsigned char a[201]; } Blk201;
+typedef struct { long a[125]; } Blk1000;
+
+int blkCopy(int n) {
+  Blk3 a, a2; Blk24 b, b2; Blk100 c, c2, c3; Blk201 d, d2; Blk1000 e, e2;
+  for (int i = 0; i < 3; i++) a.a[i] = i + n;
+  for (int i = 0; i < 3; i++) b.a[i] = i + n;
+  for (int i = 0; i < 25; i++) c.a[i] = i + n;
+  for (int i = 0; i < 201; i++) d.a[i] = i + n;
+  for (int i = 0; i < 125; i++) e.a[i] = i + n;
+  a2 = a; b2 = b; c3 = c2 = c; d2 = d; e2 = e;
+  int sum = 0;
+  for (int i = 0; i < 3; i++) sum += a2.a[i] + b2.a[i];
+  for (int i = 0; i < 25; i++) sum += c2.a[i] + c3.a[i];
+  for (int i = 0; i < 201; i++) sum += d2.a[i];
+  for (int i = 0; i < 125; i++) sum += e2.a[i];
+  return sum;
+}
+
+typedef struct { int x, c; } AmC;
+typedef struct { long y; AmC b; } AmB;
+typedef struct { int z; AmB a; int big[1000]; } AmA;
+AmA amG;
+int amArr[1000];
+
+int amNext(int *p) { return p[-1] + p[1]; }
+
+int addrFold(AmA *p) {
+  AmA l;
+  p->a.b.c = 3; p->a.b.x = 4; p->z = 5;
+  l.a.b.c = p->a.b.c + 1;
+  p->big[0] = 6; p->big[2] = 7; p->big[999] = amNext(&p->big[1]);
+  l.big[900] = p->big[999] * 2;
+  amG.a.b.c = 11; amG.big[600] = 12;
+  amArr[3] = 13; amArr[999] = amArr[3] + amNext(&amArr[3]);
+  short *s = (short *)&amArr[4];
+  s[1] = 1;
+  return p->a.b.c + p->a.b.x * 10 + l.a.b.c * 100 + p->big[999] * 1000 +
+         l.big[900] * 10000 + amG.a.b.c + amG.big[600] + amArr[999] + amArr[4];
+}
+
 int main() {
   // [49] 支持struct
   ASSERT(1, ({ struct {int a; int b;} x; x.a=1; x.b=2; x.a; }));
@@ -68,6 +113,14 @@ int main() {
   ASSERT(1, ({ struct T { struct T *next; int x; } a; struct T b; b.x=1; a.next=&b; a.next->x; }));
   ASSERT(4, ({ typedef struct T T; struct T { int x; }; sizeof(T); }));
 
+  // 块复制
+  ASSERT(28838, blkCopy(1));
+
+  // 常量偏移并入访存指令
+  ASSERT(339015, ({ AmA a; addrFold(&a); }));
+  ASSERT(404559, addrFold(&amG));
+  ASSERT(11, amG.a.b.c);
+
   printf("OK\n");
   return 0;
 }
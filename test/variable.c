@@ -5,6 +5,21 @@ int g1, g2[4];
 // [123] 支持静态全局变量
 static int g3 = 3;
 
+typedef struct { int v[3]; } Trip;
+
+// 生存期不相交的块中的变量共用栈槽
+int slotShare(int n) {
+  int sum = 0;
+  for (int i = 0; i < n; i++) {
+    if (i % 2) { int a[50]; for (int j = 0; j < 50; j++) a[j] = i + j; sum += a[49]; }
+    else { char b[30]; long c = i * 3; for (int j = 0; j < 30; j++) b[j] = j; sum += b[29] + c; }
+    { struct { int x; long y; } s = { i, sum }; sum = s.x + s.y; }
+  }
+  int big[600];
+  big[599] = sum;
+  return big[599] + ({ Trip t = {{1, 2, 3}}; t; }).v[2];
+}
+
 int main() {
   // [10] 支持单字母变量
   ASSERT(3, ({ int a; a=3; a; }));
@@ -57,8 +72,9 @@ int main() {
   ASSERT(3, ({ int x=2; { x=3; } x; }));
 
   // [51] 对齐局部变量
-  ASSERT(7, ({ int x; int y; char z; char *a=&y; char *b=&z; b-a; }));
-  ASSERT(1, ({ int x; char y; int z; char *a=&y; char *b=&z; b-a; }));
+  // 栈帧按类型排序、紧密排列后，相邻变量的地址差不再固定，这里只检查对齐
+  ASSERT(0, ({ char z; int y; char w; long x; ((long)&y % 4) + ((long)&x % 8); }));
+  ASSERT(0, ({ int x; char y; int z; ((long)&x % 4) + ((long)&z % 4); }));
 
   // [57] 支持long类型
   ASSERT(8, ({ long x; sizeof(x); }));
@@ -82,6 +98,9 @@ int main() {
   // [123] 支持静态全局变量
   ASSERT(3, g3);
 
+  // 栈帧布局
+  ASSERT(523, slotShare(10));
+
   printf("OK\n");
   return 0;
 }
@@ -50,6 +50,7 @@ static bool isKeyword(Token *Tok) {
             "extern", "sizeof", "static", "signed", "unsigned",
             "_Alignof", "_Alignas", "const", "volatile", "auto", "register", 
             "restrict", "__restrict", "__restrict__", "_Noreturn",
+            "inline", "__inline", "__inline__", "__attribute__",
         };
 
     return equal2(Tok, sizeof(Kw) / sizeof(*Kw), Kw);
@@ -45,6 +45,11 @@ bool isNumeric(Type *Ty) {
     return isInteger(Ty) || isFloNum(Ty); 
 }
 
+// 判断是否为结构体或联合体
+bool isStructOrUnion(Type *Ty) {
+    return Ty->Kind == TY_STRUCT || Ty->Kind == TY_UNION;
+}
+
 bool isChar(Type *Ty){
     return Ty->Kind == TY_CHAR;
 }
@@ -272,9 +277,12 @@ void addType(Node *Nd) {
         case ND_LOGAND:
             Nd->Ty = TyInt;
             return;
+        // 对左部进行整数提升，结果为提升后的类型
         case ND_BITNOT:
         case ND_SHL:
         case ND_SHR:
+            if (isInteger(Nd->LHS->Ty))
+                Nd->LHS = newCast(Nd->LHS, getCommonType(TyInt, Nd->LHS->Ty));
             Nd->Ty = Nd->LHS->Ty;
             return;
         // 如果:左或右部为void则为void，否则为二者兼容的类型